@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+// Pixel conversions used by the render drivers when they upload textures.
+// Every kernel converts a single row of count pixels. The source and destination must not overlap, but need no particular alignment.
+struct TextureConvertKernels
+{
+	// dst = palette[src], with the 32-bit palette entries copied as they are
+	void (*P8)(uint32_t* dst, const uint8_t* src, int count, const uint32_t* palette);
+
+	// BGRA8 lightmap texels to RGBA8, with every channel doubled and saturated
+	void (*BGRA8_LM)(uint8_t* dst, const uint8_t* src, int count);
+
+	// RGB8 to RGBA8 with alpha set to 255
+	void (*RGB8)(uint8_t* dst, const uint8_t* src, int count);
+
+	// 10:10:10:2 texels, red in the top bits and alpha in the bottom two, to RGBA16 unorm
+	void (*RGB10A2)(uint16_t* dst, const uint32_t* src, int count);
+
+	// 10:10:10:2 texels to RGBA16 uint, keeping the raw values
+	void (*RGB10A2_UI)(uint16_t* dst, const uint32_t* src, int count);
+
+	// 10:10:10:2 lightmap texels to RGBA16 unorm, with every channel doubled and saturated
+	void (*RGB10A2_LM)(uint16_t* dst, const uint32_t* src, int count);
+};
+
+enum class TextureConvertBackend
+{
+	Scalar,
+	SSE2,
+	SSSE3,
+	AVX2,
+	NEON,
+	Count
+};
+
+class TextureConvert
+{
+public:
+	// The fastest kernels the CPU supports. Picked once on first use.
+	static const TextureConvertKernels& Get();
+
+	// The kernels of one instruction set, with formats it has no kernel for taken from the next lower set.
+	// Returns nullptr if the CPU or the build can't run them. The scalar kernels are always available and are the reference the others must match.
+	static const TextureConvertKernels* Get(TextureConvertBackend backend);
+
+	static TextureConvertBackend GetBestBackend();
+	static const char* GetName(TextureConvertBackend backend);
+};
@@ -0,0 +1,255 @@
+#include "textureconvert_kernels.h"
+
+#if defined(TEXTURECONVERT_X86)
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+void ScalarP8(uint32_t* dst, const uint8_t* src, int count, const uint32_t* palette)
+{
+	for (int j = 0; j < count; j++)
+	{
+		dst[j] = palette[src[j]];
+	}
+}
+
+void ScalarBGRA8_LM(uint8_t* dst, const uint8_t* src, int count)
+{
+	for (int j = 0; j < count; j++)
+	{
+		dst[0] = src[2] < 128 ? src[2] << 1 : 255;
+		dst[1] = src[1] < 128 ? src[1] << 1 : 255;
+		dst[2] = src[0] < 128 ? src[0] << 1 : 255;
+		dst[3] = src[3] < 128 ? src[3] << 1 : 255;
+		dst += 4;
+		src += 4;
+	}
+}
+
+void ScalarRGB8(uint8_t* dst, const uint8_t* src, int count)
+{
+	for (int j = 0; j < count; j++)
+	{
+		dst[0] = src[0];
+		dst[1] = src[1];
+		dst[2] = src[2];
+		dst[3] = 255;
+		dst += 4;
+		src += 3;
+	}
+}
+
+void ScalarRGB10A2(uint16_t* dst, const uint32_t* src, int count)
+{
+	for (int j = 0; j < count; j++)
+	{
+		uint32_t c = src[j];
+		uint32_t r = (c >> 22) & 0x3ff;
+		uint32_t g = (c >> 12) & 0x3ff;
+		uint32_t b = (c >> 2) & 0x3ff;
+		uint32_t a = c & 0x3;
+
+		r = r * 0xffff / 0x3ff;
+		g = g * 0xffff / 0x3ff;
+		b = b * 0xffff / 0x3ff;
+		a = a * 0xffff / 0x3;
+
+		*(dst++) = r;
+		*(dst++) = g;
+		*(dst++) = b;
+		*(dst++) = a;
+	}
+}
+
+void ScalarRGB10A2_UI(uint16_t* dst, const uint32_t* src, int count)
+{
+	for (int j = 0; j < count; j++)
+	{
+		uint32_t c = src[j];
+		*(dst++) = (c >> 22) & 0x3ff;
+		*(dst++) = (c >> 12) & 0x3ff;
+		*(dst++) = (c >> 2) & 0x3ff;
+		*(dst++) = c & 0x3;
+	}
+}
+
+void ScalarRGB10A2_LM(uint16_t* dst, const uint32_t* src, int count)
+{
+	for (int j = 0; j < count; j++)
+	{
+		uint32_t c = src[j];
+		uint32_t r = (c >> 22) & 0x3ff;
+		uint32_t g = (c >> 12) & 0x3ff;
+		uint32_t b = (c >> 2) & 0x3ff;
+		uint32_t a = c & 0x3;
+
+		r = r < 0x200 ? (r << 1) * 0xffff / 0x3ff : 0xffff;
+		g = g < 0x200 ? (g << 1) * 0xffff / 0x3ff : 0xffff;
+		b = b < 0x200 ? (b << 1) * 0xffff / 0x3ff : 0xffff;
+		a = a < 0x2 ? (a << 1) * 0xffff / 0x3 : 0xffff;
+
+		*(dst++) = r;
+		*(dst++) = g;
+		*(dst++) = b;
+		*(dst++) = a;
+	}
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+	struct CPUFeatures
+	{
+		bool SSE2 = false;
+		bool SSSE3 = false;
+		bool AVX2 = false;
+		bool NEON = false;
+	};
+
+#if defined(TEXTURECONVERT_X86)
+	void CPUID(int leaf, int subleaf, unsigned int regs[4])
+	{
+#if defined(_MSC_VER)
+		int r[4];
+		__cpuidex(r, leaf, subleaf);
+		for (int i = 0; i < 4; i++)
+			regs[i] = (unsigned int)r[i];
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+#if !defined(_MSC_VER)
+	__attribute__((target("xsave")))
+#endif
+	uint64_t GetXCR0()
+	{
+		return _xgetbv(0);
+	}
+#endif
+
+	CPUFeatures DetectCPUFeatures()
+	{
+		CPUFeatures features;
+#if defined(TEXTURECONVERT_X86)
+		unsigned int regs[4];
+		CPUID(0, 0, regs);
+		unsigned int maxLeaf = regs[0];
+		if (maxLeaf >= 1)
+		{
+			CPUID(1, 0, regs);
+			features.SSE2 = (regs[3] & (1u << 26)) != 0;
+			features.SSSE3 = (regs[2] & (1u << 9)) != 0;
+
+			// AVX2 also needs the OS to save the upper halves of the ymm registers
+			bool osxsave = (regs[2] & (1u << 27)) != 0;
+			bool avx = (regs[2] & (1u << 28)) != 0;
+			if (maxLeaf >= 7 && osxsave && avx && (GetXCR0() & 6) == 6)
+			{
+				CPUID(7, 0, regs);
+				features.AVX2 = (regs[1] & (1u << 5)) != 0;
+			}
+		}
+#elif defined(TEXTURECONVERT_NEON)
+		features.NEON = true;
+#endif
+		return features;
+	}
+
+	struct BackendTable
+	{
+		BackendTable()
+		{
+			CPUFeatures cpu = DetectCPUFeatures();
+
+			TextureConvertKernels kernels;
+			kernels.P8 = ScalarP8;
+			kernels.BGRA8_LM = ScalarBGRA8_LM;
+			kernels.RGB8 = ScalarRGB8;
+			kernels.RGB10A2 = ScalarRGB10A2;
+			kernels.RGB10A2_UI = ScalarRGB10A2_UI;
+			kernels.RGB10A2_LM = ScalarRGB10A2_LM;
+			Add(TextureConvertBackend::Scalar, kernels);
+
+#if defined(TEXTURECONVERT_X86)
+			if (cpu.SSE2)
+			{
+				AddSSE2Kernels(kernels);
+				Add(TextureConvertBackend::SSE2, kernels);
+
+				if (cpu.SSSE3)
+				{
+					AddSSSE3Kernels(kernels);
+					Add(TextureConvertBackend::SSSE3, kernels);
+
+					if (cpu.AVX2)
+					{
+						AddAVX2Kernels(kernels);
+						Add(TextureConvertBackend::AVX2, kernels);
+					}
+				}
+			}
+#elif defined(TEXTURECONVERT_NEON)
+			if (cpu.NEON)
+			{
+				AddNEONKernels(kernels);
+				Add(TextureConvertBackend::NEON, kernels);
+			}
+#endif
+		}
+
+		void Add(TextureConvertBackend backend, const TextureConvertKernels& kernels)
+		{
+			Kernels[(int)backend] = kernels;
+			Supported[(int)backend] = true;
+			Best = backend;
+		}
+
+		TextureConvertKernels Kernels[(int)TextureConvertBackend::Count] = {};
+		bool Supported[(int)TextureConvertBackend::Count] = {};
+		TextureConvertBackend Best = TextureConvertBackend::Scalar;
+	};
+
+	const BackendTable& GetBackendTable()
+	{
+		static BackendTable table;
+		return table;
+	}
+}
+
+const TextureConvertKernels& TextureConvert::Get()
+{
+	const BackendTable& table = GetBackendTable();
+	return table.Kernels[(int)table.Best];
+}
+
+const TextureConvertKernels* TextureConvert::Get(TextureConvertBackend backend)
+{
+	const BackendTable& table = GetBackendTable();
+	if ((int)backend < 0 || backend >= TextureConvertBackend::Count || !table.Supported[(int)backend])
+		return nullptr;
+	return &table.Kernels[(int)backend];
+}
+
+TextureConvertBackend TextureConvert::GetBestBackend()
+{
+	return GetBackendTable().Best;
+}
+
+const char* TextureConvert::GetName(TextureConvertBackend backend)
+{
+	switch (backend)
+	{
+	case TextureConvertBackend::Scalar: return "Scalar";
+	case TextureConvertBackend::SSE2: return "SSE2";
+	case TextureConvertBackend::SSSE3: return "SSSE3";
+	case TextureConvertBackend::AVX2: return "AVX2";
+	case TextureConvertBackend::NEON: return "NEON";
+	default: return "Unknown";
+	}
+}
@@ -0,0 +1,155 @@
+#include "textureconvert_kernels.h"
+
+#if defined(TEXTURECONVERT_X86)
+
+#include <immintrin.h>
+
+#define TARGET TEXTURECONVERT_TARGET("avx2")
+
+namespace
+{
+	TARGET void AVX2P8(uint32_t* dst, const uint8_t* src, int count, const uint32_t* palette)
+	{
+		int j = 0;
+		for (; j + 8 <= count; j += 8)
+		{
+			__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + j)));
+			__m256i p = _mm256_i32gather_epi32((const int*)palette, index, 4);
+			_mm256_storeu_si256((__m256i*)(dst + j), p);
+		}
+		_mm256_zeroupper();
+		ScalarP8(dst + j, src + j, count - j, palette);
+	}
+
+	TARGET void AVX2BGRA8_LM(uint8_t* dst, const uint8_t* src, int count)
+	{
+		const __m256i swapRB = _mm256_setr_epi8(
+			2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+			2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+		int j = 0;
+		for (; j + 8 <= count; j += 8)
+		{
+			__m256i p = _mm256_loadu_si256((const __m256i*)(src + j * 4));
+			p = _mm256_shuffle_epi8(_mm256_adds_epu8(p, p), swapRB);
+			_mm256_storeu_si256((__m256i*)(dst + j * 4), p);
+		}
+		_mm256_zeroupper();
+		ScalarBGRA8_LM(dst + j * 4, src + j * 4, count - j);
+	}
+
+	TARGET void AVX2RGB8(uint8_t* dst, const uint8_t* src, int count)
+	{
+		const __m256i expand = _mm256_setr_epi8(
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m256i alpha = _mm256_set1_epi32(0xff000000);
+		int j = 0;
+		// The second 16 byte load starts 12 bytes in, so the last four bytes it reads must still be inside the row
+		for (; j + 10 <= count; j += 8)
+		{
+			__m128i lo = _mm_loadu_si128((const __m128i*)(src + j * 3));
+			__m128i hi = _mm_loadu_si128((const __m128i*)(src + j * 3 + 12));
+			__m256i p = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+			p = _mm256_or_si256(_mm256_shuffle_epi8(p, expand), alpha);
+			_mm256_storeu_si256((__m256i*)(dst + j * 4), p);
+		}
+		_mm256_zeroupper();
+		ScalarRGB8(dst + j * 4, src + j * 3, count - j);
+	}
+
+	TARGET __m256i UnormFrom10(__m256i x)
+	{
+		__m256i frac = _mm256_srli_epi16(_mm256_mulhi_epu16(_mm256_mullo_epi16(x, _mm256_set1_epi16(21)), _mm256_set1_epi16(24601)), 7);
+		return _mm256_add_epi16(_mm256_slli_epi16(x, 6), frac);
+	}
+
+	// Unpacks sixteen 10:10:10:2 texels. The pack works within 128-bit lanes, so the values come out in
+	// the order 0-3, 8-11, 4-7, 12-15. Store16 puts them back.
+	TARGET void Unpack10A2(const uint32_t* src, __m256i& r, __m256i& g, __m256i& b, __m256i& a)
+	{
+		const __m256i mask10 = _mm256_set1_epi32(0x3ff);
+		const __m256i mask2 = _mm256_set1_epi32(0x3);
+		__m256i c0 = _mm256_loadu_si256((const __m256i*)src);
+		__m256i c1 = _mm256_loadu_si256((const __m256i*)(src + 8));
+		r = _mm256_packs_epi32(_mm256_srli_epi32(c0, 22), _mm256_srli_epi32(c1, 22));
+		g = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(c0, 12), mask10), _mm256_and_si256(_mm256_srli_epi32(c1, 12), mask10));
+		b = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(c0, 2), mask10), _mm256_and_si256(_mm256_srli_epi32(c1, 2), mask10));
+		a = _mm256_packs_epi32(_mm256_and_si256(c0, mask2), _mm256_and_si256(c1, mask2));
+	}
+
+	TARGET void Store16(uint16_t* dst, __m256i r, __m256i g, __m256i b, __m256i a)
+	{
+		// Lane 0 holds pixels 0-3 and 8-11, lane 1 holds 4-7 and 12-15
+		__m256i rg0 = _mm256_unpacklo_epi16(r, g); // 0-3 | 4-7
+		__m256i rg1 = _mm256_unpackhi_epi16(r, g); // 8-11 | 12-15
+		__m256i ba0 = _mm256_unpacklo_epi16(b, a);
+		__m256i ba1 = _mm256_unpackhi_epi16(b, a);
+		__m256i p0 = _mm256_unpacklo_epi32(rg0, ba0); // 0-1 | 4-5
+		__m256i p1 = _mm256_unpackhi_epi32(rg0, ba0); // 2-3 | 6-7
+		__m256i p2 = _mm256_unpacklo_epi32(rg1, ba1); // 8-9 | 12-13
+		__m256i p3 = _mm256_unpackhi_epi32(rg1, ba1); // 10-11 | 14-15
+		_mm256_storeu_si256((__m256i*)dst, _mm256_permute2x128_si256(p0, p1, 0x20));
+		_mm256_storeu_si256((__m256i*)(dst + 16), _mm256_permute2x128_si256(p0, p1, 0x31));
+		_mm256_storeu_si256((__m256i*)(dst + 32), _mm256_permute2x128_si256(p2, p3, 0x20));
+		_mm256_storeu_si256((__m256i*)(dst + 48), _mm256_permute2x128_si256(p2, p3, 0x31));
+	}
+
+	TARGET void AVX2RGB10A2(uint16_t* dst, const uint32_t* src, int count)
+	{
+		const __m256i alphaScale = _mm256_set1_epi16(0x5555);
+		int j = 0;
+		for (; j + 16 <= count; j += 16)
+		{
+			__m256i r, g, b, a;
+			Unpack10A2(src + j, r, g, b, a);
+			Store16(dst + j * 4, UnormFrom10(r), UnormFrom10(g), UnormFrom10(b), _mm256_mullo_epi16(a, alphaScale));
+		}
+		_mm256_zeroupper();
+		ScalarRGB10A2(dst + j * 4, src + j, count - j);
+	}
+
+	TARGET void AVX2RGB10A2_UI(uint16_t* dst, const uint32_t* src, int count)
+	{
+		int j = 0;
+		for (; j + 16 <= count; j += 16)
+		{
+			__m256i r, g, b, a;
+			Unpack10A2(src + j, r, g, b, a);
+			Store16(dst + j * 4, r, g, b, a);
+		}
+		_mm256_zeroupper();
+		ScalarRGB10A2_UI(dst + j * 4, src + j, count - j);
+	}
+
+	TARGET void AVX2RGB10A2_LM(uint16_t* dst, const uint32_t* src, int count)
+	{
+		const __m256i alphaScale = _mm256_set1_epi16(0x5555);
+		const __m256i max10 = _mm256_set1_epi16(0x3ff);
+		const __m256i max2 = _mm256_set1_epi16(0x3);
+		int j = 0;
+		for (; j + 16 <= count; j += 16)
+		{
+			__m256i r, g, b, a;
+			Unpack10A2(src + j, r, g, b, a);
+			r = _mm256_min_epi16(_mm256_add_epi16(r, r), max10);
+			g = _mm256_min_epi16(_mm256_add_epi16(g, g), max10);
+			b = _mm256_min_epi16(_mm256_add_epi16(b, b), max10);
+			a = _mm256_min_epi16(_mm256_add_epi16(a, a), max2);
+			Store16(dst + j * 4, UnormFrom10(r), UnormFrom10(g), UnormFrom10(b), _mm256_mullo_epi16(a, alphaScale));
+		}
+		_mm256_zeroupper();
+		ScalarRGB10A2_LM(dst + j * 4, src + j, count - j);
+	}
+}
+
+void AddAVX2Kernels(TextureConvertKernels& kernels)
+{
+	kernels.P8 = AVX2P8;
+	kernels.BGRA8_LM = AVX2BGRA8_LM;
+	kernels.RGB8 = AVX2RGB8;
+	kernels.RGB10A2 = AVX2RGB10A2;
+	kernels.RGB10A2_UI = AVX2RGB10A2_UI;
+	kernels.RGB10A2_LM = AVX2RGB10A2_LM;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "textureconvert/textureconvert.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define TEXTURECONVERT_X86
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define TEXTURECONVERT_NEON
+#endif
+
+// MSVC lets any function use any intrinsic. GCC and clang have to be told per function, so that the rest of the library
+// still runs on CPUs without the instruction set.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TEXTURECONVERT_TARGET(isa)
+#else
+#define TEXTURECONVERT_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// The scalar kernels. The SIMD kernels use them for the pixels left over at the end of a row.
+void ScalarP8(uint32_t* dst, const uint8_t* src, int count, const uint32_t* palette);
+void ScalarBGRA8_LM(uint8_t* dst, const uint8_t* src, int count);
+void ScalarRGB8(uint8_t* dst, const uint8_t* src, int count);
+void ScalarRGB10A2(uint16_t* dst, const uint32_t* src, int count);
+void ScalarRGB10A2_UI(uint16_t* dst, const uint32_t* src, int count);
+void ScalarRGB10A2_LM(uint16_t* dst, const uint32_t* src, int count);
+
+// Each of these replaces the kernels the instruction set has a faster version of
+#if defined(TEXTURECONVERT_X86)
+void AddSSE2Kernels(TextureConvertKernels& kernels);
+void AddSSSE3Kernels(TextureConvertKernels& kernels);
+void AddAVX2Kernels(TextureConvertKernels& kernels);
+#elif defined(TEXTURECONVERT_NEON)
+void AddNEONKernels(TextureConvertKernels& kernels);
+#endif
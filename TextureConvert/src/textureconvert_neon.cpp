@@ -0,0 +1,106 @@
+#include "textureconvert_kernels.h"
+
+#if defined(TEXTURECONVERT_NEON)
+
+#include <arm_neon.h>
+
+namespace
+{
+	void NEONBGRA8_LM(uint8_t* dst, const uint8_t* src, int count)
+	{
+		int j = 0;
+		for (; j + 16 <= count; j += 16)
+		{
+			uint8x16x4_t p = vld4q_u8(src + j * 4);
+			uint8x16x4_t d;
+			d.val[0] = vqaddq_u8(p.val[2], p.val[2]);
+			d.val[1] = vqaddq_u8(p.val[1], p.val[1]);
+			d.val[2] = vqaddq_u8(p.val[0], p.val[0]);
+			d.val[3] = vqaddq_u8(p.val[3], p.val[3]);
+			vst4q_u8(dst + j * 4, d);
+		}
+		ScalarBGRA8_LM(dst + j * 4, src + j * 4, count - j);
+	}
+
+	void NEONRGB8(uint8_t* dst, const uint8_t* src, int count)
+	{
+		int j = 0;
+		for (; j + 16 <= count; j += 16)
+		{
+			uint8x16x3_t p = vld3q_u8(src + j * 3);
+			uint8x16x4_t d;
+			d.val[0] = p.val[0];
+			d.val[1] = p.val[1];
+			d.val[2] = p.val[2];
+			d.val[3] = vdupq_n_u8(255);
+			vst4q_u8(dst + j * 4, d);
+		}
+		ScalarRGB8(dst + j * 4, src + j * 3, count - j);
+	}
+
+	// Exact x * 0xffff / 0x3ff for x in 0-1023
+	inline uint16x4_t UnormFrom10(uint32x4_t x)
+	{
+		return vmovn_u32(vshrq_n_u32(vmulq_n_u32(x, 4198340), 16));
+	}
+
+	enum class Convert10A2 { Unorm, UInt, Lightmap };
+
+	template<Convert10A2 mode>
+	void NEONRGB10A2(uint16_t* dst, const uint32_t* src, int count)
+	{
+		const uint32x4_t mask10 = vdupq_n_u32(0x3ff);
+		const uint32x4_t mask2 = vdupq_n_u32(0x3);
+		int j = 0;
+		for (; j + 4 <= count; j += 4)
+		{
+			uint32x4_t c = vld1q_u32(src + j);
+			uint32x4_t r = vshrq_n_u32(c, 22);
+			uint32x4_t g = vandq_u32(vshrq_n_u32(c, 12), mask10);
+			uint32x4_t b = vandq_u32(vshrq_n_u32(c, 2), mask10);
+			uint32x4_t a = vandq_u32(c, mask2);
+
+			uint16x4x4_t d;
+			if (mode == Convert10A2::UInt)
+			{
+				d.val[0] = vmovn_u32(r);
+				d.val[1] = vmovn_u32(g);
+				d.val[2] = vmovn_u32(b);
+				d.val[3] = vmovn_u32(a);
+			}
+			else
+			{
+				if (mode == Convert10A2::Lightmap)
+				{
+					r = vminq_u32(vshlq_n_u32(r, 1), mask10);
+					g = vminq_u32(vshlq_n_u32(g, 1), mask10);
+					b = vminq_u32(vshlq_n_u32(b, 1), mask10);
+					a = vminq_u32(vshlq_n_u32(a, 1), mask2);
+				}
+				d.val[0] = UnormFrom10(r);
+				d.val[1] = UnormFrom10(g);
+				d.val[2] = UnormFrom10(b);
+				d.val[3] = vmovn_u32(vmulq_n_u32(a, 0x5555));
+			}
+			vst4_u16(dst + j * 4, d);
+		}
+
+		if (mode == Convert10A2::Unorm)
+			ScalarRGB10A2(dst + j * 4, src + j, count - j);
+		else if (mode == Convert10A2::UInt)
+			ScalarRGB10A2_UI(dst + j * 4, src + j, count - j);
+		else
+			ScalarRGB10A2_LM(dst + j * 4, src + j, count - j);
+	}
+}
+
+void AddNEONKernels(TextureConvertKernels& kernels)
+{
+	kernels.BGRA8_LM = NEONBGRA8_LM;
+	kernels.RGB8 = NEONRGB8;
+	kernels.RGB10A2 = NEONRGB10A2<Convert10A2::Unorm>;
+	kernels.RGB10A2_UI = NEONRGB10A2<Convert10A2::UInt>;
+	kernels.RGB10A2_LM = NEONRGB10A2<Convert10A2::Lightmap>;
+}
+
+#endif
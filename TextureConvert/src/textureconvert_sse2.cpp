@@ -0,0 +1,114 @@
+#include "textureconvert_kernels.h"
+
+#if defined(TEXTURECONVERT_X86)
+
+#include <emmintrin.h>
+
+#define TARGET TEXTURECONVERT_TARGET("sse2")
+
+namespace
+{
+	// Doubles every byte with unsigned saturation and swaps the red and blue bytes
+	TARGET void SSE2BGRA8_LM(uint8_t* dst, const uint8_t* src, int count)
+	{
+		const __m128i rbMask = _mm_set1_epi32(0x00ff00ff);
+		int j = 0;
+		for (; j + 4 <= count; j += 4)
+		{
+			__m128i p = _mm_loadu_si128((const __m128i*)(src + j * 4));
+			p = _mm_adds_epu8(p, p);
+			__m128i ga = _mm_andnot_si128(rbMask, p);
+			__m128i rb = _mm_and_si128(rbMask, p);
+			rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+			_mm_storeu_si128((__m128i*)(dst + j * 4), _mm_or_si128(ga, rb));
+		}
+		ScalarBGRA8_LM(dst + j * 4, src + j * 4, count - j);
+	}
+
+	// Exact x * 0xffff / 0x3ff for x in 0-1023, which is (x << 6) + 21 * x / 341
+	TARGET __m128i UnormFrom10(__m128i x)
+	{
+		__m128i frac = _mm_srli_epi16(_mm_mulhi_epu16(_mm_mullo_epi16(x, _mm_set1_epi16(21)), _mm_set1_epi16(24601)), 7);
+		return _mm_add_epi16(_mm_slli_epi16(x, 6), frac);
+	}
+
+	// Unpacks eight 10:10:10:2 texels into 16-bit r, g, b and a vectors
+	TARGET void Unpack10A2(const uint32_t* src, __m128i& r, __m128i& g, __m128i& b, __m128i& a)
+	{
+		const __m128i mask10 = _mm_set1_epi32(0x3ff);
+		const __m128i mask2 = _mm_set1_epi32(0x3);
+		__m128i c0 = _mm_loadu_si128((const __m128i*)src);
+		__m128i c1 = _mm_loadu_si128((const __m128i*)(src + 4));
+		r = _mm_packs_epi32(_mm_srli_epi32(c0, 22), _mm_srli_epi32(c1, 22));
+		g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(c0, 12), mask10), _mm_and_si128(_mm_srli_epi32(c1, 12), mask10));
+		b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(c0, 2), mask10), _mm_and_si128(_mm_srli_epi32(c1, 2), mask10));
+		a = _mm_packs_epi32(_mm_and_si128(c0, mask2), _mm_and_si128(c1, mask2));
+	}
+
+	// Interleaves r, g, b and a vectors into eight RGBA16 pixels
+	TARGET void Store16(uint16_t* dst, __m128i r, __m128i g, __m128i b, __m128i a)
+	{
+		__m128i rg0 = _mm_unpacklo_epi16(r, g);
+		__m128i rg1 = _mm_unpackhi_epi16(r, g);
+		__m128i ba0 = _mm_unpacklo_epi16(b, a);
+		__m128i ba1 = _mm_unpackhi_epi16(b, a);
+		_mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi32(rg0, ba0));
+		_mm_storeu_si128((__m128i*)(dst + 8), _mm_unpackhi_epi32(rg0, ba0));
+		_mm_storeu_si128((__m128i*)(dst + 16), _mm_unpacklo_epi32(rg1, ba1));
+		_mm_storeu_si128((__m128i*)(dst + 24), _mm_unpackhi_epi32(rg1, ba1));
+	}
+
+	TARGET void SSE2RGB10A2(uint16_t* dst, const uint32_t* src, int count)
+	{
+		const __m128i alphaScale = _mm_set1_epi16(0x5555);
+		int j = 0;
+		for (; j + 8 <= count; j += 8)
+		{
+			__m128i r, g, b, a;
+			Unpack10A2(src + j, r, g, b, a);
+			Store16(dst + j * 4, UnormFrom10(r), UnormFrom10(g), UnormFrom10(b), _mm_mullo_epi16(a, alphaScale));
+		}
+		ScalarRGB10A2(dst + j * 4, src + j, count - j);
+	}
+
+	TARGET void SSE2RGB10A2_UI(uint16_t* dst, const uint32_t* src, int count)
+	{
+		int j = 0;
+		for (; j + 8 <= count; j += 8)
+		{
+			__m128i r, g, b, a;
+			Unpack10A2(src + j, r, g, b, a);
+			Store16(dst + j * 4, r, g, b, a);
+		}
+		ScalarRGB10A2_UI(dst + j * 4, src + j, count - j);
+	}
+
+	TARGET void SSE2RGB10A2_LM(uint16_t* dst, const uint32_t* src, int count)
+	{
+		const __m128i alphaScale = _mm_set1_epi16(0x5555);
+		const __m128i max10 = _mm_set1_epi16(0x3ff);
+		const __m128i max2 = _mm_set1_epi16(0x3);
+		int j = 0;
+		for (; j + 8 <= count; j += 8)
+		{
+			__m128i r, g, b, a;
+			Unpack10A2(src + j, r, g, b, a);
+			r = _mm_min_epi16(_mm_add_epi16(r, r), max10);
+			g = _mm_min_epi16(_mm_add_epi16(g, g), max10);
+			b = _mm_min_epi16(_mm_add_epi16(b, b), max10);
+			a = _mm_min_epi16(_mm_add_epi16(a, a), max2);
+			Store16(dst + j * 4, UnormFrom10(r), UnormFrom10(g), UnormFrom10(b), _mm_mullo_epi16(a, alphaScale));
+		}
+		ScalarRGB10A2_LM(dst + j * 4, src + j, count - j);
+	}
+}
+
+void AddSSE2Kernels(TextureConvertKernels& kernels)
+{
+	kernels.BGRA8_LM = SSE2BGRA8_LM;
+	kernels.RGB10A2 = SSE2RGB10A2;
+	kernels.RGB10A2_UI = SSE2RGB10A2_UI;
+	kernels.RGB10A2_LM = SSE2RGB10A2_LM;
+}
+
+#endif
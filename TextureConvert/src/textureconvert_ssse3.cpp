@@ -0,0 +1,47 @@
+#include "textureconvert_kernels.h"
+
+#if defined(TEXTURECONVERT_X86)
+
+#include <tmmintrin.h>
+
+#define TARGET TEXTURECONVERT_TARGET("ssse3")
+
+namespace
+{
+	TARGET void SSSE3BGRA8_LM(uint8_t* dst, const uint8_t* src, int count)
+	{
+		const __m128i swapRB = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+		int j = 0;
+		for (; j + 4 <= count; j += 4)
+		{
+			__m128i p = _mm_loadu_si128((const __m128i*)(src + j * 4));
+			p = _mm_shuffle_epi8(_mm_adds_epu8(p, p), swapRB);
+			_mm_storeu_si128((__m128i*)(dst + j * 4), p);
+		}
+		ScalarBGRA8_LM(dst + j * 4, src + j * 4, count - j);
+	}
+
+	// Spreads four RGB8 pixels out to RGBA8 and sets the alpha bytes the shuffle zeroed
+	TARGET void SSSE3RGB8(uint8_t* dst, const uint8_t* src, int count)
+	{
+		const __m128i expand = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m128i alpha = _mm_set1_epi32(0xff000000);
+		int j = 0;
+		// Each step reads 16 bytes but only uses 12, so stop while the whole load is still inside the row
+		for (; j + 6 <= count; j += 4)
+		{
+			__m128i p = _mm_loadu_si128((const __m128i*)(src + j * 3));
+			p = _mm_or_si128(_mm_shuffle_epi8(p, expand), alpha);
+			_mm_storeu_si128((__m128i*)(dst + j * 4), p);
+		}
+		ScalarRGB8(dst + j * 4, src + j * 3, count - j);
+	}
+}
+
+void AddSSSE3Kernels(TextureConvertKernels& kernels)
+{
+	kernels.BGRA8_LM = SSSE3BGRA8_LM;
+	kernels.RGB8 = SSSE3RGB8;
+}
+
+#endif
@@ -0,0 +1,79 @@
+// Measures the throughput of every kernel on every backend the CPU supports.
+// Each run converts a 1024x1024 texture row by row, the way the drivers' uploaders do, and reports destination MB/s.
+
+#include "textureconvert/textureconvert.h"
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <functional>
+
+namespace
+{
+	const int Width = 1024;
+	const int Height = 1024;
+
+	double Measure(const std::function<void()>& convertTexture, size_t dstBytes)
+	{
+		convertTexture();
+
+		// Repeat until at least a quarter second has passed and keep the fastest run
+		double best = 1e30;
+		double total = 0.0;
+		int runs = 0;
+		while (total < 0.25 || runs < 5)
+		{
+			auto start = std::chrono::steady_clock::now();
+			convertTexture();
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			best = seconds < best ? seconds : best;
+			total += seconds;
+			runs++;
+		}
+		return dstBytes / best / (1024.0 * 1024.0);
+	}
+}
+
+int main()
+{
+	std::mt19937 random(469);
+	std::vector<uint8_t> src8(Width * Height * 4);
+	std::vector<uint32_t> src32(Width * Height), palette(256);
+	for (uint8_t& v : src8)
+		v = (uint8_t)random();
+	for (uint32_t& v : src32)
+		v = random();
+	for (uint32_t& v : palette)
+		v = random();
+	std::vector<uint8_t> dst8(Width * Height * 4);
+	std::vector<uint16_t> dst16(Width * Height * 4);
+
+	std::printf("%-12s", "MB/s");
+	const char* kernelNames[] = { "P8", "BGRA8_LM", "RGB8", "RGB10A2", "RGB10A2_UI", "RGB10A2_LM" };
+	for (const char* name : kernelNames)
+		std::printf("%12s", name);
+	std::printf("\n");
+
+	for (int i = 0; i < (int)TextureConvertBackend::Count; i++)
+	{
+		TextureConvertBackend backend = (TextureConvertBackend)i;
+		const TextureConvertKernels* k = TextureConvert::Get(backend);
+		if (!k)
+			continue;
+
+		double results[6];
+		results[0] = Measure([&] { for (int y = 0; y < Height; y++) k->P8((uint32_t*)dst8.data() + y * Width, src8.data() + y * Width, Width, palette.data()); }, dst8.size());
+		results[1] = Measure([&] { for (int y = 0; y < Height; y++) k->BGRA8_LM(dst8.data() + y * Width * 4, src8.data() + y * Width * 4, Width); }, dst8.size());
+		results[2] = Measure([&] { for (int y = 0; y < Height; y++) k->RGB8(dst8.data() + y * Width * 4, src8.data() + y * Width * 3, Width); }, dst8.size());
+		results[3] = Measure([&] { for (int y = 0; y < Height; y++) k->RGB10A2(dst16.data() + y * Width * 4, src32.data() + y * Width, Width); }, dst16.size() * 2);
+		results[4] = Measure([&] { for (int y = 0; y < Height; y++) k->RGB10A2_UI(dst16.data() + y * Width * 4, src32.data() + y * Width, Width); }, dst16.size() * 2);
+		results[5] = Measure([&] { for (int y = 0; y < Height; y++) k->RGB10A2_LM(dst16.data() + y * Width * 4, src32.data() + y * Width, Width); }, dst16.size() * 2);
+
+		std::printf("%-12s", TextureConvert::GetName(backend));
+		for (double result : results)
+			std::printf("%12.0f", result);
+		std::printf("\n");
+	}
+	return 0;
+}
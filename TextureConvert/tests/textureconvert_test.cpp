@@ -0,0 +1,245 @@
+// Checks every SIMD backend the CPU supports against the scalar kernels.
+// RGB8 is checked for all 2^24 colors. The 32-bit source formats are checked for one 64k block of texel values in every
+// 61, or for all 2^32 values when run with --exhaustive. On top of that every kernel runs for row lengths 0 to 67 at
+// several misaligned offsets, with guard bytes around the destination.
+
+#include "textureconvert/textureconvert.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <random>
+#include <chrono>
+
+namespace
+{
+	int Failures = 0;
+
+	struct Backend
+	{
+		TextureConvertBackend Id;
+		const TextureConvertKernels* Kernels;
+	};
+
+	bool Report(const char* backend, const char* kernel, const char* test, size_t offset, int got, int expected)
+	{
+		if (Failures < 20)
+			std::printf("FAIL: %s %s (%s) at %zu: got %d, expected %d\n", backend, kernel, test, offset, got, expected);
+		Failures++;
+		return false;
+	}
+
+	template<typename T>
+	bool Compare(const char* backend, const char* kernel, const char* test, const T* got, const T* expected, size_t count)
+	{
+		if (std::memcmp(got, expected, count * sizeof(T)) == 0)
+			return true;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (got[i] != expected[i])
+				return Report(backend, kernel, test, i, (int)got[i], (int)expected[i]);
+		}
+		return true;
+	}
+
+	typedef void (*Kernel10A2)(uint16_t* dst, const uint32_t* src, int count);
+
+	struct Kernel10A2Entry
+	{
+		const char* Name;
+		Kernel10A2 TextureConvertKernels::*Member;
+	};
+
+	const Kernel10A2Entry Kernels10A2[] =
+	{
+		{ "RGB10A2", &TextureConvertKernels::RGB10A2 },
+		{ "RGB10A2_UI", &TextureConvertKernels::RGB10A2_UI },
+		{ "RGB10A2_LM", &TextureConvertKernels::RGB10A2_LM },
+	};
+
+	// Every 32-bit value, or every value in one block of 64k out of blockStep, goes through BGRA8_LM and the three 10:10:10:2 kernels
+	void Test32(const TextureConvertKernels& scalar, const std::vector<Backend>& backends, int blockStep)
+	{
+		const int chunk = 1 << 16;
+		std::vector<uint32_t> src(chunk);
+		std::vector<uint8_t> expected8(chunk * 4), got8(chunk * 4);
+		std::vector<uint16_t> expected16(chunk * 4), got16(chunk * 4);
+		bool failed[(int)TextureConvertBackend::Count][4] = {};
+
+		for (uint64_t base = 0; base < (1ull << 32); base += (uint64_t)chunk * blockStep)
+		{
+			for (int i = 0; i < chunk; i++)
+				src[i] = (uint32_t)(base + i);
+
+			scalar.BGRA8_LM(expected8.data(), (const uint8_t*)src.data(), chunk);
+			for (const Backend& backend : backends)
+			{
+				if (failed[(int)backend.Id][0])
+					continue;
+				backend.Kernels->BGRA8_LM(got8.data(), (const uint8_t*)src.data(), chunk);
+				if (!Compare(TextureConvert::GetName(backend.Id), "BGRA8_LM", "all values", got8.data(), expected8.data(), got8.size()))
+					failed[(int)backend.Id][0] = true;
+			}
+
+			for (int k = 0; k < 3; k++)
+			{
+				(scalar.*Kernels10A2[k].Member)(expected16.data(), src.data(), chunk);
+				for (const Backend& backend : backends)
+				{
+					if (failed[(int)backend.Id][k + 1])
+						continue;
+					(backend.Kernels->*Kernels10A2[k].Member)(got16.data(), src.data(), chunk);
+					if (!Compare(TextureConvert::GetName(backend.Id), Kernels10A2[k].Name, "all values", got16.data(), expected16.data(), got16.size()))
+						failed[(int)backend.Id][k + 1] = true;
+				}
+			}
+		}
+	}
+
+	// Every 24-bit color goes through RGB8
+	void TestExhaustiveRGB8(const TextureConvertKernels& scalar, const std::vector<Backend>& backends)
+	{
+		const int count = 1 << 24;
+		std::vector<uint8_t> src(count * 3);
+		for (int i = 0; i < count; i++)
+		{
+			src[i * 3] = (uint8_t)i;
+			src[i * 3 + 1] = (uint8_t)(i >> 8);
+			src[i * 3 + 2] = (uint8_t)(i >> 16);
+		}
+
+		std::vector<uint8_t> expected(count * 4), got(count * 4);
+		scalar.RGB8(expected.data(), src.data(), count);
+		for (const Backend& backend : backends)
+		{
+			backend.Kernels->RGB8(got.data(), src.data(), count);
+			Compare(TextureConvert::GetName(backend.Id), "RGB8", "all values", got.data(), expected.data(), got.size());
+		}
+	}
+
+	// Every palette index, with palettes that put all bit patterns into the 32-bit entries
+	void TestP8(const TextureConvertKernels& scalar, const std::vector<Backend>& backends, std::mt19937& random)
+	{
+		const int count = 4096;
+		std::vector<uint8_t> src(count);
+		std::vector<uint32_t> palette(256), expected(count), got(count);
+		for (int round = 0; round < 64; round++)
+		{
+			for (uint32_t& entry : palette)
+				entry = random();
+			for (int i = 0; i < count; i++)
+				src[i] = round == 0 ? (uint8_t)i : (uint8_t)random();
+
+			scalar.P8(expected.data(), src.data(), count, palette.data());
+			for (const Backend& backend : backends)
+			{
+				backend.Kernels->P8(got.data(), src.data(), count, palette.data());
+				Compare(TextureConvert::GetName(backend.Id), "P8", "palette", got.data(), expected.data(), got.size());
+			}
+		}
+	}
+
+	// Short rows exercise the SIMD loop tails. The destination has guard bytes on both sides to catch writes past the row.
+	template<typename SrcT, typename DstT, typename Run>
+	void TestRows(const char* kernel, int srcPerPixel, int dstPerPixel, const TextureConvertKernels& scalar, const std::vector<Backend>& backends, std::mt19937& random, Run run)
+	{
+		const int guard = 64;
+		const int maxCount = 67;
+		const int maxOffset = 4;
+		const DstT guardValue = (DstT)0xa5a5a5a5;
+
+		for (int offset = 0; offset < maxOffset; offset++)
+		{
+			for (int count = 0; count <= maxCount; count++)
+			{
+				// The source ends exactly at the end of the allocation, so an address sanitizer build catches reads past the row
+				std::vector<SrcT> src(offset + count * srcPerPixel);
+				for (SrcT& v : src)
+					v = (SrcT)random();
+				const SrcT* srcRow = src.data() + offset;
+
+				std::vector<DstT> expected(guard * 2 + maxOffset + count * dstPerPixel, guardValue);
+				std::vector<DstT> got(expected.size(), guardValue);
+				run(scalar, expected.data() + guard + offset, srcRow, count);
+				for (const Backend& backend : backends)
+				{
+					std::fill(got.begin(), got.end(), guardValue);
+					run(*backend.Kernels, got.data() + guard + offset, srcRow, count);
+					Compare(TextureConvert::GetName(backend.Id), kernel, "row tail", got.data(), expected.data(), got.size());
+				}
+			}
+		}
+	}
+
+	double Seconds(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool exhaustive = argc > 1 && std::strcmp(argv[1], "--exhaustive") == 0;
+
+	const TextureConvertKernels& scalar = *TextureConvert::Get(TextureConvertBackend::Scalar);
+
+	std::vector<Backend> backends;
+	std::printf("Backends:");
+	for (int i = 0; i < (int)TextureConvertBackend::Count; i++)
+	{
+		TextureConvertBackend id = (TextureConvertBackend)i;
+		const TextureConvertKernels* kernels = TextureConvert::Get(id);
+		if (kernels)
+		{
+			std::printf(" %s", TextureConvert::GetName(id));
+			if (id != TextureConvertBackend::Scalar)
+				backends.push_back({ id, kernels });
+		}
+	}
+	std::printf(" (best: %s)\n", TextureConvert::GetName(TextureConvert::GetBestBackend()));
+
+	// Get() must hand out the best backend's table
+	if (&TextureConvert::Get() != TextureConvert::Get(TextureConvert::GetBestBackend()))
+	{
+		std::printf("FAIL: TextureConvert::Get() does not return the best backend\n");
+		Failures++;
+	}
+
+	std::mt19937 random(469);
+	auto start = std::chrono::steady_clock::now();
+
+	TestRows<uint8_t, uint32_t>("P8", 1, 1, scalar, backends, random, [&](const TextureConvertKernels& k, uint32_t* dst, const uint8_t* src, int count) {
+		static const std::vector<uint32_t> palette = [] { std::vector<uint32_t> p(256); for (int i = 0; i < 256; i++) p[i] = 0x01010101u * i ^ 0xff00ff00u; return p; }();
+		k.P8(dst, src, count, palette.data());
+	});
+	TestRows<uint8_t, uint8_t>("BGRA8_LM", 4, 4, scalar, backends, random, [](const TextureConvertKernels& k, uint8_t* dst, const uint8_t* src, int count) { k.BGRA8_LM(dst, src, count); });
+	TestRows<uint8_t, uint8_t>("RGB8", 3, 4, scalar, backends, random, [](const TextureConvertKernels& k, uint8_t* dst, const uint8_t* src, int count) { k.RGB8(dst, src, count); });
+	for (const Kernel10A2Entry& entry : Kernels10A2)
+	{
+		auto member = entry.Member;
+		TestRows<uint32_t, uint16_t>(entry.Name, 1, 4, scalar, backends, random, [=](const TextureConvertKernels& k, uint16_t* dst, const uint32_t* src, int count) { (k.*member)(dst, src, count); });
+	}
+	std::printf("Row tails: %.1f s\n", Seconds(start));
+
+	start = std::chrono::steady_clock::now();
+	TestP8(scalar, backends, random);
+	std::printf("P8 palettes: %.1f s\n", Seconds(start));
+
+	start = std::chrono::steady_clock::now();
+	TestExhaustiveRGB8(scalar, backends);
+	std::printf("RGB8, all 2^24 colors: %.1f s\n", Seconds(start));
+
+	// With an odd block step no bit of the upper 16 stays the same in all blocks
+	start = std::chrono::steady_clock::now();
+	Test32(scalar, backends, exhaustive ? 1 : 61);
+	std::printf("BGRA8_LM and RGB10A2, %s values: %.1f s\n", exhaustive ? "all 2^32" : "1/61 of the 2^32", Seconds(start));
+
+	if (Failures != 0)
+	{
+		std::printf("%d failures\n", Failures);
+		return 1;
+	}
+	std::printf("All tests passed\n");
+	return 0;
+}
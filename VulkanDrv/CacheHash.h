@@ -0,0 +1,10 @@
+#pragma once
+
+// 64-bit FNV-1a. Used to check that the pipeline and shader cache files read back what was written.
+inline uint64_t HashCacheData(const uint8_t* data, size_t size)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ data[i]) * 0x100000001b3ULL;
+	return hash;
+}
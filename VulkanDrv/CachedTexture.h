@@ -7,9 +7,37 @@ public:
 	std::unique_ptr<VulkanImageView> imageView;
 	VkImageLayout imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-	int BindlessIndex[4] = { -1, -1, -1, -1 };
+	int BindlessIndex = -1;
 	int RealtimeChangeCount = 0;
 
+	// Hash of the source data when it was uploaded, used to keep the texture across URenderDevice::Flush
+	uint64_t ContentHash = 0;
+	bool NeedsRevalidate = false;
+
+	// Converted copy of mip 0 as last uploaded, used to find the changed rows of realtime textures
+	std::vector<uint8_t> RealtimeShadow;
+
 	std::vector<VkBufferImageCopy> pendingUploads[2];
 	bool inPendingUploads = false;
+
+	// Lightmaps and fogmaps packed into a LightmapAtlas page have no image of their own
+	CachedTexture* AtlasPage = nullptr;
+	int AtlasX = 0;
+	int AtlasY = 0;
+	int AtlasWidth = 0;
+	int AtlasHeight = 0;
+	float AtlasScale[2] = { 1.0f, 1.0f };
+	float AtlasOffset[2] = { 0.0f, 0.0f };
+
+	CachedTexture* GetImageTexture() { return AtlasPage ? AtlasPage : this; }
+
+	// Textures allocated by TextureArrayPool live in one layer of a shared array image
+	CachedTexture* ArrayTexture = nullptr;
+	int ArrayLayer = 0;
+
+	CachedTexture* GetUploadTexture() { return ArrayTexture ? ArrayTexture : this; }
+
+	// Streamed textures start with only their smallest mips. The image view begins at ResidentMip so the missing ones are never sampled.
+	int ResidentMip = 0;
+	int WantedMip = 0;
 };
@@ -50,10 +50,16 @@ void CommandBufferManager::BeginFrame()
 	VkFence currentFence = RenderFinishedFences[CurrentFrameIndex]->fence;
 	vkWaitForFences(renderer->Device.get()->device, 1, &currentFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
 	vkResetFences(renderer->Device.get()->device, 1, &currentFence);
+	FinishedSerial = std::max(FinishedSerial, SlotSerials[CurrentFrameIndex]);
 
 	// Safely clear old Vulkan objects now that the GPU is 100% done with this frame index
 	FrameDeleteLists[CurrentFrameIndex] = std::make_unique<DeleteList>();
 
+	// Pooled images released the last time this frame index was used can be reused too.
+	// Textures is still null when TextureManager begins the first frame from its constructor.
+	if (renderer->Textures)
+		renderer->Textures->Images->BeginFrame(CurrentFrameIndex);
+
 	// Reset per-frame CPU write positions now that this frame index is safe to reuse
 	renderer->Buffers->UploadBufferPositions[CurrentFrameIndex] = 0;
 
@@ -152,6 +158,7 @@ void CommandBufferManager::SubmitCommands(bool present, int presentWidth, int pr
 	}
 	submit.AddSignal(DrawFinishedSemaphores[CurrentFrameIndex].get());
 	submit.Execute(renderer->Device.get(), renderer->Device.get()->GraphicsQueue, RenderFinishedFence.get());
+	SlotSerials[CurrentFrameIndex] = ++SubmittedSerial;
 
 	FrameBegun = false;
 	IsFirstFrame = false;
@@ -165,6 +172,46 @@ void CommandBufferManager::SubmitCommands(bool present, int presentWidth, int pr
 	CurrentFrameIndex = (CurrentFrameIndex + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
+bool CommandBufferManager::IsSubmitFinished(uint64_t serial)
+{
+	if (serial <= FinishedSerial)
+		return true;
+	else if (serial > SubmittedSerial)
+		return false;
+
+	// A slot only gets a new serial after BeginFrame waited for its old one
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		if (SlotSerials[i] == serial)
+		{
+			if (vkGetFenceStatus(renderer->Device.get()->device, RenderFinishedFences[i]->fence) != VK_SUCCESS)
+				return false;
+			break;
+		}
+	}
+
+	FinishedSerial = serial;
+	return true;
+}
+
+void CommandBufferManager::WaitForSubmit(uint64_t serial)
+{
+	if (serial > SubmittedSerial || IsSubmitFinished(serial))
+		return;
+
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		if (SlotSerials[i] == serial)
+		{
+			// Not reset here, BeginFrame does that when the slot comes around again
+			vkWaitForFences(renderer->Device.get()->device, 1, &RenderFinishedFences[i]->fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+			break;
+		}
+	}
+
+	FinishedSerial = serial;
+}
+
 VulkanCommandBuffer* CommandBufferManager::GetTransferCommands()
 {
 	if (!FrameBegun)
@@ -189,6 +236,9 @@ VulkanCommandBuffer* CommandBufferManager::GetTransferCommands()
 
 VulkanCommandBuffer* CommandBufferManager::GetDrawCommands()
 {
+	if (SceneCommandsOpen)
+		return SceneCommandsArray[CurrentFrameIndex].get();
+
 	if (!FrameBegun)
 	{
 		BeginFrame();
@@ -209,6 +259,31 @@ VulkanCommandBuffer* CommandBufferManager::GetDrawCommands()
 	return DrawCommands.get();
 }
 
+VulkanCommandBuffer* CommandBufferManager::BeginSceneCommands(const VkCommandBufferInheritanceInfo* inheritance)
+{
+	if (SceneCommandsOpen)
+		throw std::runtime_error("Scene commands are already open");
+
+	// A frame slot executes at most one scene pass per submit, and the slot's fence has been waited for when its draw commands begun
+	GetDrawCommands();
+
+	auto& SceneCommands = SceneCommandsArray[CurrentFrameIndex];
+	if (!SceneCommands)
+		SceneCommands = CommandPool->createBuffer(VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+	SceneCommands->begin(inheritance);
+	SceneCommandsOpen = true;
+	return SceneCommands.get();
+}
+
+VulkanCommandBuffer* CommandBufferManager::EndSceneCommands()
+{
+	auto SceneCommands = SceneCommandsArray[CurrentFrameIndex].get();
+	SceneCommands->end();
+	SceneCommandsOpen = false;
+	return SceneCommands;
+}
+
 void CommandBufferManager::DeleteFrameObjects()
 {
 	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
@@ -18,6 +18,16 @@ public:
 	VulkanCommandBuffer* GetDrawCommands();
 	void DeleteFrameObjects();
 
+	// While the scene commands are open GetDrawCommands returns them instead of the primary draw commands. The scene pass is
+	// recorded into them and only begun on the primary when it ends, once it is known whether its attachments have to be stored.
+	VulkanCommandBuffer* BeginSceneCommands(const VkCommandBufferInheritanceInfo* inheritance);
+	VulkanCommandBuffer* EndSceneCommands();
+
+	// Every SubmitCommands call gets the next serial. Readbacks use it to find out when their copy has finished on the GPU.
+	uint64_t GetNextSubmitSerial() const { return SubmittedSerial + 1; }
+	bool IsSubmitFinished(uint64_t serial);
+	void WaitForSubmit(uint64_t serial);
+
 	struct DeleteList
 	{
 		std::vector<std::unique_ptr<VulkanImage>> images;
@@ -54,9 +64,15 @@ private:
 	std::unique_ptr<VulkanCommandPool> CommandPool;
 	std::array<std::unique_ptr<VulkanCommandBuffer>, MAX_FRAMES_IN_FLIGHT> DrawCommandsArray;
 	std::array<std::unique_ptr<VulkanCommandBuffer>, MAX_FRAMES_IN_FLIGHT> TransferCommandsArray;
+	std::array<std::unique_ptr<VulkanCommandBuffer>, MAX_FRAMES_IN_FLIGHT> SceneCommandsArray;
+	bool SceneCommandsOpen = false;
 
 	bool FrameBegun = false;
 	bool IsFirstFrame = true;
+
+	uint64_t SubmittedSerial = 0;
+	uint64_t FinishedSerial = 0;
+	std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> SlotSerials = {};
 	std::array<bool, MAX_FRAMES_IN_FLIGHT> DrawCommandsBegun = {};
 	std::array<bool, MAX_FRAMES_IN_FLIGHT> TransferCommandsBegun = {};
 };
@@ -11,6 +11,8 @@ DescriptorSetManager::DescriptorSetManager(UVulkanRenderDevice* renderer) : rend
 	CreatePresentSet();
 	CreateBloomLayout();
 	CreateBloomSets();
+	CreateFusedPresentSet();
+	CreateHitReduceSet();
 }
 
 DescriptorSetManager::~DescriptorSetManager()
@@ -21,6 +23,7 @@ void DescriptorSetManager::ClearCache()
 {
 	Textures.WriteBindless = WriteDescriptors();
 	Textures.NextBindlessIndex = 0;
+	Textures.ViewUpdates.clear();
 }
 
 int DescriptorSetManager::GetTextureArrayIndex(DWORD PolyFlags, CachedTexture* tex, bool clamp)
@@ -40,32 +43,62 @@ int DescriptorSetManager::GetTextureArrayIndex(DWORD PolyFlags, CachedTexture* t
 
 	if (Textures.NextBindlessIndex == 0)
 	{
-		Textures.WriteBindless.AddCombinedImageSampler(Textures.BindlessSet.get(), 0, 0, renderer->Textures->NullTextureView.get(), renderer->Samplers->Samplers[0].get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		for (int i = 0; i < 4; i++)
+			Textures.WriteBindless.AddSampler(Textures.BindlessSet.get(), 0, i, renderer->Samplers->Samplers[i].get());
+		Textures.WriteBindless.AddSampledImage(Textures.BindlessSet.get(), 1, 0, renderer->Textures->NullTextureView.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 		Textures.NextBindlessIndex = 1;
 	}
 
 	if (!tex)
 		return 0;
 
+	// The array layer goes in the upper bits of the bind
+	if (tex->ArrayTexture)
+		return GetTextureArrayIndex(PolyFlags, tex->ArrayTexture, clamp) | (tex->ArrayLayer << 18);
+
 	uint32_t samplermode = 0;
 	if (PolyFlags & PF_NoSmooth) samplermode |= 1;
 	if (clamp) samplermode |= 2;
 
-	int index = tex->BindlessIndex[samplermode];
-	if (index != -1)
-		return index;
-
-	index = Textures.NextBindlessIndex++;
+	// The sampler is picked in the shader, so each image only needs one slot
+	int index = tex->BindlessIndex;
+	if (index == -1)
+	{
+		index = Textures.NextBindlessIndex++;
+		Textures.WriteBindless.AddSampledImage(Textures.BindlessSet.get(), 1, index, tex->imageView.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		tex->BindlessIndex = index;
+	}
 
-	VulkanSampler* sampler = renderer->Samplers->Samplers[samplermode].get();
-	Textures.WriteBindless.AddCombinedImageSampler(Textures.BindlessSet.get(), 0, index, tex->imageView.get(), sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	return index | (samplermode << 16);
+}
 
-	tex->BindlessIndex[samplermode] = index;
-	return index;
+void DescriptorSetManager::UpdateTextureView(CachedTexture* tex)
+{
+	if (tex->BindlessIndex != -1)
+		Textures.ViewUpdates.push_back(tex);
 }
 
 void DescriptorSetManager::UpdateBindlessSet()
 {
+	if (!Textures.ViewUpdates.empty())
+	{
+		// Update after bind lets the draws recorded this frame see the new view in the texture's existing slot.
+		// A slot must not change while an earlier frame that may read it is still running, though. If the GPU is
+		// behind, the texture moves to a new slot on its next use instead.
+		bool gpuIdle = renderer->Commands->IsSubmitFinished(renderer->Commands->GetNextSubmitSerial() - 1);
+		for (CachedTexture* tex : Textures.ViewUpdates)
+		{
+			if (tex->BindlessIndex == -1)
+				continue;
+
+			if (gpuIdle)
+				Textures.WriteBindless.AddSampledImage(Textures.BindlessSet.get(), 1, tex->BindlessIndex, tex->imageView.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			else
+				tex->BindlessIndex = -1;
+		}
+		Textures.ViewUpdates.clear();
+	}
+
 	Textures.WriteBindless.Execute(renderer->Device.get());
 	Textures.WriteBindless = WriteDescriptors();
 }
@@ -74,7 +107,8 @@ void DescriptorSetManager::CreateBindlessTextureSet()
 {
 	Textures.BindlessPool = DescriptorPoolBuilder()
 		.Flags(VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT)
-		.AddPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MaxBindlessTextures)
+		.AddPoolSize(VK_DESCRIPTOR_TYPE_SAMPLER, 4)
+		.AddPoolSize(VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, MaxBindlessTextures)
 		.MaxSets(MaxBindlessTextures)
 		.DebugName("TextureBindlessPool")
 		.Create(renderer->Device.get());
@@ -82,7 +116,12 @@ void DescriptorSetManager::CreateBindlessTextureSet()
 	Textures.BindlessLayout = DescriptorSetLayoutBuilder()
 		.Flags(VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT)
 		.AddBinding(
-			0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			0, VK_DESCRIPTOR_TYPE_SAMPLER,
+			4,
+			VK_SHADER_STAGE_FRAGMENT_BIT,
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT)
+		.AddBinding(
+			1, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
 			MaxBindlessTextures,
 			VK_SHADER_STAGE_FRAGMENT_BIT,
 			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT)
@@ -113,28 +152,71 @@ void DescriptorSetManager::CreatePresentSet()
 
 void DescriptorSetManager::CreateBloomLayout()
 {
-	Bloom.Layout = DescriptorSetLayoutBuilder()
-		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
-		.AddBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT)
-		.DebugName("BloomLayout")
+	Bloom.DownsampleLayout = DescriptorSetLayoutBuilder()
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+		.DebugName("BloomDownsampleLayout")
+		.Create(renderer->Device.get());
+
+	Bloom.UpsampleLayout = DescriptorSetLayoutBuilder()
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+		.DebugName("BloomUpsampleLayout")
 		.Create(renderer->Device.get());
 }
 
 void DescriptorSetManager::CreateBloomSets()
 {
 	Bloom.Pool = DescriptorPoolBuilder()
-		.AddPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, (NumBloomLevels * 2 + 1) * 2)
-		.MaxSets(NumBloomLevels * 2 + 1)
+		.AddPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 + NumBloomLevels * 2)
+		.AddPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 + NumBloomLevels * 2)
+		.MaxSets(1 + NumBloomLevels * 2)
 		.DebugName("BloomPool")
 		.Create(renderer->Device.get());
 
+	Bloom.DownsampleSet = Bloom.Pool->allocate(Bloom.DownsampleLayout.get());
+	for (int level = 0; level < NumBloomLevels - 1; level++)
+		Bloom.BlurDownsampleSets[level] = Bloom.Pool->allocate(Bloom.UpsampleLayout.get());
 	for (int level = 0; level < NumBloomLevels; level++)
-	{
-		Bloom.HTextureSets[level] = Bloom.Pool->allocate(Bloom.Layout.get());
-		Bloom.VTextureSets[level] = Bloom.Pool->allocate(Bloom.Layout.get());
-	}
+		Bloom.UpsampleSets[level] = Bloom.Pool->allocate(Bloom.UpsampleLayout.get());
+	Bloom.SceneDownsampleSet = Bloom.Pool->allocate(Bloom.DownsampleLayout.get());
+}
+
+void DescriptorSetManager::CreateFusedPresentSet()
+{
+	FusedPresent.Layout = DescriptorSetLayoutBuilder()
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(3, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+		.DebugName("FusedPresentLayout")
+		.Create(renderer->Device.get());
 
-	Bloom.PPImageSet = Bloom.Pool->allocate(Bloom.Layout.get());
+	FusedPresent.Pool = DescriptorPoolBuilder()
+		.AddPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3 * MAX_FRAMES_IN_FLIGHT)
+		.AddPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, MAX_FRAMES_IN_FLIGHT)
+		.MaxSets(MAX_FRAMES_IN_FLIGHT)
+		.DebugName("FusedPresentPool")
+		.Create(renderer->Device.get());
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		FusedPresent.Sets[i] = FusedPresent.Pool->allocate(FusedPresent.Layout.get());
+}
+
+void DescriptorSetManager::CreateHitReduceSet()
+{
+	HitReduce.Layout = DescriptorSetLayoutBuilder()
+		.AddBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+		.AddBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT)
+		.DebugName("HitReduceLayout")
+		.Create(renderer->Device.get());
+
+	HitReduce.Pool = DescriptorPoolBuilder()
+		.AddPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1)
+		.AddPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1)
+		.MaxSets(1)
+		.DebugName("HitReducePool")
+		.Create(renderer->Device.get());
+	HitReduce.Set = HitReduce.Pool->allocate(HitReduce.Layout.get());
 }
 
 void DescriptorSetManager::UpdateFrameDescriptors()
@@ -145,11 +227,66 @@ void DescriptorSetManager::UpdateFrameDescriptors()
 	WriteDescriptors write;
 	write.AddCombinedImageSampler(Present.Set.get(), 0, textures->Scene->PPImageView[0].get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	write.AddCombinedImageSampler(Present.Set.get(), 1, textures->DitherImageView.get(), samplers->PPNearestRepeat.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	write.AddCombinedImageSampler(Bloom.DownsampleSet.get(), 0, textures->Scene->PPImageView[0].get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	write.AddCombinedImageSampler(Bloom.SceneDownsampleSet.get(), 0, textures->Scene->GetResolvedView(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	write.AddStorageImage(Bloom.DownsampleSet.get(), 1, textures->Scene->BloomLevels[0].TextureView.get(), VK_IMAGE_LAYOUT_GENERAL);
+	write.AddStorageImage(Bloom.SceneDownsampleSet.get(), 1, textures->Scene->BloomLevels[0].TextureView.get(), VK_IMAGE_LAYOUT_GENERAL);
+	for (int level = 0; level < NumBloomLevels - 1; level++)
+	{
+		// Each downsample step blurs a level and writes it into the next smaller one
+		write.AddCombinedImageSampler(GetBloomBlurDownsampleSet(level), 0, textures->Scene->BloomLevels[level].TextureView.get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_GENERAL);
+		write.AddStorageImage(GetBloomBlurDownsampleSet(level), 1, textures->Scene->BloomLevels[level + 1].TextureView.get(), VK_IMAGE_LAYOUT_GENERAL);
+	}
 	for (int level = 0; level < NumBloomLevels; level++)
 	{
-		write.AddCombinedImageSampler(GetBloomHTextureSet(level), 0, textures->Scene->BloomBlurLevels[level].HTextureView.get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-		write.AddCombinedImageSampler(GetBloomVTextureSet(level), 0, textures->Scene->BloomBlurLevels[level].VTextureView.get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		// Each upsample step blurs a level and writes it into the next larger one, the last one adds it to the post process image
+		VulkanImageView* output = level > 0 ? textures->Scene->BloomLevels[level - 1].TextureView.get() : textures->Scene->PPImageView[0].get();
+		write.AddCombinedImageSampler(GetBloomUpsampleSet(level), 0, textures->Scene->BloomLevels[level].TextureView.get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_GENERAL);
+		write.AddStorageImage(GetBloomUpsampleSet(level), 1, output, VK_IMAGE_LAYOUT_GENERAL);
 	}
-	write.AddCombinedImageSampler(Bloom.PPImageSet.get(), 0, textures->Scene->PPImageView[0].get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	write.Execute(renderer->Device.get());
+
+	if (textures->Scene->HitBuffer)
+		UpdateHitReduceSet();
+
+	// The fused present sets refer to the old color buffer until the next fused frame rewrites them
+	InvalidateFusedPresentSets();
+}
+
+void DescriptorSetManager::UpdateHitReduceSet()
+{
+	auto textures = renderer->Textures.get();
+	auto samplers = renderer->Samplers.get();
+
+	WriteDescriptors()
+		.AddCombinedImageSampler(HitReduce.Set.get(), 0, textures->Scene->HitBufferView.get(), samplers->PPNearestRepeat.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+		.AddBuffer(HitReduce.Set.get(), 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, textures->Scene->HitResultBuffer.get())
+		.Execute(renderer->Device.get());
+}
+
+void DescriptorSetManager::InvalidateFusedPresentSets()
+{
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		FusedPresent.Stale[i] = true;
+}
+
+VulkanDescriptorSet* DescriptorSetManager::GetFusedPresentSet()
+{
+	// The command buffer manager waited for the fence of this frame index, so its set is no longer in use and can be rewritten
+	uint32_t frame = renderer->Commands->CurrentFrameIndex;
+	VulkanDescriptorSet* set = FusedPresent.Sets[frame].get();
+	if (FusedPresent.Stale[frame])
+	{
+		auto textures = renderer->Textures.get();
+		auto samplers = renderer->Samplers.get();
+
+		WriteDescriptors()
+			.AddCombinedImageSampler(set, 0, textures->Scene->GetResolvedView(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+			.AddCombinedImageSampler(set, 1, textures->Scene->BloomLevels[0].TextureView.get(), samplers->PPLinearClamp.get(), VK_IMAGE_LAYOUT_GENERAL)
+			.AddCombinedImageSampler(set, 2, textures->DitherImageView.get(), samplers->PPNearestRepeat.get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+			.AddStorageImage(set, 3, textures->Scene->FusedPresentImageView.get(), VK_IMAGE_LAYOUT_GENERAL)
+			.Execute(renderer->Device.get());
+		FusedPresent.Stale[frame] = false;
+	}
+	return set;
 }
@@ -52,23 +52,36 @@ public:
 
 	void ClearCache();
 
-	bool IsTextureArrayFull() const { return Textures.NextBindlessIndex + 4 > MaxBindlessTextures; }
+	bool IsTextureArrayFull() const { return Textures.NextBindlessIndex + MaxTexturesPerDraw > MaxBindlessTextures; }
 	int GetTextureArrayIndex(DWORD PolyFlags, CachedTexture* tex, bool clamp = false);
 
 	VulkanDescriptorSet* GetBindlessSet() { return Textures.BindlessSet.get(); }
 	VulkanDescriptorSet* GetPresentSet() { return Present.Set.get(); }
-	VulkanDescriptorSet* GetBloomPPImageSet() { return Bloom.PPImageSet.get(); }
-	VulkanDescriptorSet* GetBloomVTextureSet(int level) { return Bloom.VTextureSets[level].get(); }
-	VulkanDescriptorSet* GetBloomHTextureSet(int level) { return Bloom.HTextureSets[level].get(); }
+	VulkanDescriptorSet* GetBloomDownsampleSet() { return Bloom.DownsampleSet.get(); }
+	VulkanDescriptorSet* GetBloomBlurDownsampleSet(int level) { return Bloom.BlurDownsampleSets[level].get(); }
+	VulkanDescriptorSet* GetBloomUpsampleSet(int level) { return Bloom.UpsampleSets[level].get(); }
+	VulkanDescriptorSet* GetBloomSceneDownsampleSet() { return Bloom.SceneDownsampleSet.get(); }
+	VulkanDescriptorSet* GetFusedPresentSet();
+	VulkanDescriptorSet* GetHitReduceSet() { return HitReduce.Set.get(); }
 
 	void UpdateBindlessSet();
+	void UpdateTextureView(CachedTexture* tex);
 	void UpdateFrameDescriptors();
+	void UpdateHitReduceSet();
+	void InvalidateFusedPresentSets();
 
 	static const int MaxBindlessTextures = 16536;
 
+	// A surface draw binds the texture, macro texture, detail texture and lightmap. Each can take a new bindless slot,
+	// so the array counts as full once there is no longer room for all four.
+	static const int MaxTexturesPerDraw = 4;
+
 	VulkanDescriptorSetLayout* GetTextureBindlessLayout() { return Textures.BindlessLayout.get(); }
 	VulkanDescriptorSetLayout* GetPresentLayout() { return Present.Layout.get(); }
-	VulkanDescriptorSetLayout* GetBloomLayout() { return Bloom.Layout.get(); }
+	VulkanDescriptorSetLayout* GetBloomDownsampleLayout() { return Bloom.DownsampleLayout.get(); }
+	VulkanDescriptorSetLayout* GetBloomUpsampleLayout() { return Bloom.UpsampleLayout.get(); }
+	VulkanDescriptorSetLayout* GetFusedPresentLayout() { return FusedPresent.Layout.get(); }
+	VulkanDescriptorSetLayout* GetHitReduceLayout() { return HitReduce.Layout.get(); }
 
 private:
 	void CreateBindlessTextureSet();
@@ -76,6 +89,8 @@ private:
 	void CreatePresentSet();
 	void CreateBloomLayout();
 	void CreateBloomSets();
+	void CreateFusedPresentSet();
+	void CreateHitReduceSet();
 
 	UVulkanRenderDevice* renderer = nullptr;
 
@@ -86,7 +101,7 @@ private:
 		std::unique_ptr<VulkanDescriptorSet> BindlessSet;
 		WriteDescriptors WriteBindless;
 		int NextBindlessIndex = 0;
-
+		std::vector<CachedTexture*> ViewUpdates;
 	} Textures;
 
 	struct
@@ -98,10 +113,31 @@ private:
 
 	struct
 	{
-		std::unique_ptr<VulkanDescriptorSetLayout> Layout;
+		std::unique_ptr<VulkanDescriptorSetLayout> DownsampleLayout;
+		std::unique_ptr<VulkanDescriptorSetLayout> UpsampleLayout;
 		std::unique_ptr<VulkanDescriptorPool> Pool;
-		std::unique_ptr<VulkanDescriptorSet> VTextureSets[NumBloomLevels];
-		std::unique_ptr<VulkanDescriptorSet> HTextureSets[NumBloomLevels];
-		std::unique_ptr<VulkanDescriptorSet> PPImageSet;
+		std::unique_ptr<VulkanDescriptorSet> DownsampleSet;
+		std::unique_ptr<VulkanDescriptorSet> BlurDownsampleSets[NumBloomLevels - 1];
+		std::unique_ptr<VulkanDescriptorSet> UpsampleSets[NumBloomLevels];
+
+		// Reads the scene color buffer directly for the fused present pass
+		std::unique_ptr<VulkanDescriptorSet> SceneDownsampleSet;
 	} Bloom;
+
+	struct
+	{
+		std::unique_ptr<VulkanDescriptorSetLayout> Layout;
+		std::unique_ptr<VulkanDescriptorPool> Pool;
+
+		// One set per frame in flight so that a new fused present image never changes a set the GPU may still be reading
+		std::unique_ptr<VulkanDescriptorSet> Sets[MAX_FRAMES_IN_FLIGHT];
+		bool Stale[MAX_FRAMES_IN_FLIGHT] = {};
+	} FusedPresent;
+
+	struct
+	{
+		std::unique_ptr<VulkanDescriptorSetLayout> Layout;
+		std::unique_ptr<VulkanDescriptorPool> Pool;
+		std::unique_ptr<VulkanDescriptorSet> Set;
+	} HitReduce;
 };
@@ -0,0 +1,89 @@
+
+#include "Precomp.h"
+#include "DynamicResolution.h"
+#include "UVulkanRenderDevice.h"
+
+// Defined here because std::max takes it by reference, which needs a definition in C++14
+const float DynamicResolution::MinScale = 0.5f;
+
+DynamicResolution::DynamicResolution(UVulkanRenderDevice* renderer) : renderer(renderer)
+{
+	if (renderer->Device->GraphicsTimeQueries)
+	{
+		Queries = QueryPoolBuilder()
+			.QueryType(VK_QUERY_TYPE_TIMESTAMP, RingSize * 2)
+			.DebugName("DynamicResolution.Queries")
+			.Create(renderer->Device.get());
+
+		TimestampPeriod = renderer->Device->PhysicalDevice.Properties.Properties.limits.timestampPeriod;
+	}
+}
+
+DynamicResolution::~DynamicResolution()
+{
+}
+
+void DynamicResolution::BeginFrame(VulkanCommandBuffer* cmdbuffer)
+{
+	float maxScale = std::max(std::min(renderer->VkRenderScale, 1.0f), MinScale);
+	if (!renderer->VkDynamicResolution || !Queries)
+	{
+		RenderScale = maxScale;
+		Pending = {};
+		return;
+	}
+
+	// Oldest first. The queries are never waited for, a frame that isn't done yet is looked at again next time.
+	for (uint64_t age = RingSize - 1; age > 0; age--)
+	{
+		if (age > FrameCounter)
+			continue;
+
+		int index = (int)((FrameCounter - age) % RingSize);
+		if (!Pending[index])
+			continue;
+
+		uint64_t timestamps[2] = {};
+		if (!Queries->getResults(index * 2, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT))
+			break;
+
+		Pending[index] = false;
+		if (timestamps[1] > timestamps[0])
+			Update((timestamps[1] - timestamps[0]) * TimestampPeriod / 1000000.0f, maxScale);
+	}
+
+	RenderScale = std::max(std::min(RenderScale, maxScale), MinScale);
+
+	int index = (int)(FrameCounter % RingSize);
+	Pending[index] = false;
+	cmdbuffer->resetQueryPool(Queries.get(), index * 2, 2);
+	cmdbuffer->writeTimestamp(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, Queries.get(), index * 2);
+	FrameBegun = true;
+}
+
+void DynamicResolution::EndFrame(VulkanCommandBuffer* cmdbuffer)
+{
+	if (!FrameBegun)
+		return;
+
+	int index = (int)(FrameCounter % RingSize);
+	cmdbuffer->writeTimestamp(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, Queries.get(), index * 2 + 1);
+	Pending[index] = true;
+	FrameCounter++;
+	FrameBegun = false;
+}
+
+void DynamicResolution::Update(float gpuTime, float maxScale)
+{
+	GPUTime = gpuTime;
+
+	// Leave the scale alone while the frame time is a bit below the target, so it doesn't hunt back and forth
+	float target = std::max(renderer->VkDynamicResolutionTarget, 1.0f);
+	if (gpuTime <= target && gpuTime >= target * 0.8f)
+		return;
+
+	// The GPU time mostly follows the pixel count, which goes with the square of the scale. Aim for the middle of the band.
+	float wanted = RenderScale * std::sqrt(target * 0.9f / std::max(gpuTime, 0.1f));
+	RenderScale += (wanted - RenderScale) * 0.25f;
+	RenderScale = std::max(std::min(RenderScale, maxScale), MinScale);
+}
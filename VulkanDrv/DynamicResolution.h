@@ -0,0 +1,36 @@
+#pragma once
+
+class UVulkanRenderDevice;
+
+// Picks the scene render scale for each frame from the GPU time of earlier frames, measured with timestamp queries
+class DynamicResolution
+{
+public:
+	DynamicResolution(UVulkanRenderDevice* renderer);
+	~DynamicResolution();
+
+	// Takes in the timings that have arrived, picks the scale for this frame and writes its start timestamp
+	void BeginFrame(VulkanCommandBuffer* cmdbuffer);
+	void EndFrame(VulkanCommandBuffer* cmdbuffer);
+
+	float GetRenderScale() const { return RenderScale; }
+	float GetGPUTime() const { return GPUTime; }
+
+	static const float MinScale;
+
+private:
+	void Update(float gpuTime, float maxScale);
+
+	UVulkanRenderDevice* renderer = nullptr;
+
+	// A frame can span several submits, so the timings are kept in a ring of their own rather than per frame slot
+	static const int RingSize = MAX_FRAMES_IN_FLIGHT + 2;
+	std::unique_ptr<VulkanQueryPool> Queries;
+	std::array<bool, RingSize> Pending = {};
+	uint64_t FrameCounter = 0;
+	bool FrameBegun = false;
+	float TimestampPeriod = 1.0f;
+
+	float RenderScale = 1.0f;
+	float GPUTime = 0.0f;
+};
@@ -53,7 +53,8 @@ std::string FileResource::readAllText(const std::string& filename)
 	else if (filename == "shaders/Scene.frag")
 	{
 		return R"(
-			layout(binding = 0) uniform sampler2D textures[];
+			layout(binding = 0) uniform sampler samplers[4];
+			layout(binding = 1) uniform texture2DArray textures[];
 
 			layout(location = 0) flat in uint flags;
 			layout(location = 1) centroid in vec2 texCoord;
@@ -65,7 +66,12 @@ std::string FileResource::readAllText(const std::string& filename)
 			layout(location = 7) flat in ivec4 textureBinds;
 
 			layout(location = 0) out vec4 outColor;
+			#if !defined(NOHIT)
 			layout(location = 1) out uint outHitIndex;
+			#endif
+
+			// Flags the pipeline variant may see. The branches for the other flags are removed when the pipeline is created.
+			layout(constant_id = 0) const uint features = 31;
 
 			vec4 darkClamp(vec4 c)
 			{
@@ -74,10 +80,18 @@ std::string FileResource::readAllText(const std::string& filename)
 				return vec4(clamp((c.rgb - cutoff) / (1.0 - cutoff), 0.0, 1.0), c.a);
 			}
 
-			vec4 textureTex(vec2 uv) { return texture(textures[nonuniformEXT(textureBinds.x)], uv); }
-			vec4 textureMacro(vec2 uv) { return texture(textures[nonuniformEXT(textureBinds.y)], uv); }
-			vec4 textureDetail(vec2 uv) { return texture(textures[nonuniformEXT(textureBinds.z)], uv); }
-			vec4 textureLightmap(vec2 uv) { return texture(textures[nonuniformEXT(textureBinds.w)], uv); }
+			// Texture binds are the image index in the low 16 bits, the sampler in the next two bits and the array layer above that
+			vec4 textureBind(int bind, vec2 uv)
+			{
+				int index = bind & 0xffff;
+				int samplerIndex = (bind >> 16) & 3;
+				return texture(nonuniformEXT(sampler2DArray(textures[nonuniformEXT(index)], samplers[nonuniformEXT(samplerIndex)])), vec3(uv, bind >> 18));
+			}
+
+			vec4 textureTex(vec2 uv) { return textureBind(textureBinds.x, uv); }
+			vec4 textureMacro(vec2 uv) { return textureBind(textureBinds.y, uv); }
+			vec4 textureDetail(vec2 uv) { return textureBind(textureBinds.z, uv); }
+			vec4 textureLightmap(vec2 uv) { return textureBind(textureBinds.w, uv); }
 
 			void main()
 			{
@@ -87,29 +101,29 @@ std::string FileResource::readAllText(const std::string& filename)
 				outColor = darkClamp(textureTex(texCoord)) * color;
 				outColor.rgb *= actorXBlending;
 
-				if ((flags & 2) != 0) // Macro texture
+				if ((flags & features & 2) != 0) // Macro texture
 				{
 					outColor *= darkClamp(textureMacro(texCoord3));
 				}
 
-				if ((flags & 1) != 0) // Lightmap
+				if ((flags & features & 1) != 0) // Lightmap
 				{
 					outColor.rgb *= clamp(textureLightmap(texCoord2).rgb, 0.0, 1.0) * oneXBlending;
 				}
 
-				if ((flags & 4) != 0) // Detail texture
+				if ((flags & features & 4) != 0) // Detail texture
 				{
 					float fadedistance = 380.0f;
 					float a = clamp(2.0f - (1.0f / gl_FragCoord.w) / fadedistance, 0.0f, 1.0f);
 					vec4 detailColor = (textureDetail(texCoord4) - 0.5) * 0.8 + 1.0;
 					outColor.rgb = mix(outColor.rgb, outColor.rgb * detailColor.rgb, a);
 				}
-				else if ((flags & 8) != 0) // Fog map
+				else if ((flags & features & 8) != 0) // Fog map
 				{
 					vec4 fogcolor = textureDetail(texCoord4);
 					outColor.rgb = fogcolor.rgb + outColor.rgb * (1.0 - fogcolor.a);
 				}
-				else if ((flags & 16) != 0) // Fog color
+				else if ((flags & features & 16) != 0) // Fog color
 				{
 					vec4 fogcolor = vec4(texCoord2, texCoord3);
 					outColor.rgb = fogcolor.rgb + outColor.rgb * (1.0 - fogcolor.a);
@@ -121,7 +135,9 @@ std::string FileResource::readAllText(const std::string& filename)
 
 				outColor = clamp(outColor, 0.0, 1.0);
 
+				#if !defined(NOHIT)
 				outHitIndex = hitIndex;
+				#endif
 			}
 		)";
 	}
@@ -157,6 +173,8 @@ std::string FileResource::readAllText(const std::string& filename)
 				float Brightness;
 				float HdrScale;
 				vec4 GammaCorrection;
+				vec2 SourceScale;
+				float Sharpness;
 			};
 
 			layout(binding = 0) uniform sampler2D texSampler;
@@ -164,6 +182,87 @@ std::string FileResource::readAllText(const std::string& filename)
 			layout(location = 0) in vec2 texCoord;
 			layout(location = 0) out vec4 outColor;
 
+			#include "shaders/PresentColor.glsl"
+
+			#if defined(UPSCALE)
+
+			float luma(vec3 c)
+			{
+				return dot(min(c, vec3(1.0)), vec3(0.299, 0.587, 0.114));
+			}
+
+			// Polynomial approximation of a Lanczos2 kernel, taking the squared distance
+			float lanczos2(float x2)
+			{
+				x2 = min(x2, 4.0);
+				float a = 0.4 * x2 - 1.0;
+				float b = 0.25 * x2 - 1.0;
+				return (1.5625 * a * a - 0.5625) * (b * b);
+			}
+
+			// Edge adaptive upscale of the 4x4 texels around the sample point. The kernel is stretched along edges and squeezed across them,
+			// so edges stay sharp without the stair steps of a plain bilinear filter. The result is clamped to the nearest 2x2 texels to avoid ringing.
+			vec3 upscale(vec2 uv)
+			{
+				ivec2 texSize = textureSize(texSampler, 0);
+				ivec2 last = ivec2(SourceScale * vec2(texSize) + 0.5) - 1;
+				vec2 pos = uv * vec2(texSize) - 0.5;
+				ivec2 base = ivec2(floor(pos));
+				vec2 f = pos - vec2(base);
+
+				vec3 c[16];
+				float l[16];
+				for (int y = 0; y < 4; y++)
+				{
+					for (int x = 0; x < 4; x++)
+					{
+						c[y * 4 + x] = texelFetch(texSampler, clamp(base + ivec2(x - 1, y - 1), ivec2(0), last), 0).rgb;
+						l[y * 4 + x] = luma(c[y * 4 + x]);
+					}
+				}
+
+				// Luma gradient at the sample point, from central differences at the four nearest texels
+				vec2 grad = vec2(0.0);
+				for (int y = 1; y <= 2; y++)
+				{
+					for (int x = 1; x <= 2; x++)
+					{
+						float w = (x == 1 ? 1.0 - f.x : f.x) * (y == 1 ? 1.0 - f.y : f.y);
+						grad += w * vec2(l[y * 4 + x + 1] - l[y * 4 + x - 1], l[y * 4 + x + 4] - l[y * 4 + x - 4]);
+					}
+				}
+
+				float len = length(grad);
+				vec2 dir = len > 1.0 / 255.0 ? grad / len : vec2(1.0, 0.0);
+				float edge = clamp(len * 2.0, 0.0, 1.0);
+
+				// Stretching more than this made PSNR and SSIM against native renders worse than not stretching at all
+				float stretch = 1.0 + 0.25 * edge;
+				vec2 axisScale = vec2(stretch, 1.0 / stretch);
+
+				vec3 sum = vec3(0.0);
+				float weights = 0.0;
+				for (int i = 0; i < 16; i++)
+				{
+					vec2 d = vec2(i % 4 - 1, i / 4 - 1) - f;
+					vec2 r = vec2(dot(d, dir), dot(d, vec2(-dir.y, dir.x))) * axisScale;
+					float w = lanczos2(dot(r, r));
+					sum += c[i] * w;
+					weights += w;
+				}
+				vec3 color = sum / max(weights, 0.0001);
+
+				vec3 lo = min(min(c[5], c[6]), min(c[9], c[10]));
+				vec3 hi = max(max(c[5], c[6]), max(c[9], c[10]));
+				color = clamp(color, lo, hi);
+
+				// Sharpen by pushing away from the bilinear result, limited to the same range
+				vec3 bilinear = mix(mix(c[5], c[6], f.x), mix(c[9], c[10], f.x), f.y);
+				return clamp(color + (color - bilinear) * Sharpness, lo, hi);
+			}
+
+			#endif
+
 			vec3 dither(vec3 c)
 			{
 				vec2 texSize = vec2(textureSize(texDither, 0));
@@ -171,6 +270,28 @@ std::string FileResource::readAllText(const std::string& filename)
 				return floor(c.rgb * 255.0 + threshold) / 255.0;
 			}
 
+
+			void main()
+			{
+				// The scene may only cover the top left part of the post process image. Keep the filter from reaching past it.
+				vec2 uv = min(texCoord * SourceScale, SourceScale - 0.5 / vec2(textureSize(texSampler, 0)));
+			#if defined(UPSCALE)
+				vec3 color = gammaCorrect(colorCorrect(upscale(uv)));
+			#else
+				vec3 color = gammaCorrect(colorCorrect(texture(texSampler, uv).rgb));
+			#endif
+			#if defined(HDR_MODE)
+				outColor = vec4(linearHdr(color), 1.0f);
+			#else
+				outColor = vec4(dither(color), 1.0f);
+			#endif
+			}
+		)";
+	}
+	else if (filename == "shaders/PresentColor.glsl")
+	{
+		// Color correction shared by Present.frag and FusedPresent.comp. Expects the PresentPushConstants members to be declared already.
+		return R"(
 			vec3 linearHdr(vec3 c)
 			{
 				return pow(c, vec3(2.2)) * HdrScale;
@@ -255,46 +376,104 @@ std::string FileResource::readAllText(const std::string& filename)
 			#else
 			vec3 colorCorrect(vec3 c) { return c; }
 			#endif
+		)";
+	}
+	else if (filename == "shaders/HitReduce.comp")
+	{
+		return R"(
+			layout(local_size_x = 16, local_size_y = 16) in;
+
+			#if defined(MULTISAMPLE)
+			layout(binding = 0) uniform usampler2DMS hitBuffer;
+			#else
+			layout(binding = 0) uniform usampler2D hitBuffer;
+			#endif
+
+			layout(std430, binding = 1) buffer HitResult
+			{
+				uint hitResult;
+			};
+
+			layout(push_constant) uniform HitReducePushConstants
+			{
+				ivec2 HitOffset;
+				ivec2 HitSize;
+			};
+
+			shared uint tile[256];
 
 			void main()
 			{
-				vec3 color = gammaCorrect(colorCorrect(texture(texSampler, texCoord).rgb));
-			#if defined(HDR_MODE)
-				outColor = vec4(linearHdr(color), 1.0f);
+				ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+				ivec2 pixel = HitOffset + pos;
+
+			#if defined(MULTISAMPLE)
+				ivec2 size = textureSize(hitBuffer);
 			#else
-				outColor = vec4(dither(color), 1.0f);
+				ivec2 size = textureSize(hitBuffer, 0);
+			#endif
+
+				// Hit indexes are stored plus one, so zero means nothing was hit and the largest value is the last hit drawn
+				uint hit = 0;
+				if (all(lessThan(pos, HitSize)) && all(greaterThanEqual(pixel, ivec2(0))) && all(lessThan(pixel, size)))
+				{
+			#if defined(MULTISAMPLE)
+					int samples = textureSamples(hitBuffer);
+					for (int i = 0; i < samples; i++)
+						hit = max(hit, texelFetch(hitBuffer, pixel, i).r);
+			#else
+					hit = texelFetch(hitBuffer, pixel, 0).r;
 			#endif
+				}
+
+				// Reduce the workgroup in shared memory, then combine the workgroups with one atomic each
+				uint index = gl_LocalInvocationIndex;
+				tile[index] = hit;
+				for (uint stride = 128; stride > 0; stride >>= 1)
+				{
+					barrier();
+					if (index < stride)
+						tile[index] = max(tile[index], tile[index + stride]);
+				}
+
+				if (index == 0 && tile[0] != 0)
+					atomicMax(hitResult, tile[0]);
 			}
 		)";
 	}
-	else if (filename == "shaders/BloomExtract.frag")
+	else if (filename == "shaders/BloomDownsample.comp")
 	{
 		return R"(
-			layout(push_constant) uniform BloomPushConstants
+			layout(local_size_x = 16, local_size_y = 16) in;
+
+			layout(push_constant) uniform BloomDownsamplePushConstants
 			{
-				float SampleWeights0;
-				float SampleWeights1;
-				float SampleWeights2;
-				float SampleWeights3;
-				float SampleWeights4;
-				float SampleWeights5;
-				float SampleWeights6;
-				float SampleWeights7;
+				ivec2 SourceSize; // Part of the scene image rendered to this frame
 			};
 
 			layout(binding = 0) uniform sampler2D texSampler;
-			layout(location = 0) in vec2 texCoord;
-			layout(location = 0) out vec4 outColor;
+			layout(binding = 1, SCENE_FORMAT) uniform writeonly image2D level0;
 
 			void main()
 			{
-				outColor = vec4(max(texture(texSampler, texCoord).rgb - 1.0, 0.0), 0.0);
+				ivec2 size = imageSize(level0);
+				ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+				if (any(greaterThanEqual(pos, size)))
+					return;
+				ivec2 last = (SourceSize + 1) / 2 - 1;
+
+				// Extract overbright pixels. Sampling in the middle of the 2x2 source pixels averages them.
+				vec2 uv = (vec2(min(pos, last)) + 0.5) / vec2((textureSize(texSampler, 0) + 1) / 2);
+				vec3 color = max(texture(texSampler, uv).rgb - 1.0, 0.0);
+				imageStore(level0, pos, vec4(color, 0.0));
 			}
 		)";
 	}
-	else if (filename == "shaders/BloomCombine.frag")
+	else if (filename == "shaders/BloomUpsample.comp")
 	{
 		return R"(
+			layout(local_size_x = 16, local_size_y = 16) in;
+
 			layout(push_constant) uniform BloomPushConstants
 			{
 				float SampleWeights0;
@@ -308,20 +487,130 @@ std::string FileResource::readAllText(const std::string& filename)
 			};
 
 			layout(binding = 0) uniform sampler2D texSampler;
-			layout(location = 0) in vec2 texCoord;
-			layout(location = 0) out vec4 outColor;
+			#if defined(COMBINE)
+			layout(binding = 1, SCENE_FORMAT) uniform image2D outputImage;
+			#else
+			layout(binding = 1, SCENE_FORMAT) uniform writeonly image2D outputImage;
+			#endif
+
+			#include "shaders/BloomBlur.glsl"
 
 			void main()
 			{
-				outColor = texture(texSampler, texCoord);
+				ivec2 outputSize = imageSize(outputImage);
+				vec3 bloom = blurScale(texSampler, outputSize);
+
+				ivec2 pos = ivec2(gl_WorkGroupID.xy) * OUTPUT_TILE + ivec2(gl_LocalInvocationID.xy);
+				if (any(greaterThanEqual(gl_LocalInvocationID.xy, uvec2(OUTPUT_TILE))) || any(greaterThanEqual(pos, outputSize)))
+					return;
+
+			#if defined(COMBINE)
+				imageStore(outputImage, pos, imageLoad(outputImage, pos) + vec4(bloom, 0.0));
+			#else
+				imageStore(outputImage, pos, vec4(bloom, 0.0));
+			#endif
 			}
 		)";
 	}
-	else if (filename == "shaders/Blur.frag")
+	else if (filename == "shaders/BloomBlur.glsl")
 	{
+		// Shared by BloomUpsample.comp and FusedPresent.comp. Expects the SampleWeights push constants and a 16x16 workgroup.
 		return R"(
-			layout(push_constant) uniform BloomPushConstants
+			#define BORDER 3
+			#if defined(DOWNSAMPLE)
+			// The 8x8 output pixels of a workgroup need up to 17x17 input texels for the linear downscale, plus the blur radius on each side
+			#define OUTPUT_TILE 8
+			#define TILE 23
+			#else
+			// The 16x16 output pixels of a workgroup need up to 14x14 input texels for the linear upscale, plus the blur radius on each side
+			#define OUTPUT_TILE 16
+			#define TILE 20
+			#endif
+			#define INNER (TILE - BORDER * 2)
+
+			shared vec3 tileA[TILE][TILE];
+			shared vec3 tileB[TILE][TILE];
+
+			// Blurs the input and returns it linearly scaled for the pixel at gl_WorkGroupID * OUTPUT_TILE + gl_LocalInvocationID.
+			// All invocations must call it.
+			vec3 blurScale(sampler2D inputTexture, ivec2 outputSize)
+			{
+				ivec2 local = ivec2(gl_LocalInvocationID.xy);
+				int index = int(gl_LocalInvocationIndex);
+				ivec2 inputSize = textureSize(inputTexture, 0);
+				vec2 scale = vec2(inputSize) / vec2(outputSize);
+
+				ivec2 outputOrigin = ivec2(gl_WorkGroupID.xy) * OUTPUT_TILE;
+				ivec2 tileOrigin = ivec2(floor((vec2(outputOrigin) + 0.5) * scale - 0.5)) - BORDER;
+
+				for (int i = index; i < TILE * TILE; i += 256)
+				{
+					ivec2 p = ivec2(i % TILE, i / TILE);
+					tileA[p.y][p.x] = texelFetch(inputTexture, clamp(tileOrigin + p, ivec2(0), inputSize - 1), 0).rgb;
+				}
+				barrier();
+
+				// Gaussian blur, horizontal
+				for (int i = index; i < TILE * INNER; i += 256)
+				{
+					int x = BORDER + i % INNER;
+					int y = i / INNER;
+					tileB[y][x] =
+						tileA[y][x] * SampleWeights0 +
+						tileA[y][x + 1] * SampleWeights1 +
+						tileA[y][x - 1] * SampleWeights2 +
+						tileA[y][x + 2] * SampleWeights3 +
+						tileA[y][x - 2] * SampleWeights4 +
+						tileA[y][x + 3] * SampleWeights5 +
+						tileA[y][x - 3] * SampleWeights6;
+				}
+				barrier();
+
+				// Gaussian blur, vertical
+				for (int i = index; i < INNER * INNER; i += 256)
+				{
+					int x = BORDER + i % INNER;
+					int y = BORDER + i / INNER;
+					tileA[y][x] =
+						tileB[y][x] * SampleWeights0 +
+						tileB[y + 1][x] * SampleWeights1 +
+						tileB[y - 1][x] * SampleWeights2 +
+						tileB[y + 2][x] * SampleWeights3 +
+						tileB[y - 2][x] * SampleWeights4 +
+						tileB[y + 3][x] * SampleWeights5 +
+						tileB[y - 3][x] * SampleWeights6;
+				}
+				barrier();
+
+				// Linear scale
+				// The position is clamped to the input first, the same as a linear sampler with clamp to edge
+				ivec2 pos = outputOrigin + local;
+				vec2 p = clamp((vec2(pos) + 0.5) * scale - 0.5, vec2(0.0), vec2(inputSize - 1)) - vec2(tileOrigin);
+				p = clamp(p, vec2(BORDER), vec2(TILE - BORDER - 1));
+				ivec2 p0 = ivec2(p);
+				ivec2 p1 = min(p0 + 1, ivec2(TILE - BORDER - 1));
+				vec2 t = p - vec2(p0);
+				return mix(
+					mix(tileA[p0.y][p0.x], tileA[p0.y][p1.x], t.x),
+					mix(tileA[p1.y][p0.x], tileA[p1.y][p1.x], t.x),
+					t.y);
+			}
+		)";
+	}
+	else if (filename == "shaders/FusedPresent.comp")
+	{
+		return R"(
+			layout(local_size_x = 16, local_size_y = 16) in;
+
+			layout(push_constant) uniform FusedPresentPushConstants
 			{
+				float Contrast;
+				float Saturation;
+				float Brightness;
+				float HdrScale;
+				vec4 GammaCorrection;
+				vec2 SourceScale; // Always 1, the fused pass isn't used for scaled frames
+				float Sharpness;
 				float SampleWeights0;
 				float SampleWeights1;
 				float SampleWeights2;
@@ -332,30 +621,47 @@ std::string FileResource::readAllText(const std::string& filename)
 				float SampleWeights7;
 			};
 
-			layout(binding = 0) uniform sampler2D texSampler;
-			layout(location = 0) in vec2 texCoord;
-			layout(location = 0) out vec4 outColor;
+			layout(constant_id = 0) const bool bloom = true;
+
+			layout(binding = 0) uniform sampler2D texScene;
+			layout(binding = 1) uniform sampler2D texBloom;
+			layout(binding = 2) uniform sampler2D texDither;
+			#if defined(HDR_MODE)
+			layout(binding = 3, rgba16f) uniform writeonly image2D outputImage;
+			#else
+			layout(binding = 3, rgba8) uniform writeonly image2D outputImage;
+			#endif
+
+			#include "shaders/PresentColor.glsl"
+			#include "shaders/BloomBlur.glsl"
+
+			vec3 dither(vec3 c, ivec2 pos)
+			{
+				float threshold = texelFetch(texDither, pos % textureSize(texDither, 0), 0).r;
+				return floor(c.rgb * 255.0 + threshold) / 255.0;
+			}
+
+			vec3 fetchScene(ivec2 pos)
+			{
+				return texelFetch(texScene, pos, 0).rgb;
+			}
 
 			void main()
 			{
-			#if defined(BLUR_HORIZONTAL)
-				outColor =
-					textureOffset(texSampler, texCoord, ivec2( 0, 0)) * SampleWeights0 +
-					textureOffset(texSampler, texCoord, ivec2( 1, 0)) * SampleWeights1 +
-					textureOffset(texSampler, texCoord, ivec2(-1, 0)) * SampleWeights2 +
-					textureOffset(texSampler, texCoord, ivec2( 2, 0)) * SampleWeights3 +
-					textureOffset(texSampler, texCoord, ivec2(-2, 0)) * SampleWeights4 +
-					textureOffset(texSampler, texCoord, ivec2( 3, 0)) * SampleWeights5 +
-					textureOffset(texSampler, texCoord, ivec2(-3, 0)) * SampleWeights6;
+				ivec2 outputSize = imageSize(outputImage);
+				vec3 bloomColor = vec3(0.0);
+				if (bloom)
+					bloomColor = blurScale(texBloom, outputSize);
+
+				ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+				if (any(greaterThanEqual(pos, outputSize)))
+					return;
+
+				vec3 color = gammaCorrect(colorCorrect(fetchScene(pos) + bloomColor));
+			#if defined(HDR_MODE)
+				imageStore(outputImage, pos, vec4(linearHdr(color), 1.0));
 			#else
-				outColor =
-					textureOffset(texSampler, texCoord, ivec2(0, 0)) * SampleWeights0 +
-					textureOffset(texSampler, texCoord, ivec2(0, 1)) * SampleWeights1 +
-					textureOffset(texSampler, texCoord, ivec2(0,-1)) * SampleWeights2 +
-					textureOffset(texSampler, texCoord, ivec2(0, 2)) * SampleWeights3 +
-					textureOffset(texSampler, texCoord, ivec2(0,-2)) * SampleWeights4 +
-					textureOffset(texSampler, texCoord, ivec2(0, 3)) * SampleWeights5 +
-					textureOffset(texSampler, texCoord, ivec2(0,-3)) * SampleWeights6;
+				imageStore(outputImage, pos, vec4(dither(color, pos), 1.0));
 			#endif
 			}
 		)";
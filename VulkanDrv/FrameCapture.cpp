@@ -0,0 +1,271 @@
+
+#include "Precomp.h"
+#include "FrameCapture.h"
+#include "UVulkanRenderDevice.h"
+
+FrameCapture::FrameCapture(UVulkanRenderDevice* renderer) : renderer(renderer)
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+	StopStream();
+}
+
+int FrameCapture::Record(VulkanImage* srcimage, int srcWidth, int srcHeight, bool stream)
+{
+	int index = NextReadback;
+	NextReadback = (NextReadback + 1) % RingSize;
+
+	Readback& readback = Ring[index];
+	if (readback.Pending)
+		Finish(readback);
+
+	int width = srcimage->width;
+	int height = srcimage->height;
+	size_t size = (size_t)width * height * 4;
+
+	if (!ConvertImage || ConvertImage->width != width || ConvertImage->height != height)
+	{
+		if (ConvertImage)
+			renderer->Commands->GetCurrentDeleteList()->images.push_back(std::move(ConvertImage));
+
+		ConvertImage = ImageBuilder()
+			.Format(VK_FORMAT_B8G8R8A8_UNORM)
+			.Usage(VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+			.Size(width, height)
+			.DebugName("FrameCapture.ConvertImage")
+			.Create(renderer->Device.get());
+	}
+
+	// Finish above made sure the GPU is done with the old buffer
+	if (!readback.Buffer || readback.BufferSize < size)
+	{
+		readback.Buffer = BufferBuilder()
+			.Size(size)
+			.Usage(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU)
+			.DebugName("FrameCapture.Staging")
+			.Create(renderer->Device.get());
+		readback.BufferSize = size;
+	}
+
+	auto cmdbuffer = renderer->Commands->GetDrawCommands();
+
+	// The convert image may still be read by the copy of the previous capture
+	PipelineBarrier()
+		.AddImage(srcimage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_READ_BIT)
+		.AddImage(ConvertImage.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+	VkImageBlit blit = {};
+	blit.srcOffsets[0] = { 0, 0, 0 };
+	blit.srcOffsets[1] = { srcWidth, srcHeight, 1 };
+	blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	blit.srcSubresource.mipLevel = 0;
+	blit.srcSubresource.baseArrayLayer = 0;
+	blit.srcSubresource.layerCount = 1;
+	blit.dstOffsets[0] = { 0, 0, 0 };
+	blit.dstOffsets[1] = { width, height, 1 };
+	blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	blit.dstSubresource.mipLevel = 0;
+	blit.dstSubresource.baseArrayLayer = 0;
+	blit.dstSubresource.layerCount = 1;
+	cmdbuffer->blitImage(
+		srcimage->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		ConvertImage->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		1, &blit, (srcWidth != width || srcHeight != height) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST);
+
+	PipelineBarrier()
+		.AddImage(srcimage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
+		.AddImage(ConvertImage.get(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	VkBufferImageCopy region = {};
+	region.imageExtent.width = width;
+	region.imageExtent.height = height;
+	region.imageExtent.depth = 1;
+	region.imageSubresource.layerCount = 1;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	cmdbuffer->copyImageToBuffer(ConvertImage->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.Buffer->buffer, 1, &region);
+
+	PipelineBarrier()
+		.AddBuffer(readback.Buffer.get(), VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+
+	readback.Width = width;
+	readback.Height = height;
+	readback.SubmitSerial = renderer->Commands->GetNextSubmitSerial();
+	readback.Pending = true;
+	readback.Stream = stream;
+	return index;
+}
+
+void FrameCapture::Read(int index, void* dest)
+{
+	Readback& readback = Ring[index];
+	renderer->Commands->WaitForSubmit(readback.SubmitSerial);
+	readback.Pending = false;
+
+	size_t size = (size_t)readback.Width * readback.Height * 4;
+	const uint8_t* pixels = (const uint8_t*)readback.Buffer->Map(0, size);
+	if (pixels)
+	{
+		memcpy(dest, pixels, size);
+		readback.Buffer->Unmap();
+	}
+}
+
+void FrameCapture::Finish(Readback& readback)
+{
+	renderer->Commands->WaitForSubmit(readback.SubmitSerial);
+	readback.Pending = false;
+
+	// A ReadPixels copy that nobody read is simply dropped
+	if (readback.Stream && StreamFile)
+	{
+		size_t size = (size_t)readback.Width * readback.Height * 4;
+		const uint8_t* pixels = (const uint8_t*)readback.Buffer->Map(0, size);
+		if (pixels)
+		{
+			WriteFrame(pixels, readback.Width, readback.Height);
+			readback.Buffer->Unmap();
+		}
+	}
+}
+
+void FrameCapture::WriteStreamedFrames(int maxPending)
+{
+	while (true)
+	{
+		Readback* oldest = nullptr;
+		int pending = 0;
+		for (Readback& readback : Ring)
+		{
+			if (readback.Pending && readback.Stream)
+			{
+				pending++;
+				if (!oldest || readback.SubmitSerial < oldest->SubmitSerial)
+					oldest = &readback;
+			}
+		}
+
+		if (!oldest || (pending <= maxPending && !renderer->Commands->IsSubmitFinished(oldest->SubmitSerial)))
+			break;
+
+		Finish(*oldest);
+	}
+}
+
+bool FrameCapture::StartStream(const TCHAR* filename, int framerate)
+{
+	StopStream();
+
+	StreamFile = GFileManager->CreateFileWriter(filename);
+	if (!StreamFile)
+	{
+		debugf(TEXT("Could not open %s for frame capture"), filename);
+		return false;
+	}
+
+	int len = appStrlen(filename);
+	StreamY4M = len >= 4 && appStricmp(filename + len - 4, TEXT(".y4m")) == 0;
+	StreamFramerate = std::max(framerate, 1);
+	StreamWidth = 0;
+	StreamHeight = 0;
+	StreamFrames = 0;
+
+	debugf(TEXT("Frame capture started: %s"), filename);
+	return true;
+}
+
+void FrameCapture::StopStream()
+{
+	if (!StreamFile)
+		return;
+
+	WriteStreamedFrames(0);
+
+	// WriteFrame closes the file itself if the frame size changed
+	if (StreamFile)
+	{
+		StreamFile->Close();
+		delete StreamFile;
+		StreamFile = nullptr;
+		debugf(TEXT("Frame capture stopped after %d frames"), StreamFrames);
+	}
+}
+
+void FrameCapture::WriteFrame(const uint8_t* pixels, int width, int height)
+{
+	if (StreamWidth == 0)
+	{
+		StreamWidth = width;
+		StreamHeight = height;
+
+		if (StreamY4M)
+		{
+			char header[128];
+			snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, StreamFramerate);
+			StreamFile->Serialize(header, (INT)strlen(header));
+		}
+	}
+	else if (StreamWidth != width || StreamHeight != height)
+	{
+		// Neither format can change size halfway
+		StreamFile->Close();
+		delete StreamFile;
+		StreamFile = nullptr;
+		debugf(TEXT("Frame capture stopped after %d frames as the resolution changed"), StreamFrames);
+		return;
+	}
+
+	StreamFrames++;
+
+	if (!StreamY4M)
+	{
+		StreamFile->Serialize((void*)pixels, width * height * 4);
+		return;
+	}
+
+	// Full range BT.601 with the chroma averaged over 2x2 pixels
+	int chromaWidth = (width + 1) / 2;
+	int chromaHeight = (height + 1) / 2;
+	StreamBuffer.resize((size_t)width * height + (size_t)chromaWidth * chromaHeight * 2);
+	uint8_t* yplane = StreamBuffer.data();
+	uint8_t* uplane = yplane + width * height;
+	uint8_t* vplane = uplane + chromaWidth * chromaHeight;
+
+	for (int y = 0; y < height; y++)
+	{
+		const uint8_t* src = pixels + y * width * 4;
+		uint8_t* dest = yplane + y * width;
+		for (int x = 0; x < width; x++)
+		{
+			int b = src[0], g = src[1], r = src[2];
+			dest[x] = (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+			src += 4;
+		}
+	}
+
+	for (int cy = 0; cy < chromaHeight; cy++)
+	{
+		for (int cx = 0; cx < chromaWidth; cx++)
+		{
+			int x0 = cx * 2, x1 = std::min(cx * 2 + 1, width - 1);
+			int y0 = cy * 2, y1 = std::min(cy * 2 + 1, height - 1);
+			const uint8_t* p00 = pixels + (y0 * width + x0) * 4;
+			const uint8_t* p01 = pixels + (y0 * width + x1) * 4;
+			const uint8_t* p10 = pixels + (y1 * width + x0) * 4;
+			const uint8_t* p11 = pixels + (y1 * width + x1) * 4;
+			int b = (p00[0] + p01[0] + p10[0] + p11[0] + 2) >> 2;
+			int g = (p00[1] + p01[1] + p10[1] + p11[1] + 2) >> 2;
+			int r = (p00[2] + p01[2] + p10[2] + p11[2] + 2) >> 2;
+			uplane[cy * chromaWidth + cx] = (uint8_t)std::min((-43 * r - 85 * g + 128 * b + 32896) >> 8, 255);
+			vplane[cy * chromaWidth + cx] = (uint8_t)std::min((128 * r - 107 * g - 21 * b + 32896) >> 8, 255);
+		}
+	}
+
+	static const char frameHeader[] = "FRAME\n";
+	StreamFile->Serialize((void*)frameHeader, sizeof(frameHeader) - 1);
+	StreamFile->Serialize(StreamBuffer.data(), (INT)StreamBuffer.size());
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+class UVulkanRenderDevice;
+
+// Copies finished frames back to the CPU as BGRA8 through a ring of persistent staging buffers.
+// ReadPixels waits for its copy right away. A capture stream only waits for the frame before the newest, and writes it to a raw or Y4M file.
+class FrameCapture
+{
+public:
+	FrameCapture(UVulkanRenderDevice* renderer);
+	~FrameCapture();
+
+	// Records the conversion and the copy into the next free staging buffer. The image must be in shader read only layout.
+	// Only the top left srcWidth x srcHeight pixels of it are used, scaled up to the size of the whole image.
+	int Record(VulkanImage* srcimage, int srcWidth, int srcHeight, bool stream);
+
+	// Waits for a recorded copy and copies its pixels out. The commands that recorded it must have been submitted.
+	void Read(int index, void* dest);
+
+	bool StartStream(const TCHAR* filename, int framerate);
+	void StopStream();
+	bool IsStreaming() const { return StreamFile != nullptr; }
+
+	// Writes the streamed frames that have finished on the GPU, then waits for the oldest ones until at most maxPending are left
+	void WriteStreamedFrames(int maxPending);
+
+	static const int RingSize = MAX_FRAMES_IN_FLIGHT + 1;
+
+private:
+	struct Readback
+	{
+		std::unique_ptr<VulkanBuffer> Buffer;
+		size_t BufferSize = 0;
+		int Width = 0;
+		int Height = 0;
+		uint64_t SubmitSerial = 0;
+		bool Pending = false;
+		bool Stream = false;
+	};
+
+	void Finish(Readback& readback);
+	void WriteFrame(const uint8_t* pixels, int width, int height);
+
+	UVulkanRenderDevice* renderer = nullptr;
+
+	// The scene is a float format. The blit into this image converts it to BGRA8 before it's copied into a staging buffer.
+	std::unique_ptr<VulkanImage> ConvertImage;
+
+	std::array<Readback, RingSize> Ring;
+	int NextReadback = 0;
+
+	FArchive* StreamFile = nullptr;
+	bool StreamY4M = false;
+	int StreamFramerate = 60;
+	int StreamWidth = 0;
+	int StreamHeight = 0;
+	int StreamFrames = 0;
+	std::vector<uint8_t> StreamBuffer;
+};
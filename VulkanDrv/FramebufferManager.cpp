@@ -9,31 +9,21 @@ FramebufferManager::FramebufferManager(UVulkanRenderDevice* renderer) : renderer
 
 void FramebufferManager::CreateSceneFramebuffer()
 {
-	SceneFramebuffer = FramebufferBuilder()
-		.RenderPass(renderer->RenderPasses->Scene.RenderPass.get())
-		.Size(renderer->Textures->Scene->Width, renderer->Textures->Scene->Height)
-		.AddAttachment(renderer->Textures->Scene->ColorBufferView.get())
-		.AddAttachment(renderer->Textures->Scene->HitBufferView.get())
-		.AddAttachment(renderer->Textures->Scene->DepthBufferView.get())
-		.DebugName("SceneFramebuffer")
-		.Create(renderer->Device.get());
+	if (renderer->RenderPasses->DynamicRendering)
+		return;
 
-	for (int level = 0; level < NumBloomLevels; level++)
-	{
-		BloomBlurLevels[level].VTextureFB = FramebufferBuilder()
-			.RenderPass(renderer->RenderPasses->Postprocess.RenderPass.get())
-			.Size(renderer->Textures->Scene->BloomBlurLevels[level].Width, renderer->Textures->Scene->BloomBlurLevels[level].Height)
-			.AddAttachment(renderer->Textures->Scene->BloomBlurLevels[level].VTextureView.get())
-			.DebugName("VTextureFB")
-			.Create(renderer->Device.get());
+	FramebufferBuilder builder;
+	builder.RenderPass(renderer->RenderPasses->Scene.RenderPass[0][0][0].get());
+	builder.Size(renderer->Textures->Scene->Width, renderer->Textures->Scene->Height);
+	builder.AddAttachment(renderer->Textures->Scene->ColorBufferView.get());
+	builder.AddAttachment(renderer->Textures->Scene->DepthBufferView.get());
+	if (renderer->Textures->Scene->SceneSamples != VK_SAMPLE_COUNT_1_BIT)
+		builder.AddAttachment(renderer->Textures->Scene->PPImageView[0].get());
+	builder.DebugName("SceneFramebufferNoHit");
+	SceneFramebuffer[0] = builder.Create(renderer->Device.get());
 
-		BloomBlurLevels[level].HTextureFB = FramebufferBuilder()
-			.RenderPass(renderer->RenderPasses->Postprocess.RenderPass.get())
-			.Size(renderer->Textures->Scene->BloomBlurLevels[level].Width, renderer->Textures->Scene->BloomBlurLevels[level].Height)
-			.AddAttachment(renderer->Textures->Scene->BloomBlurLevels[level].HTextureView.get())
-			.DebugName("HTextureFB")
-			.Create(renderer->Device.get());
-	}
+	if (renderer->Textures->Scene->HitBuffer)
+		CreateSceneHitFramebuffer();
 
 	for (int i = 0; i < 2; i++)
 	{
@@ -46,25 +36,45 @@ void FramebufferManager::CreateSceneFramebuffer()
 	}
 }
 
-void FramebufferManager::DestroySceneFramebuffer()
+void FramebufferManager::CreateSceneHitFramebuffer()
 {
-	SceneFramebuffer.reset();
-	for (int level = 0; level < NumBloomLevels; level++)
-	{
-		BloomBlurLevels[level].VTextureFB.reset();
-		BloomBlurLevels[level].HTextureFB.reset();
-	}
+	if (renderer->RenderPasses->DynamicRendering)
+		return;
+
+	FramebufferBuilder builder;
+	builder.RenderPass(renderer->RenderPasses->Scene.RenderPass[1][0][0].get());
+	builder.Size(renderer->Textures->Scene->Width, renderer->Textures->Scene->Height);
+	builder.AddAttachment(renderer->Textures->Scene->ColorBufferView.get());
+	builder.AddAttachment(renderer->Textures->Scene->HitBufferView.get());
+	builder.AddAttachment(renderer->Textures->Scene->DepthBufferView.get());
+	if (renderer->Textures->Scene->SceneSamples != VK_SAMPLE_COUNT_1_BIT)
+		builder.AddAttachment(renderer->Textures->Scene->PPImageView[0].get());
+	builder.DebugName("SceneFramebuffer");
+	SceneFramebuffer[1] = builder.Create(renderer->Device.get());
+}
 
+void FramebufferManager::DestroySceneFramebuffer()
+{
+	for (int i = 0; i < 2; i++)
+		SceneFramebuffer[i].reset();
 	for (int i = 0; i < 2; i++)
 		PPImageFB[i].reset();
 }
 
 void FramebufferManager::CreateSwapChainFramebuffers()
 {
-	renderer->RenderPasses->CreatePresentRenderPass();
-	renderer->RenderPasses->CreatePresentPipeline();
-
 	auto swapchain = renderer->Commands->SwapChain.get();
+
+	// The present pipelines use a dynamic viewport and scissor and only have to be rebuilt when the swap chain format changes
+	if (!renderer->RenderPasses->Present.Pipeline[0] || renderer->RenderPasses->Present.Format != swapchain->Format().format)
+	{
+		renderer->RenderPasses->CreatePresentRenderPass();
+		renderer->RenderPasses->CreatePresentPipeline();
+	}
+
+	if (renderer->RenderPasses->DynamicRendering)
+		return;
+
 	for (int i = 0; i < swapchain->ImageCount(); i++)
 	{
 		SwapChainFramebuffers.push_back(
@@ -10,6 +10,7 @@ public:
 	FramebufferManager(UVulkanRenderDevice* renderer);
 
 	void CreateSceneFramebuffer();
+	void CreateSceneHitFramebuffer();
 	void DestroySceneFramebuffer();
 
 	void CreateSwapChainFramebuffers();
@@ -17,15 +18,9 @@ public:
 
 	VulkanFramebuffer* GetSwapChainFramebuffer();
 
-	std::unique_ptr<VulkanFramebuffer> SceneFramebuffer;
+	std::unique_ptr<VulkanFramebuffer> SceneFramebuffer[2]; // [hit test]
 	std::unique_ptr<VulkanFramebuffer> PPImageFB[2];
 
-	struct
-	{
-		std::unique_ptr<VulkanFramebuffer> VTextureFB;
-		std::unique_ptr<VulkanFramebuffer> HTextureFB;
-	} BloomBlurLevels[NumBloomLevels];
-
 private:
 	UVulkanRenderDevice* renderer = nullptr;
 	std::vector<std::unique_ptr<VulkanFramebuffer>> SwapChainFramebuffers;
@@ -0,0 +1,118 @@
+
+#include "Precomp.h"
+#include "ImagePool.h"
+#include "UVulkanRenderDevice.h"
+
+ImagePool::ImagePool(UVulkanRenderDevice* renderer) : renderer(renderer)
+{
+}
+
+ImagePool::~ImagePool()
+{
+}
+
+std::unique_ptr<VulkanImage> ImagePool::Acquire(VkFormat format, int width, int height, int mipLevels)
+{
+	ImageKey key;
+	key.Format = format;
+	key.Width = width;
+	key.Height = height;
+	key.MipLevels = mipLevels;
+
+	auto it = FreeImages.find(key);
+	if (it != FreeImages.end() && !it->second.empty())
+	{
+		std::unique_ptr<VulkanImage> image = std::move(it->second.back());
+		it->second.pop_back();
+		FreeCount--;
+		renderer->Stats.ImagePoolHits++;
+		return image;
+	}
+
+	renderer->Stats.ImagePoolMisses++;
+
+	auto image = ImageBuilder()
+		.Format(format)
+		.Size(width, height, mipLevels)
+		.Usage(VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT)
+		.DebugName("CachedTexture.Image")
+		.Create(renderer->Device.get());
+
+	Formats[image.get()] = format;
+	return image;
+}
+
+void ImagePool::Release(std::unique_ptr<VulkanImage> image)
+{
+	if (!image)
+		return;
+
+	if (Formats.find(image.get()) != Formats.end())
+		Released[renderer->Commands->CurrentFrameIndex].push_back(std::move(image));
+	else
+		renderer->Commands->GetCurrentDeleteList()->images.push_back(std::move(image));
+}
+
+void ImagePool::BeginFrame(uint32_t frameIndex)
+{
+	for (auto& image : Released[frameIndex])
+	{
+		auto it = Formats.find(image.get());
+		if (FreeCount < MaxFreeImages)
+		{
+			ImageKey key;
+			key.Format = it->second;
+			key.Width = image->width;
+			key.Height = image->height;
+			key.MipLevels = image->mipLevels;
+			FreeImages[key].push_back(std::move(image));
+			FreeCount++;
+		}
+		else
+		{
+			Formats.erase(it);
+			image.reset();
+		}
+	}
+	Released[frameIndex].clear();
+}
+
+void ImagePool::ReleaseUnused()
+{
+	// Only valid when the device is idle, as images released this frame are destroyed too
+	auto forget = [&](std::vector<std::unique_ptr<VulkanImage>>& images)
+	{
+		for (auto& image : images)
+			Formats.erase(image.get());
+		images.clear();
+	};
+
+	for (auto& images : Released)
+		forget(images);
+	for (auto& it : FreeImages)
+		forget(it.second);
+	FreeImages.clear();
+	FreeCount = 0;
+}
+
+VkFormat ImagePool::GetFormat(VulkanImage* image) const
+{
+	auto it = Formats.find(image);
+	return it != Formats.end() ? it->second : VK_FORMAT_UNDEFINED;
+}
+
+void ImagePool::Clear()
+{
+	// Released images may still be in use by a frame on the GPU. They go on the delete list of the frame slot they were
+	// released in, which is only emptied after that slot's fence. Free images are no longer in use by anything.
+	for (uint32_t frameIndex = 0; frameIndex < MAX_FRAMES_IN_FLIGHT; frameIndex++)
+	{
+		auto& deleteList = renderer->Commands->FrameDeleteLists[frameIndex]->images;
+		for (auto& image : Released[frameIndex])
+			deleteList.push_back(std::move(image));
+		Released[frameIndex].clear();
+	}
+	FreeImages.clear();
+	Formats.clear();
+	FreeCount = 0;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+class UVulkanRenderDevice;
+
+// Recycles the images of released textures for new textures with the same format, size and mip count
+class ImagePool
+{
+public:
+	ImagePool(UVulkanRenderDevice* renderer);
+	~ImagePool();
+
+	std::unique_ptr<VulkanImage> Acquire(VkFormat format, int width, int height, int mipLevels);
+	void Release(std::unique_ptr<VulkanImage> image);
+
+	void BeginFrame(uint32_t frameIndex);
+	void ReleaseUnused();
+	void Clear();
+
+	VkFormat GetFormat(VulkanImage* image) const;
+
+	int GetFreeCount() const { return FreeCount; }
+
+	static const int MaxFreeImages = 256;
+
+private:
+	struct ImageKey
+	{
+		VkFormat Format;
+		int Width;
+		int Height;
+		int MipLevels;
+
+		bool operator<(const ImageKey& other) const
+		{
+			if (Format != other.Format)
+				return Format < other.Format;
+			else if (Width != other.Width)
+				return Width < other.Width;
+			else if (Height != other.Height)
+				return Height < other.Height;
+			else
+				return MipLevels < other.MipLevels;
+		}
+	};
+
+	UVulkanRenderDevice* renderer = nullptr;
+
+	// Formats of the images handed out by Acquire, as VulkanImage doesn't remember it
+	std::unordered_map<VulkanImage*, VkFormat> Formats;
+
+	// Released images stay here until the frame slot they were released in has finished on the GPU
+	std::array<std::vector<std::unique_ptr<VulkanImage>>, MAX_FRAMES_IN_FLIGHT> Released;
+
+	std::map<ImageKey, std::vector<std::unique_ptr<VulkanImage>>> FreeImages;
+	int FreeCount = 0;
+};
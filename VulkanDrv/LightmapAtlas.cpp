@@ -0,0 +1,220 @@
+
+#include "Precomp.h"
+#include "LightmapAtlas.h"
+#include "UVulkanRenderDevice.h"
+#include "CachedTexture.h"
+
+LightmapAtlas::LightmapAtlas(UVulkanRenderDevice* renderer) : renderer(renderer)
+{
+}
+
+LightmapAtlas::~LightmapAtlas()
+{
+}
+
+bool LightmapAtlas::CanInsert(const FTextureInfo& Info) const
+{
+	if (Info.NumMips < 1 || !Info.Mips[0] || !Info.Mips[0]->DataPtr)
+		return false;
+
+	// Only formats that end up as plain 8-bit RGBA can share a page
+	TextureUploader* uploader = TextureUploader::GetUploader(Info.Format);
+	if (!uploader || uploader->GetVkFormat() != VK_FORMAT_R8G8B8A8_UNORM || uploader->GetUploadSize(0, 0, 1, 1) != 4)
+		return false;
+
+	FMipmapBase* Mip = Info.Mips[0];
+	return Mip->USize > 0 && Mip->VSize > 0 && Mip->USize <= MaxEntrySize && Mip->VSize <= MaxEntrySize;
+}
+
+bool LightmapAtlas::Insert(CachedTexture* entry, const FTextureInfo& Info)
+{
+	int width = Info.Mips[0]->USize;
+	int height = Info.Mips[0]->VSize;
+	int paddedWidth = width + Padding * 2;
+	int paddedHeight = height + Padding * 2;
+
+	Page* page = nullptr;
+	int x = 0, y = 0;
+	for (auto& it : Pages)
+	{
+		if (Allocate(it.get(), paddedWidth, paddedHeight, x, y))
+		{
+			page = it.get();
+			break;
+		}
+	}
+
+	if (!page)
+	{
+		page = CreatePage();
+		if (!page)
+			page = FindEvictablePage();
+		if (!page)
+			return false;
+
+		Evict(page);
+		if (!Allocate(page, paddedWidth, paddedHeight, x, y))
+			return false;
+	}
+
+	entry->AtlasPage = page->Texture.get();
+	entry->AtlasX = x + Padding;
+	entry->AtlasY = y + Padding;
+	entry->AtlasWidth = width;
+	entry->AtlasHeight = height;
+	entry->AtlasScale[0] = width / (float)PageSize;
+	entry->AtlasScale[1] = height / (float)PageSize;
+	entry->AtlasOffset[0] = entry->AtlasX / (float)PageSize;
+	entry->AtlasOffset[1] = entry->AtlasY / (float)PageSize;
+	page->Entries.push_back(entry);
+	page->LastUsedFrame = FrameCounter;
+
+	renderer->Uploads->UploadAtlasRect(entry->AtlasPage, Info, entry->AtlasX, entry->AtlasY, Padding);
+	return true;
+}
+
+void LightmapAtlas::Update(CachedTexture* entry, const FTextureInfo& Info)
+{
+	if (Info.Mips[0]->USize != entry->AtlasWidth || Info.Mips[0]->VSize != entry->AtlasHeight)
+	{
+		Remove(entry);
+		if (!Insert(entry, Info)) // Revalidation unloads the data again right after the update
+			renderer->Uploads->UploadTexture(entry, Info, false, false);
+		return;
+	}
+
+	renderer->Uploads->UploadAtlasRect(entry->AtlasPage, Info, entry->AtlasX, entry->AtlasY, Padding);
+}
+
+void LightmapAtlas::Remove(CachedTexture* entry)
+{
+	// The space is reclaimed when the page gets evicted
+	for (auto& page : Pages)
+	{
+		if (page->Texture.get() == entry->AtlasPage)
+		{
+			page->Entries.erase(std::remove(page->Entries.begin(), page->Entries.end(), entry), page->Entries.end());
+			break;
+		}
+	}
+	entry->AtlasPage = nullptr;
+}
+
+void LightmapAtlas::MarkUsed(CachedTexture* entry)
+{
+	for (auto& page : Pages)
+	{
+		if (page->Texture.get() == entry->AtlasPage)
+		{
+			page->LastUsedFrame = FrameCounter;
+			break;
+		}
+	}
+}
+
+void LightmapAtlas::Clear()
+{
+	Pages.clear();
+}
+
+void LightmapAtlas::ClearAllBindlessIndexes()
+{
+	for (auto& page : Pages)
+	{
+		page->Texture->BindlessIndex = -1;
+	}
+}
+
+bool LightmapAtlas::Allocate(Page* page, int width, int height, int& x, int& y)
+{
+	// Best fit among the existing shelves, but don't waste tall shelves on short entries unless the page is otherwise full
+	Shelf* best = nullptr;
+	Shelf* fallback = nullptr;
+	for (Shelf& shelf : page->Shelves)
+	{
+		if (shelf.Height < height || shelf.NextX + width > PageSize)
+			continue;
+
+		if (shelf.Height <= height * 2)
+		{
+			if (!best || shelf.Height < best->Height)
+				best = &shelf;
+		}
+		else if (!fallback || shelf.Height < fallback->Height)
+		{
+			fallback = &shelf;
+		}
+	}
+
+	if (!best)
+	{
+		int shelfHeight = std::min((height + 7) / 8 * 8, PageSize - page->NextShelfY);
+		if (shelfHeight >= height && width <= PageSize)
+		{
+			Shelf shelf;
+			shelf.Y = page->NextShelfY;
+			shelf.Height = shelfHeight;
+			page->Shelves.push_back(shelf);
+			page->NextShelfY += shelfHeight;
+			best = &page->Shelves.back();
+		}
+		else
+		{
+			best = fallback;
+		}
+	}
+
+	if (!best)
+		return false;
+
+	x = best->NextX;
+	y = best->Y;
+	best->NextX += width;
+	return true;
+}
+
+LightmapAtlas::Page* LightmapAtlas::CreatePage()
+{
+	if ((int)Pages.size() == MaxPages)
+		return nullptr;
+
+	auto page = std::make_unique<Page>();
+	page->Texture.reset(new CachedTexture());
+
+	page->Texture->image = ImageBuilder()
+		.Format(VK_FORMAT_R8G8B8A8_UNORM)
+		.Size(PageSize, PageSize)
+		.Usage(VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT)
+		.DebugName("LightmapAtlas.Page")
+		.Create(renderer->Device.get());
+
+	page->Texture->imageView = ImageViewBuilder()
+		.Type(VK_IMAGE_VIEW_TYPE_2D_ARRAY)
+		.Image(page->Texture->image.get(), VK_FORMAT_R8G8B8A8_UNORM)
+		.DebugName("LightmapAtlas.PageView")
+		.Create(renderer->Device.get());
+
+	Pages.push_back(std::move(page));
+	return Pages.back().get();
+}
+
+LightmapAtlas::Page* LightmapAtlas::FindEvictablePage()
+{
+	// Pages used this frame may still be referenced by draws that haven't been submitted yet
+	Page* oldest = nullptr;
+	for (auto& page : Pages)
+	{
+		if (page->LastUsedFrame < FrameCounter && (!oldest || page->LastUsedFrame < oldest->LastUsedFrame))
+			oldest = page.get();
+	}
+	return oldest;
+}
+
+void LightmapAtlas::Evict(Page* page)
+{
+	for (CachedTexture* entry : page->Entries)
+		entry->AtlasPage = nullptr;
+	page->Entries.clear();
+	page->Shelves.clear();
+	page->NextShelfY = 0;
+}
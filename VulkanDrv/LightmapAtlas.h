@@ -0,0 +1,57 @@
+#pragma once
+
+class UVulkanRenderDevice;
+class CachedTexture;
+struct FTextureInfo;
+
+// Packs the small per-surface lightmaps and fogmaps into a few large pages
+class LightmapAtlas
+{
+public:
+	LightmapAtlas(UVulkanRenderDevice* renderer);
+	~LightmapAtlas();
+
+	bool CanInsert(const FTextureInfo& Info) const;
+	bool Insert(CachedTexture* entry, const FTextureInfo& Info);
+	void Update(CachedTexture* entry, const FTextureInfo& Info);
+	void Remove(CachedTexture* entry);
+
+	void MarkUsed(CachedTexture* entry);
+	void NextFrame() { FrameCounter++; }
+
+	void Clear();
+	void ClearAllBindlessIndexes();
+
+	int GetPageCount() const { return (int)Pages.size(); }
+
+	static const int PageSize = 1024;
+	static const int MaxPages = 16;
+	static const int MaxEntrySize = 256;
+	static const int Padding = 2;
+
+private:
+	struct Shelf
+	{
+		int Y = 0;
+		int Height = 0;
+		int NextX = 0;
+	};
+
+	struct Page
+	{
+		std::unique_ptr<CachedTexture> Texture;
+		std::vector<Shelf> Shelves;
+		std::vector<CachedTexture*> Entries;
+		int NextShelfY = 0;
+		int LastUsedFrame = 0;
+	};
+
+	bool Allocate(Page* page, int width, int height, int& x, int& y);
+	Page* CreatePage();
+	Page* FindEvictablePage();
+	void Evict(Page* page);
+
+	UVulkanRenderDevice* renderer = nullptr;
+	std::vector<std::unique_ptr<Page>> Pages;
+	int FrameCounter = 1;
+};
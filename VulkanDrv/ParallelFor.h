@@ -0,0 +1,58 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <exception>
+#include <vector>
+#include <algorithm>
+
+// Runs callback(0) to callback(count - 1) spread across the CPU cores and waits for all of them to finish.
+// The first exception thrown by a callback is rethrown on the calling thread.
+inline void ParallelFor(int count, const std::function<void(int)>& callback)
+{
+	int threadCount = std::min((int)std::thread::hardware_concurrency(), count);
+	if (threadCount <= 1)
+	{
+		for (int i = 0; i < count; i++)
+			callback(i);
+		return;
+	}
+
+	std::atomic<int> nextIndex(0);
+	std::mutex errorMutex;
+	std::exception_ptr error;
+
+	auto worker = [&]()
+	{
+		while (true)
+		{
+			int i = nextIndex++;
+			if (i >= count)
+				break;
+
+			try
+			{
+				callback(i);
+			}
+			catch (...)
+			{
+				std::unique_lock<std::mutex> lock(errorMutex);
+				if (!error)
+					error = std::current_exception();
+			}
+		}
+	};
+
+	// The calling thread does its share of the work too
+	std::vector<std::thread> threads;
+	for (int i = 1; i < threadCount; i++)
+		threads.push_back(std::thread(worker));
+	worker();
+	for (auto& thread : threads)
+		thread.join();
+
+	if (error)
+		std::rethrow_exception(error);
+}
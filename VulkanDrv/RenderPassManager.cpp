@@ -2,19 +2,122 @@
 #include "Precomp.h"
 #include "RenderPassManager.h"
 #include "UVulkanRenderDevice.h"
+#include "ParallelFor.h"
+#include "CacheHash.h"
+
+static const TCHAR* PipelineCacheFilename = TEXT("VulkanDrvPipelineCache.bin");
+
+// Scene.frag flags: 1 = lightmap, 2 = macro texture, 4 = detail texture, 8 = fog map, 16 = fog color
+const uint32_t RenderPassManager::SceneVariantFeatures[SceneVariantCount] =
+{
+	0,      // Tiles and unfogged gouraud polygons
+	16,     // Fogged gouraud polygons
+	1,      // Lightmapped surfaces
+	1 | 8,  // Lightmapped surfaces in fog zones
+	1 | 4,  // Lightmapped surfaces with detail textures
+	31      // Everything else
+};
 
 RenderPassManager::RenderPassManager(UVulkanRenderDevice* renderer) : renderer(renderer)
 {
+	DynamicRendering = renderer->VkDynamicRendering && renderer->Device->EnabledFeatures.DynamicRendering.dynamicRendering;
+	if (DynamicRendering)
+		debugf(TEXT("Vulkan: using dynamic rendering"));
+
+	UseFusedPresent = renderer->VkFusedPresent;
+
+	CreatePipelineCache();
 	CreateSceneBindlessPipelineLayout();
 	CreatePostprocessRenderPass();
 	CreatePresentPipelineLayout();
 	CreateScreenshotPipeline();
 	CreateBloomPipelineLayout();
 	CreateBloomPipeline();
+	if (UseFusedPresent)
+		CreateFusedPresentPipelineLayout();
+	CreateHitReducePipelineLayout();
+	CreateHitReducePipeline();
 }
 
 RenderPassManager::~RenderPassManager()
 {
+	{
+		std::unique_lock<std::mutex> lock(VariantWorker.Mutex);
+		VariantWorker.Stop = true;
+	}
+	VariantWorker.Condition.notify_all();
+	if (VariantWorker.Thread.joinable())
+		VariantWorker.Thread.join();
+
+	SavePipelineCache();
+}
+
+void RenderPassManager::CreatePipelineCache()
+{
+	PipelineCacheBuilder builder;
+
+	TArray<BYTE> file;
+	if (appLoadFileToArray(file, PipelineCacheFilename) && file.Num() > (INT)sizeof(PipelineCacheFileHeader))
+	{
+		PipelineCacheFileHeader header;
+		memcpy(&header, &file(0), sizeof(PipelineCacheFileHeader));
+		const uint8_t* data = &file(sizeof(PipelineCacheFileHeader));
+		size_t dataSize = file.Num() - sizeof(PipelineCacheFileHeader);
+		if (IsPipelineCacheHeaderValid(header) && header.DataSize == dataSize && header.DataHash == HashCacheData(data, dataSize))
+		{
+			builder.InitialData(data, dataSize);
+			debugf(TEXT("Vulkan pipeline cache loaded (%d KB)"), (int)(dataSize / 1024));
+		}
+		else
+		{
+			debugf(TEXT("Vulkan pipeline cache is from another device or driver version and will be rebuilt"));
+		}
+	}
+
+	PipelineCache = builder.DebugName("PipelineCache").Create(renderer->Device.get());
+}
+
+void RenderPassManager::SavePipelineCache()
+{
+	if (!PipelineCache)
+		return;
+
+	std::vector<uint8_t> data = PipelineCache->GetCacheData();
+	if (data.empty())
+		return;
+
+	PipelineCacheFileHeader header;
+	InitPipelineCacheHeader(header);
+	header.DataSize = (uint32_t)data.size();
+	header.DataHash = HashCacheData(data.data(), data.size());
+
+	TArray<BYTE> file;
+	file.Add(sizeof(PipelineCacheFileHeader) + data.size());
+	memcpy(&file(0), &header, sizeof(PipelineCacheFileHeader));
+	memcpy(&file(sizeof(PipelineCacheFileHeader)), data.data(), data.size());
+	appSaveArrayToFile(file, PipelineCacheFilename);
+}
+
+void RenderPassManager::InitPipelineCacheHeader(PipelineCacheFileHeader& header)
+{
+	const auto& props = renderer->Device->PhysicalDevice.Properties.Properties;
+	header = {};
+	header.Magic = 0x43505256; // VRPC
+	header.VendorID = props.vendorID;
+	header.DeviceID = props.deviceID;
+	header.DriverVersion = props.driverVersion;
+	memcpy(header.CacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE);
+}
+
+bool RenderPassManager::IsPipelineCacheHeaderValid(const PipelineCacheFileHeader& header)
+{
+	PipelineCacheFileHeader expected;
+	InitPipelineCacheHeader(expected);
+	return header.Magic == expected.Magic &&
+		header.VendorID == expected.VendorID &&
+		header.DeviceID == expected.DeviceID &&
+		header.DriverVersion == expected.DriverVersion &&
+		memcmp(header.CacheUUID, expected.CacheUUID, VK_UUID_SIZE) == 0;
 }
 
 void RenderPassManager::CreateSceneBindlessPipelineLayout()
@@ -37,14 +140,38 @@ void RenderPassManager::CreatePresentPipelineLayout()
 
 void RenderPassManager::CreateBloomPipelineLayout()
 {
-	Bloom.PipelineLayout = PipelineLayoutBuilder()
-		.AddSetLayout(renderer->DescriptorSets->GetBloomLayout())
-		.AddPushConstantRange(VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(BloomPushConstants))
-		.DebugName("BloomPipelineLayout")
+	Bloom.DownsampleLayout = PipelineLayoutBuilder()
+		.AddSetLayout(renderer->DescriptorSets->GetBloomDownsampleLayout())
+		.AddPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BloomDownsamplePushConstants))
+		.DebugName("BloomDownsampleLayout")
+		.Create(renderer->Device.get());
+
+	Bloom.UpsampleLayout = PipelineLayoutBuilder()
+		.AddSetLayout(renderer->DescriptorSets->GetBloomUpsampleLayout())
+		.AddPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BloomPushConstants))
+		.DebugName("BloomUpsampleLayout")
+		.Create(renderer->Device.get());
+}
+
+void RenderPassManager::CreateFusedPresentPipelineLayout()
+{
+	FusedPresent.PipelineLayout = PipelineLayoutBuilder()
+		.AddSetLayout(renderer->DescriptorSets->GetFusedPresentLayout())
+		.AddPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FusedPresentPushConstants))
+		.DebugName("FusedPresentPipelineLayout")
+		.Create(renderer->Device.get());
+}
+
+void RenderPassManager::CreateHitReducePipelineLayout()
+{
+	HitReduce.PipelineLayout = PipelineLayoutBuilder()
+		.AddSetLayout(renderer->DescriptorSets->GetHitReduceLayout())
+		.AddPushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HitReducePushConstants))
+		.DebugName("HitReducePipelineLayout")
 		.Create(renderer->Device.get());
 }
 
-PipelineState* RenderPassManager::GetPipeline(DWORD PolyFlags)
+PipelineState* RenderPassManager::GetPipeline(DWORD PolyFlags, uint32_t features, PipelineState* current)
 {
 	int index;
 	if (PolyFlags & PF_Translucent)
@@ -77,245 +204,580 @@ PipelineState* RenderPassManager::GetPipeline(DWORD PolyFlags)
 		index |= 16;
 	}
 
-	return &Scene.Pipeline[index];
+	features &= SceneVariantFeatures[SceneVariantCount - 1];
+
+	// Staying on a variant that handles more flags than needed is cheaper than breaking the batch
+	if (current && current->Index == index && (features & ~current->Features) == 0)
+		return current;
+
+	int variant = 0;
+	while ((features & ~SceneVariantFeatures[variant]) != 0)
+		variant++;
+	return GetScenePipeline(index, variant);
 }
 
 PipelineState* RenderPassManager::GetEndFlashPipeline()
 {
-	return &Scene.Pipeline[2];
+	return GetScenePipeline(2, 0);
 }
 
-void RenderPassManager::CreatePipelines()
+PipelineState* RenderPassManager::GetScenePipeline(int index, int variant)
 {
-	VulkanShader* vertShader = renderer->Shaders->Scene.VertexShader.get();
-	VulkanShader* fragShader = renderer->Shaders->Scene.FragmentShader.get();
-	VulkanShader* fragShaderAlphaTest = renderer->Shaders->Scene.FragmentShaderAlphaTest.get();
-	VulkanPipelineLayout* layout = Scene.BindlessPipelineLayout.get();
-	static const char* debugName = "ScenePipeline";
+	// A level only ever uses a handful of the blend state and variant combinations. Creating one here would stall the frame.
+	if (variant != SceneVariantAll && SceneVariantStatus[Scene.HitTest][index][variant].load(std::memory_order_acquire) != VariantReady)
+	{
+		QueueSceneVariant(Scene.HitTest, index, variant);
+		variant = SceneVariantAll;
+	}
+	return &Scene.Pipeline[Scene.HitTest][index][variant];
+}
 
-	for (int i = 0; i < 32; i++)
-	{
-		GraphicsPipelineBuilder builder;
-		builder.AddVertexShader(vertShader);
-		builder.Viewport(0.0f, 0.0f, (float)renderer->Textures->Scene->Width, (float)renderer->Textures->Scene->Height);
-		builder.Scissor(0, 0, renderer->Textures->Scene->Width, renderer->Textures->Scene->Height);
-		builder.Topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-		builder.Cull(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
-		builder.AddVertexBufferBinding(0, sizeof(SceneVertex));
-		builder.AddVertexAttribute(0, 0, VK_FORMAT_R32_UINT, offsetof(SceneVertex, Flags));
-		builder.AddVertexAttribute(1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(SceneVertex, Position));
-		builder.AddVertexAttribute(2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord));
-		builder.AddVertexAttribute(3, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord2));
-		builder.AddVertexAttribute(4, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord3));
-		builder.AddVertexAttribute(5, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord4));
-		builder.AddVertexAttribute(6, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(SceneVertex, Color));
-		builder.AddVertexAttribute(7, 0, VK_FORMAT_R32G32B32A32_SINT, offsetof(SceneVertex, TextureBinds));
-		builder.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT);
-		builder.Layout(layout);
-		builder.RenderPass(Scene.RenderPass.get());
-
-		// Avoid clipping the weapon. The UE1 engine clips the geometry anyway.
-		if (renderer->Device.get()->EnabledFeatures.Features.depthClamp)
-			builder.DepthClampEnable(true);
-
-		ColorBlendAttachmentBuilder colorblend;
-		switch (i & 3)
-		{
-		case 0: // PF_Translucent
-			colorblend.BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR);
-			builder.DepthBias(true, -1.0f, 0.0f, -1.0f);
-			break;
-		case 1: // PF_Modulated
-			colorblend.BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_DST_COLOR, VK_BLEND_FACTOR_SRC_COLOR);
-			builder.DepthBias(true, -1.0f, 0.0f, -1.0f);
-			break;
-		case 2: // PF_Highlighted
-			colorblend.BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA);
-			builder.DepthBias(true, -1.0f, 0.0f, -1.0f);
-			break;
-		case 3:
-			colorblend.BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ZERO); // Hmm, is it faster to keep the blend mode enabled or to toggle it?
+void RenderPassManager::QueueSceneVariant(int hitTest, int index, int variant)
+{
+	std::atomic<int>& status = SceneVariantStatus[hitTest][index][variant];
+	if (status.load(std::memory_order_relaxed) != VariantMissing)
+		return;
+	status.store(VariantQueued, std::memory_order_relaxed);
+
+	std::unique_lock<std::mutex> lock(VariantWorker.Mutex);
+	if (!VariantWorker.Thread.joinable())
+		VariantWorker.Thread = std::thread([this]() { SceneVariantWorkerMain(); });
+	VariantWorker.Queue.push_back({ hitTest, index, variant });
+	VariantWorker.Condition.notify_all();
+}
+
+void RenderPassManager::SceneVariantWorkerMain()
+{
+	std::unique_lock<std::mutex> lock(VariantWorker.Mutex);
+	while (true)
+	{
+		VariantWorker.Condition.wait(lock, [&]() { return VariantWorker.Stop || !VariantWorker.Queue.empty(); });
+		if (VariantWorker.Stop)
 			break;
-		}
 
-		if (i & 4) // PF_Invisible
+		SceneVariantKey key = VariantWorker.Queue.front();
+		VariantWorker.Queue.erase(VariantWorker.Queue.begin());
+		VariantWorker.Busy = true;
+		lock.unlock();
+
+		try
 		{
-			colorblend.ColorWriteMask(0);
+			CreateScenePipeline(key.HitTest, key.Index, key.Variant);
+			SceneVariantStatus[key.HitTest][key.Index][key.Variant].store(VariantReady, std::memory_order_release);
 		}
-
-		if (i & 8) // PF_Occlude
+		catch (...)
 		{
-			builder.DepthStencilEnable(true, true, false);
+			// Stays queued, so the draws keep using the SceneVariantAll pipeline
 		}
-		else
+
+		lock.lock();
+		VariantWorker.Busy = false;
+		VariantWorker.Condition.notify_all();
+	}
+}
+
+void RenderPassManager::CancelSceneVariants()
+{
+	// The worker uses the render pass and the sample count, so it must be done before either changes
+	std::unique_lock<std::mutex> lock(VariantWorker.Mutex);
+	VariantWorker.Queue.clear();
+	VariantWorker.Condition.wait(lock, [&]() { return !VariantWorker.Busy; });
+
+	for (auto& sets : SceneVariantStatus)
+		for (auto& variants : sets)
+			for (auto& status : variants)
+				status.store(VariantMissing, std::memory_order_relaxed);
+}
+
+void RenderPassManager::CreatePipelines()
+{
+	double startTime = appSeconds();
+
+	// Only the editor hit tests all the time. Elsewhere the hit test set is left until a frame first asks for it.
+	// Variants created on demand for the old render pass and sample count have to go as well.
+	const int setCount = GIsEditor ? 2 : 1;
+	CancelSceneVariants();
+	for (int hitTest = 0; hitTest < 2; hitTest++)
+	{
+		for (auto& pipelines : Scene.Pipeline[hitTest])
+			for (auto& state : pipelines)
+				state.Pipeline.reset();
+		for (int i = 0; i < 2; i++)
 		{
-			builder.DepthStencilEnable(true, false, false);
+			Scene.LinePipeline[hitTest][i].Pipeline.reset();
+			Scene.PointPipeline[hitTest][i].Pipeline.reset();
 		}
+	}
 
-		if (i & 16) // PF_Masked
-			builder.AddFragmentShader(fragShaderAlphaTest);
+	// Pipelines are independent of each other and vkCreateGraphicsPipelines may be called from several threads at once
+	// The fused present pipelines read the single sampled scene image and only have to be created once
+	const int sceneCount = ScenePassPipelineCount * setCount;
+	const int fusedPresentCount = (UseFusedPresent && !FusedPresent.Pipeline[0][0]) ? 16 * 2 : 0;
+	ParallelFor(sceneCount + fusedPresentCount, [&](int i)
+	{
+		if (i < sceneCount)
+			CreateScenePassPipeline(i / ScenePassPipelineCount, i % ScenePassPipelineCount);
 		else
-			builder.AddFragmentShader(fragShader);
+			CreateFusedPresentPipeline(i - sceneCount);
+	});
 
-		builder.AddColorBlendAttachment(colorblend.Create());
-		builder.AddColorBlendAttachment(ColorBlendAttachmentBuilder().Create());
+	debugf(TEXT("Vulkan scene pipelines created in %.1f ms (%d pipelines)"), (appSeconds() - startTime) * 1000.0, sceneCount + fusedPresentCount);
+
+	// Don't rely on the destructor alone. It never runs if the game crashes or is killed.
+	SavePipelineCache();
+}
 
-		builder.RasterizationSamples(renderer->Textures->Scene->SceneSamples);
-		builder.DebugName(debugName);
+void RenderPassManager::CreateHitTestPipelines()
+{
+	ParallelFor(ScenePassPipelineCount, [&](int i)
+	{
+		CreateScenePassPipeline(1, i);
+	});
+}
+
+void RenderPassManager::CreateScenePassPipeline(int hitTest, int i)
+{
+	const int sceneCount = 32;
+	if (i < sceneCount)
+		CreateScenePipeline(hitTest, i, SceneVariantAll);
+	else if (i < sceneCount + 2)
+		CreateLinePipeline(hitTest, i - sceneCount);
+	else
+		CreatePointPipeline(hitTest, i - sceneCount - 2);
+}
+
+void RenderPassManager::CreateFusedPresentPipeline(int i)
+{
+	int presentShader = i / 2;
+	bool bloom = (i % 2) == 1;
+	auto shaders = renderer->Shaders.get();
+	VulkanShader* shader = shaders->FusedPresent.Shader[presentShader].get();
+
+	FusedPresent.Pipeline[presentShader][bloom] = ComputePipelineBuilder()
+		.Cache(PipelineCache.get())
+		.ComputeShader(shader)
+		.AddSpecializationConstant(0, bloom ? 1 : 0)
+		.Layout(FusedPresent.PipelineLayout.get())
+		.DebugName("FusedPresentPipeline")
+		.Create(renderer->Device.get());
+}
+
+void RenderPassManager::CreateScenePipeline(int hitTest, int i, int variant)
+{
+	VulkanShader* vertShader = renderer->Shaders->Scene.VertexShader.get();
+	VulkanShader* fragShader = hitTest ? renderer->Shaders->Scene.FragmentShader.get() : renderer->Shaders->Scene.FragmentShaderNoHit.get();
+	VulkanShader* fragShaderAlphaTest = hitTest ? renderer->Shaders->Scene.FragmentShaderAlphaTest.get() : renderer->Shaders->Scene.FragmentShaderAlphaTestNoHit.get();
+	VulkanPipelineLayout* layout = Scene.BindlessPipelineLayout.get();
+	static const char* debugName = "ScenePipeline";
 
-		Scene.Pipeline[i].Pipeline = builder.Create(renderer->Device.get());
+	GraphicsPipelineBuilder builder;
+	builder.AddVertexShader(vertShader);
+	builder.Topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	builder.Cull(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+	builder.AddVertexBufferBinding(0, sizeof(SceneVertex));
+	builder.AddVertexAttribute(0, 0, VK_FORMAT_R32_UINT, offsetof(SceneVertex, Flags));
+	builder.AddVertexAttribute(1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(SceneVertex, Position));
+	builder.AddVertexAttribute(2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord));
+	builder.AddVertexAttribute(3, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord2));
+	builder.AddVertexAttribute(4, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord3));
+	builder.AddVertexAttribute(5, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord4));
+	builder.AddVertexAttribute(6, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(SceneVertex, Color));
+	builder.AddVertexAttribute(7, 0, VK_FORMAT_R32G32B32A32_SINT, offsetof(SceneVertex, TextureBinds));
+	builder.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT);
+	builder.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR);
+	builder.Layout(layout);
+	builder.RenderPass(Scene.RenderPass[hitTest][0][0].get());
+	builder.AddColorAttachmentFormat(renderer->Textures->SceneColorFormat);
+	if (hitTest)
+		builder.AddColorAttachmentFormat(VK_FORMAT_R32_UINT);
+	builder.DepthAttachmentFormat(VK_FORMAT_D32_SFLOAT);
+	builder.Cache(PipelineCache.get());
+
+	// Avoid clipping the weapon. The UE1 engine clips the geometry anyway.
+	if (renderer->Device.get()->EnabledFeatures.Features.depthClamp)
+		builder.DepthClampEnable(true);
+
+	ColorBlendAttachmentBuilder colorblend;
+	switch (i & 3)
+	{
+	case 0: // PF_Translucent
+		colorblend.BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR);
+		builder.DepthBias(true, -1.0f, 0.0f, -1.0f);
+		break;
+	case 1: // PF_Modulated
+		colorblend.BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_DST_COLOR, VK_BLEND_FACTOR_SRC_COLOR);
+		builder.DepthBias(true, -1.0f, 0.0f, -1.0f);
+		break;
+	case 2: // PF_Highlighted
+		colorblend.BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA);
+		builder.DepthBias(true, -1.0f, 0.0f, -1.0f);
+		break;
+	case 3:
+		colorblend.BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ZERO); // Hmm, is it faster to keep the blend mode enabled or to toggle it?
+		break;
 	}
 
-	// Line pipeline
-	for (int i = 0; i < 2; i++)
-	{
-		GraphicsPipelineBuilder builder;
-		builder.AddVertexShader(vertShader);
-		builder.Viewport(0.0f, 0.0f, (float)renderer->Textures->Scene->Width, (float)renderer->Textures->Scene->Height);
-		builder.Scissor(0, 0, renderer->Textures->Scene->Width, renderer->Textures->Scene->Height);
-		builder.Topology(VK_PRIMITIVE_TOPOLOGY_LINE_LIST);
-		builder.Cull(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
-		builder.AddVertexBufferBinding(0, sizeof(SceneVertex));
-		builder.AddVertexAttribute(0, 0, VK_FORMAT_R32_UINT, offsetof(SceneVertex, Flags));
-		builder.AddVertexAttribute(1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(SceneVertex, Position));
-		builder.AddVertexAttribute(2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord));
-		builder.AddVertexAttribute(3, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord2));
-		builder.AddVertexAttribute(4, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord3));
-		builder.AddVertexAttribute(5, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord4));
-		builder.AddVertexAttribute(6, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(SceneVertex, Color));
-		builder.AddVertexAttribute(7, 0, VK_FORMAT_R32G32B32A32_SINT, offsetof(SceneVertex, TextureBinds));
-		builder.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT);
-		builder.Layout(layout);
-		builder.RenderPass(Scene.RenderPass.get());
-
-		builder.AddColorBlendAttachment(ColorBlendAttachmentBuilder().BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA).Create());
-		builder.AddColorBlendAttachment(ColorBlendAttachmentBuilder().Create());
+	if (i & 4) // PF_Invisible
+	{
+		colorblend.ColorWriteMask(0);
+	}
 
+	if (i & 8) // PF_Occlude
+	{
 		builder.DepthStencilEnable(true, true, false);
+	}
+	else
+	{
+		builder.DepthStencilEnable(true, false, false);
+	}
+
+	if (i & 16) // PF_Masked
+		builder.AddFragmentShader(fragShaderAlphaTest);
+	else
 		builder.AddFragmentShader(fragShader);
+	builder.AddSpecializationConstant(VK_SHADER_STAGE_FRAGMENT_BIT, 0, SceneVariantFeatures[variant]);
 
-		builder.RasterizationSamples(renderer->Textures->Scene->SceneSamples);
-		builder.DebugName(debugName);
+	builder.AddColorBlendAttachment(colorblend.Create());
+	if (hitTest)
+		builder.AddColorBlendAttachment(ColorBlendAttachmentBuilder().Create());
 
-		Scene.LinePipeline[i].Pipeline = builder.Create(renderer->Device.get());
+	// Not taken from the scene textures, as they can be recreated while the variant worker runs
+	builder.RasterizationSamples(Scene.Samples);
+	builder.DebugName(debugName);
 
-		if (i == 0)
-		{
-			Scene.LinePipeline[i].MinDepth = 0.0f;
-			Scene.LinePipeline[i].MaxDepth = 0.1f;
-		}
-	}
+	PipelineState& state = Scene.Pipeline[hitTest][i][variant];
+	state.Index = i;
+	state.Features = SceneVariantFeatures[variant];
+	state.Pipeline = builder.Create(renderer->Device.get());
+}
 
-	// Point pipeline
-	for (int i = 0; i < 2; i++)
+void RenderPassManager::CreateLinePipeline(int hitTest, int i)
+{
+	VulkanShader* vertShader = renderer->Shaders->Scene.VertexShader.get();
+	VulkanShader* fragShader = hitTest ? renderer->Shaders->Scene.FragmentShader.get() : renderer->Shaders->Scene.FragmentShaderNoHit.get();
+	VulkanPipelineLayout* layout = Scene.BindlessPipelineLayout.get();
+	static const char* debugName = "ScenePipeline";
+
+	GraphicsPipelineBuilder builder;
+	builder.AddVertexShader(vertShader);
+	builder.Topology(VK_PRIMITIVE_TOPOLOGY_LINE_LIST);
+	builder.Cull(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+	builder.AddVertexBufferBinding(0, sizeof(SceneVertex));
+	builder.AddVertexAttribute(0, 0, VK_FORMAT_R32_UINT, offsetof(SceneVertex, Flags));
+	builder.AddVertexAttribute(1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(SceneVertex, Position));
+	builder.AddVertexAttribute(2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord));
+	builder.AddVertexAttribute(3, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord2));
+	builder.AddVertexAttribute(4, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord3));
+	builder.AddVertexAttribute(5, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord4));
+	builder.AddVertexAttribute(6, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(SceneVertex, Color));
+	builder.AddVertexAttribute(7, 0, VK_FORMAT_R32G32B32A32_SINT, offsetof(SceneVertex, TextureBinds));
+	builder.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT);
+	builder.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR);
+	builder.Layout(layout);
+	builder.RenderPass(Scene.RenderPass[hitTest][0][0].get());
+	builder.AddColorAttachmentFormat(renderer->Textures->SceneColorFormat);
+	if (hitTest)
+		builder.AddColorAttachmentFormat(VK_FORMAT_R32_UINT);
+	builder.DepthAttachmentFormat(VK_FORMAT_D32_SFLOAT);
+	builder.Cache(PipelineCache.get());
+
+	builder.AddColorBlendAttachment(ColorBlendAttachmentBuilder().BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA).Create());
+	if (hitTest)
+		builder.AddColorBlendAttachment(ColorBlendAttachmentBuilder().Create());
+
+	builder.DepthStencilEnable(true, true, false);
+	builder.AddFragmentShader(fragShader);
+
+	builder.RasterizationSamples(renderer->Textures->Scene->SceneSamples);
+	builder.DebugName(debugName);
+
+	Scene.LinePipeline[hitTest][i].Pipeline = builder.Create(renderer->Device.get());
+
+	if (i == 0)
 	{
-		GraphicsPipelineBuilder builder;
-		builder.AddVertexShader(vertShader);
-		builder.AddFragmentShader(fragShader);
-		builder.Viewport(0.0f, 0.0f, (float)renderer->Textures->Scene->Width, (float)renderer->Textures->Scene->Height);
-		builder.Scissor(0, 0, renderer->Textures->Scene->Width, renderer->Textures->Scene->Height);
-		builder.Topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
-		builder.Cull(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
-		builder.AddVertexBufferBinding(0, sizeof(SceneVertex));
-		builder.AddVertexAttribute(0, 0, VK_FORMAT_R32_UINT, offsetof(SceneVertex, Flags));
-		builder.AddVertexAttribute(1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(SceneVertex, Position));
-		builder.AddVertexAttribute(2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord));
-		builder.AddVertexAttribute(3, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord2));
-		builder.AddVertexAttribute(4, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord3));
-		builder.AddVertexAttribute(5, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord4));
-		builder.AddVertexAttribute(6, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(SceneVertex, Color));
-		builder.AddVertexAttribute(7, 0, VK_FORMAT_R32G32B32A32_SINT, offsetof(SceneVertex, TextureBinds));
-		builder.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT);
-		builder.Layout(layout);
-		builder.RenderPass(Scene.RenderPass.get());
-
-		builder.AddColorBlendAttachment(ColorBlendAttachmentBuilder().BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA).Create());
+		Scene.LinePipeline[hitTest][i].MinDepth = 0.0f;
+		Scene.LinePipeline[hitTest][i].MaxDepth = 0.1f;
+	}
+}
+
+void RenderPassManager::CreatePointPipeline(int hitTest, int i)
+{
+	VulkanShader* vertShader = renderer->Shaders->Scene.VertexShader.get();
+	VulkanShader* fragShader = hitTest ? renderer->Shaders->Scene.FragmentShader.get() : renderer->Shaders->Scene.FragmentShaderNoHit.get();
+	VulkanPipelineLayout* layout = Scene.BindlessPipelineLayout.get();
+	static const char* debugName = "ScenePipeline";
+
+	GraphicsPipelineBuilder builder;
+	builder.AddVertexShader(vertShader);
+	builder.AddFragmentShader(fragShader);
+	builder.Topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	builder.Cull(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+	builder.AddVertexBufferBinding(0, sizeof(SceneVertex));
+	builder.AddVertexAttribute(0, 0, VK_FORMAT_R32_UINT, offsetof(SceneVertex, Flags));
+	builder.AddVertexAttribute(1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(SceneVertex, Position));
+	builder.AddVertexAttribute(2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord));
+	builder.AddVertexAttribute(3, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord2));
+	builder.AddVertexAttribute(4, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord3));
+	builder.AddVertexAttribute(5, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(SceneVertex, TexCoord4));
+	builder.AddVertexAttribute(6, 0, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(SceneVertex, Color));
+	builder.AddVertexAttribute(7, 0, VK_FORMAT_R32G32B32A32_SINT, offsetof(SceneVertex, TextureBinds));
+	builder.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT);
+	builder.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR);
+	builder.Layout(layout);
+	builder.RenderPass(Scene.RenderPass[hitTest][0][0].get());
+	builder.AddColorAttachmentFormat(renderer->Textures->SceneColorFormat);
+	if (hitTest)
+		builder.AddColorAttachmentFormat(VK_FORMAT_R32_UINT);
+	builder.DepthAttachmentFormat(VK_FORMAT_D32_SFLOAT);
+	builder.Cache(PipelineCache.get());
+
+	builder.AddColorBlendAttachment(ColorBlendAttachmentBuilder().BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA).Create());
+	if (hitTest)
 		builder.AddColorBlendAttachment(ColorBlendAttachmentBuilder().Create());
 
-		builder.DepthStencilEnable(true, true, false);
-		builder.RasterizationSamples(renderer->Textures->Scene->SceneSamples);
-		builder.DebugName(debugName);
+	builder.DepthStencilEnable(true, true, false);
+	builder.RasterizationSamples(renderer->Textures->Scene->SceneSamples);
+	builder.DebugName(debugName);
+
+	Scene.PointPipeline[hitTest][i].Pipeline = builder.Create(renderer->Device.get());
+
+	if (i == 0)
+	{
+		Scene.PointPipeline[hitTest][i].MinDepth = 0.0f;
+		Scene.PointPipeline[hitTest][i].MaxDepth = 0.1f;
+	}
+}
 
-		Scene.PointPipeline[i].Pipeline = builder.Create(renderer->Device.get());
+void RenderPassManager::CreateRenderPass()
+{
+	CancelSceneVariants();
+	Scene.Samples = renderer->Textures->Scene->SceneSamples;
+	if (DynamicRendering)
+		return;
 
-		if (i == 0)
+	for (int hitTest = 0; hitTest < 2; hitTest++)
+	{
+		for (int continuePass = 0; continuePass < 2; continuePass++)
 		{
-			Scene.PointPipeline[i].MinDepth = 0.0f;
-			Scene.PointPipeline[i].MaxDepth = 0.1f;
+			for (int store = 0; store < 2; store++)
+			{
+				CreateSceneRenderPass(hitTest, continuePass, store);
+			}
 		}
 	}
 }
 
-void RenderPassManager::CreateRenderPass()
+void RenderPassManager::CreateSceneRenderPass(int hitTest, int continuePass, int store)
 {
-	Scene.RenderPass = RenderPassBuilder()
-		.AddAttachment(
-			VK_FORMAT_R16G16B16A16_SFLOAT,
-			renderer->Textures->Scene->SceneSamples,
-			VK_ATTACHMENT_LOAD_OP_CLEAR,
-			VK_ATTACHMENT_STORE_OP_STORE,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddAttachment(
+	VkSampleCountFlagBits samples = renderer->Textures->Scene->SceneSamples;
+	bool multisample = samples != VK_SAMPLE_COUNT_1_BIT;
+	int depthIndex = hitTest ? 2 : 1;
+
+	VkAttachmentLoadOp load = continuePass ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+	VkImageLayout colorInitialLayout = continuePass ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+	VkImageLayout depthInitialLayout = continuePass ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+
+	// Only the resolved color and the hit buffer are read after the last pass of the frame
+	VkAttachmentStoreOp colorStore = (store || !multisample) ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	VkAttachmentStoreOp depthStore = store ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+	RenderPassBuilder builder;
+	builder.AddAttachment(
+		renderer->Textures->SceneColorFormat,
+		samples,
+		load,
+		colorStore,
+		colorInitialLayout,
+		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	if (hitTest)
+	{
+		builder.AddAttachment(
 			VK_FORMAT_R32_UINT,
-			renderer->Textures->Scene->SceneSamples,
-			VK_ATTACHMENT_LOAD_OP_CLEAR,
-			VK_ATTACHMENT_STORE_OP_STORE,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddDepthStencilAttachment(
-			VK_FORMAT_D32_SFLOAT,
-			renderer->Textures->Scene->SceneSamples,
-			VK_ATTACHMENT_LOAD_OP_CLEAR,
+			samples,
+			load,
 			VK_ATTACHMENT_STORE_OP_STORE,
+			colorInitialLayout,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	}
+	builder.AddDepthStencilAttachment(
+		VK_FORMAT_D32_SFLOAT,
+		samples,
+		load,
+		depthStore,
+		VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		depthInitialLayout,
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	if (multisample)
+	{
+		// The multisampled color is resolved into PPImage[0] when the pass ends
+		builder.AddAttachment(
+			renderer->Textures->SceneColorFormat,
+			VK_SAMPLE_COUNT_1_BIT,
 			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-			VK_ATTACHMENT_STORE_OP_DONT_CARE,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-		.AddSubpass()
-		.AddSubpassColorAttachmentRef(0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddSubpassColorAttachmentRef(1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddSubpassDepthStencilAttachmentRef(2, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-		.DebugName("SceneRenderPass")
-		.Create(renderer->Device.get());
-
-	Scene.RenderPassContinue = RenderPassBuilder()
-		.AddAttachment(
-			VK_FORMAT_R16G16B16A16_SFLOAT,
-			renderer->Textures->Scene->SceneSamples,
-			VK_ATTACHMENT_LOAD_OP_LOAD,
-			VK_ATTACHMENT_STORE_OP_STORE,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddAttachment(
-			VK_FORMAT_R32_UINT,
-			renderer->Textures->Scene->SceneSamples,
-			VK_ATTACHMENT_LOAD_OP_LOAD,
 			VK_ATTACHMENT_STORE_OP_STORE,
 			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddDepthStencilAttachment(
-			VK_FORMAT_D32_SFLOAT,
-			renderer->Textures->Scene->SceneSamples,
-			VK_ATTACHMENT_LOAD_OP_LOAD,
-			VK_ATTACHMENT_STORE_OP_STORE,
-			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-			VK_ATTACHMENT_STORE_OP_DONT_CARE,
-			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-		.AddSubpass()
-		.AddSubpassColorAttachmentRef(0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddSubpassColorAttachmentRef(1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddSubpassDepthStencilAttachmentRef(2, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
-		.DebugName("SceneRenderPassContinue")
-		.Create(renderer->Device.get());
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	}
+	builder.AddSubpass();
+	builder.AddSubpassColorAttachmentRef(0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	if (hitTest)
+		builder.AddSubpassColorAttachmentRef(1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	if (multisample)
+	{
+		builder.AddSubpassResolveAttachmentRef(depthIndex + 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+		if (hitTest)
+			builder.AddSubpassResolveAttachmentRef(VK_ATTACHMENT_UNUSED, VK_IMAGE_LAYOUT_UNDEFINED);
+	}
+	builder.AddSubpassDepthStencilAttachmentRef(depthIndex, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+	builder.DebugName(hitTest ? "SceneRenderPass" : "SceneRenderPassNoHit");
+	Scene.RenderPass[hitTest][continuePass][store] = builder.Create(renderer->Device.get());
+}
+
+void RenderPassManager::BeginScene(float r, float g, float b, float a)
+{
+	Scene.Continued = false;
+	Scene.ClearColor[0] = r;
+	Scene.ClearColor[1] = g;
+	Scene.ClearColor[2] = b;
+	Scene.ClearColor[3] = a;
+	BeginSceneCommands();
+}
+
+void RenderPassManager::ContinueScene()
+{
+	Scene.Continued = true;
+	BeginSceneCommands();
+}
+
+void RenderPassManager::BeginSceneCommands()
+{
+	VkFormat colorFormats[] = { renderer->Textures->SceneColorFormat, VK_FORMAT_R32_UINT };
+
+	VkCommandBufferInheritanceRenderingInfo renderingInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO };
+	renderingInfo.colorAttachmentCount = Scene.HitTest ? 2 : 1;
+	renderingInfo.pColorAttachmentFormats = colorFormats;
+	renderingInfo.depthAttachmentFormat = VK_FORMAT_D32_SFLOAT;
+	renderingInfo.rasterizationSamples = renderer->Textures->Scene->SceneSamples;
+
+	VkCommandBufferInheritanceInfo inheritance = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO };
+	if (DynamicRendering)
+	{
+		inheritance.pNext = &renderingInfo;
+	}
+	else
+	{
+		inheritance.renderPass = Scene.RenderPass[Scene.HitTest][Scene.Continued][0]->renderPass;
+		inheritance.framebuffer = renderer->Framebuffers->SceneFramebuffer[Scene.HitTest]->framebuffer;
+	}
+	renderer->Commands->BeginSceneCommands(&inheritance);
+}
+
+void RenderPassManager::EndScene(bool store)
+{
+	SceneTextures* scene = renderer->Textures->Scene.get();
+	bool multisample = scene->SceneSamples != VK_SAMPLE_COUNT_1_BIT;
+
+	VulkanCommandBuffer* sceneCommands = renderer->Commands->EndSceneCommands();
+	VulkanCommandBuffer* cmdbuffer = renderer->Commands->GetDrawCommands();
+
+	const float* c = Scene.ClearColor;
+	if (DynamicRendering)
+	{
+		VkAttachmentLoadOp load = Scene.Continued ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+		VkAttachmentStoreOp colorStore = (store || !multisample) ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		VkAttachmentStoreOp depthStore = store ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+		RenderingBegin begin;
+		begin.RenderArea(0, 0, scene->Width, scene->Height);
+		begin.Flags(VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT);
+		begin.AddColorAttachment(scene->ColorBufferView.get(), load, colorStore, c[0], c[1], c[2], c[3]);
+		if (multisample)
+			begin.ResolveAttachment(scene->PPImageView[0].get());
+		if (Scene.HitTest)
+			begin.AddColorAttachment(scene->HitBufferView.get(), load, VK_ATTACHMENT_STORE_OP_STORE);
+		begin.DepthAttachment(scene->DepthBufferView.get(), load, depthStore);
+		begin.Execute(cmdbuffer);
+	}
+	else
+	{
+		RenderPassBegin begin;
+		begin.RenderPass(Scene.RenderPass[Scene.HitTest][Scene.Continued][store].get());
+		begin.Framebuffer(renderer->Framebuffers->SceneFramebuffer[Scene.HitTest].get());
+		begin.RenderArea(0, 0, scene->Width, scene->Height);
+		if (!Scene.Continued)
+		{
+			begin.AddClearColor(c[0], c[1], c[2], c[3]);
+			if (Scene.HitTest)
+				begin.AddClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+			begin.AddClearDepthStencil(1.0f, 0);
+		}
+		begin.Execute(cmdbuffer, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+	}
+
+	cmdbuffer->executeCommands(1, &sceneCommands->buffer);
+	EndPass(cmdbuffer);
+}
+
+void RenderPassManager::BeginPostprocess(VulkanCommandBuffer* cmdbuffer, VulkanFramebuffer* framebuffer, VulkanImageView* view, int width, int height)
+{
+	if (DynamicRendering)
+	{
+		// Post process steps draw a quad covering the whole output
+		RenderingBegin()
+			.RenderArea(0, 0, width, height)
+			.AddColorAttachment(view, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_STORE)
+			.Execute(cmdbuffer);
+	}
+	else
+	{
+		RenderPassBegin()
+			.RenderPass(Postprocess.RenderPass.get())
+			.Framebuffer(framebuffer)
+			.RenderArea(0, 0, width, height)
+			.AddClearColor(0.0f, 0.0f, 0.0f, 1.0f)
+			.Execute(cmdbuffer);
+	}
+}
+
+void RenderPassManager::BeginPresent(VulkanCommandBuffer* cmdbuffer)
+{
+	auto swapchain = renderer->Commands->SwapChain.get();
+	if (DynamicRendering)
+	{
+		RenderingBegin()
+			.RenderArea(0, 0, swapchain->Width(), swapchain->Height())
+			.AddColorAttachment(swapchain->GetImageView(renderer->Commands->PresentImageIndex), VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, 0.0f, 0.0f, 0.0f, 1.0f)
+			.Execute(cmdbuffer);
+	}
+	else
+	{
+		RenderPassBegin()
+			.RenderPass(Present.RenderPass.get())
+			.Framebuffer(renderer->Framebuffers->GetSwapChainFramebuffer())
+			.RenderArea(0, 0, swapchain->Width(), swapchain->Height())
+			.AddClearColor(0.0f, 0.0f, 0.0f, 1.0f)
+			.Execute(cmdbuffer);
+	}
+}
+
+void RenderPassManager::EndPass(VulkanCommandBuffer* cmdbuffer)
+{
+	if (DynamicRendering)
+		cmdbuffer->endRendering();
+	else
+		cmdbuffer->endRenderPass();
 }
 
 void RenderPassManager::CreatePresentRenderPass()
 {
+	Present.Format = renderer->Commands->SwapChain->Format().format;
+	if (DynamicRendering)
+		return;
+
 	Present.RenderPass = RenderPassBuilder()
 		.AddAttachment(
-			renderer->Commands->SwapChain->Format().format,
+			Present.Format,
 			VK_SAMPLE_COUNT_1_BIT,
 			VK_ATTACHMENT_LOAD_OP_CLEAR,
 			VK_ATTACHMENT_STORE_OP_STORE,
@@ -329,41 +791,78 @@ void RenderPassManager::CreatePresentRenderPass()
 
 void RenderPassManager::CreatePresentPipeline()
 {
-	for (int i = 0; i < 16; i++)
+	ParallelFor(16, [&](int i)
 	{
 		Present.Pipeline[i] = GraphicsPipelineBuilder()
+			.Cache(PipelineCache.get())
 			.AddVertexShader(renderer->Shaders->Postprocess.VertexShader.get())
 			.AddFragmentShader(renderer->Shaders->Postprocess.FragmentPresentShader[i].get())
 			.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT)
 			.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR)
 			.Layout(Present.PipelineLayout.get())
 			.RenderPass(Present.RenderPass.get())
+			.AddColorAttachmentFormat(Present.Format)
 			.DebugName("PresentPipeline")
 			.Create(renderer->Device.get());
-	}
+
+		if (renderer->Shaders->Postprocess.FragmentPresentUpscaleShader[i])
+		{
+			Present.UpscalePipeline[i] = GraphicsPipelineBuilder()
+				.Cache(PipelineCache.get())
+				.AddVertexShader(renderer->Shaders->Postprocess.VertexShader.get())
+				.AddFragmentShader(renderer->Shaders->Postprocess.FragmentPresentUpscaleShader[i].get())
+				.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT)
+				.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR)
+				.Layout(Present.PipelineLayout.get())
+				.RenderPass(Present.RenderPass.get())
+				.AddColorAttachmentFormat(Present.Format)
+				.DebugName("PresentUpscalePipeline")
+				.Create(renderer->Device.get());
+		}
+	});
 }
 
 void RenderPassManager::CreateScreenshotPipeline()
 {
-	for (int i = 0; i < 16; i++)
+	ParallelFor(16, [&](int i)
 	{
 		Present.ScreenshotPipeline[i] = GraphicsPipelineBuilder()
+			.Cache(PipelineCache.get())
 			.AddVertexShader(renderer->Shaders->Postprocess.VertexShader.get())
 			.AddFragmentShader(renderer->Shaders->Postprocess.FragmentPresentShader[i].get())
 			.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT)
 			.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR)
 			.Layout(Present.PipelineLayout.get())
 			.RenderPass(Postprocess.RenderPass.get())
+			.AddColorAttachmentFormat(renderer->Textures->SceneColorFormat)
 			.DebugName("ScreenshotPipeline")
 			.Create(renderer->Device.get());
-	}
+
+		if (renderer->Shaders->Postprocess.FragmentPresentUpscaleShader[i])
+		{
+			Present.ScreenshotUpscalePipeline[i] = GraphicsPipelineBuilder()
+				.Cache(PipelineCache.get())
+				.AddVertexShader(renderer->Shaders->Postprocess.VertexShader.get())
+				.AddFragmentShader(renderer->Shaders->Postprocess.FragmentPresentUpscaleShader[i].get())
+				.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT)
+				.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR)
+				.Layout(Present.PipelineLayout.get())
+				.RenderPass(Postprocess.RenderPass.get())
+				.AddColorAttachmentFormat(renderer->Textures->SceneColorFormat)
+				.DebugName("ScreenshotUpscalePipeline")
+				.Create(renderer->Device.get());
+		}
+	});
 }
 
 void RenderPassManager::CreatePostprocessRenderPass()
 {
+	if (DynamicRendering)
+		return;
+
 	Postprocess.RenderPass = RenderPassBuilder()
 		.AddAttachment(
-			VK_FORMAT_R16G16B16A16_SFLOAT,
+			renderer->Textures->SceneColorFormat,
 			VK_SAMPLE_COUNT_1_BIT,
 			VK_ATTACHMENT_LOAD_OP_CLEAR,
 			VK_ATTACHMENT_STORE_OP_STORE,
@@ -373,71 +872,52 @@ void RenderPassManager::CreatePostprocessRenderPass()
 		.AddSubpassColorAttachmentRef(0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
 		.DebugName("PPRenderPass")
 		.Create(renderer->Device.get());
-
-	Postprocess.RenderPassCombine = RenderPassBuilder()
-		.AddAttachment(
-			VK_FORMAT_R16G16B16A16_SFLOAT,
-			VK_SAMPLE_COUNT_1_BIT,
-			VK_ATTACHMENT_LOAD_OP_LOAD,
-			VK_ATTACHMENT_STORE_OP_STORE,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.AddSubpass()
-		.AddSubpassColorAttachmentRef(0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
-		.DebugName("PPRenderPassCombine")
-		.Create(renderer->Device.get());
 }
 
 void RenderPassManager::CreateBloomPipeline()
 {
-	Bloom.Extract = GraphicsPipelineBuilder()
-		.AddVertexShader(renderer->Shaders->Postprocess.VertexShader.get())
-		.AddFragmentShader(renderer->Shaders->Bloom.Extract.get())
-		.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT)
-		.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR)
-		.Layout(Bloom.PipelineLayout.get())
-		.RenderPass(Postprocess.RenderPass.get())
-		.DebugName("Bloom.Extract")
+	Bloom.Downsample = ComputePipelineBuilder()
+		.Cache(PipelineCache.get())
+		.ComputeShader(renderer->Shaders->Bloom.Downsample.get())
+		.Layout(Bloom.DownsampleLayout.get())
+		.DebugName("Bloom.Downsample")
 		.Create(renderer->Device.get());
 
-	Bloom.Combine = GraphicsPipelineBuilder()
-		.AddVertexShader(renderer->Shaders->Postprocess.VertexShader.get())
-		.AddFragmentShader(renderer->Shaders->Bloom.Combine.get())
-		.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT)
-		.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR)
-		.AddColorBlendAttachment(ColorBlendAttachmentBuilder().BlendMode(VK_BLEND_OP_ADD, VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE).Create())
-		.Layout(Bloom.PipelineLayout.get())
-		.RenderPass(Postprocess.RenderPass.get())
-		.DebugName("Bloom.Combine")
+	Bloom.BlurDownsample = ComputePipelineBuilder()
+		.Cache(PipelineCache.get())
+		.ComputeShader(renderer->Shaders->Bloom.BlurDownsample.get())
+		.Layout(Bloom.UpsampleLayout.get())
+		.DebugName("Bloom.BlurDownsample")
 		.Create(renderer->Device.get());
 
-	Bloom.Scale = GraphicsPipelineBuilder()
-		.AddVertexShader(renderer->Shaders->Postprocess.VertexShader.get())
-		.AddFragmentShader(renderer->Shaders->Bloom.Combine.get())
-		.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT)
-		.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR)
-		.Layout(Bloom.PipelineLayout.get())
-		.RenderPass(Postprocess.RenderPass.get())
-		.DebugName("Bloom.Copy")
+	Bloom.Upsample = ComputePipelineBuilder()
+		.Cache(PipelineCache.get())
+		.ComputeShader(renderer->Shaders->Bloom.Upsample.get())
+		.Layout(Bloom.UpsampleLayout.get())
+		.DebugName("Bloom.Upsample")
 		.Create(renderer->Device.get());
 
-	Bloom.BlurVertical = GraphicsPipelineBuilder()
-		.AddVertexShader(renderer->Shaders->Postprocess.VertexShader.get())
-		.AddFragmentShader(renderer->Shaders->Bloom.BlurVertical.get())
-		.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT)
-		.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR)
-		.Layout(Bloom.PipelineLayout.get())
-		.RenderPass(Postprocess.RenderPass.get())
-		.DebugName("Bloom.BlurVertical")
+	Bloom.UpsampleCombine = ComputePipelineBuilder()
+		.Cache(PipelineCache.get())
+		.ComputeShader(renderer->Shaders->Bloom.UpsampleCombine.get())
+		.Layout(Bloom.UpsampleLayout.get())
+		.DebugName("Bloom.UpsampleCombine")
+		.Create(renderer->Device.get());
+}
+
+void RenderPassManager::CreateHitReducePipeline()
+{
+	HitReduce.Pipeline = ComputePipelineBuilder()
+		.Cache(PipelineCache.get())
+		.ComputeShader(renderer->Shaders->HitReduce.Shader.get())
+		.Layout(HitReduce.PipelineLayout.get())
+		.DebugName("HitReduce")
 		.Create(renderer->Device.get());
 
-	Bloom.BlurHorizontal = GraphicsPipelineBuilder()
-		.AddVertexShader(renderer->Shaders->Postprocess.VertexShader.get())
-		.AddFragmentShader(renderer->Shaders->Bloom.BlurHorizontal.get())
-		.AddDynamicState(VK_DYNAMIC_STATE_VIEWPORT)
-		.AddDynamicState(VK_DYNAMIC_STATE_SCISSOR)
-		.Layout(Bloom.PipelineLayout.get())
-		.RenderPass(Postprocess.RenderPass.get())
-		.DebugName("Bloom.BlurHorizontal")
+	HitReduce.PipelineMultisample = ComputePipelineBuilder()
+		.Cache(PipelineCache.get())
+		.ComputeShader(renderer->Shaders->HitReduce.ShaderMultisample.get())
+		.Layout(HitReduce.PipelineLayout.get())
+		.DebugName("HitReduceMultisample")
 		.Create(renderer->Device.get());
 }
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+
 class UVulkanRenderDevice;
 
 struct PipelineState
@@ -7,6 +11,10 @@ struct PipelineState
 	std::unique_ptr<VulkanPipeline> Pipeline;
 	float MinDepth = 0.1f;
 	float MaxDepth = 1.0f;
+
+	// Blend state index and the scene shader flags the fragment shader variant handles
+	int Index = -1;
+	uint32_t Features = 0;
 };
 
 class RenderPassManager
@@ -17,6 +25,7 @@ public:
 
 	void CreateRenderPass();
 	void CreatePipelines();
+	void CreateHitTestPipelines();
 
 	void CreatePresentRenderPass();
 	void CreatePresentPipeline();
@@ -24,50 +33,153 @@ public:
 
 	void CreatePostprocessRenderPass();
 	void CreateBloomPipeline();
+	void CreateFusedPresentPipeline(int index);
+	void CreateHitReducePipeline();
+
+	// The scene pass is recorded into secondary command buffers. EndScene begins it on the primary draw commands and executes them.
+	// Pass store = true when a continue pass follows later in the frame, otherwise depth and multisampled color are discarded.
+	void BeginScene(float r, float g, float b, float a);
+	void ContinueScene();
+	void EndScene(bool store);
+	void BeginPostprocess(VulkanCommandBuffer* cmdbuffer, VulkanFramebuffer* framebuffer, VulkanImageView* view, int width, int height);
+	void BeginPresent(VulkanCommandBuffer* cmdbuffer);
+	void EndPass(VulkanCommandBuffer* cmdbuffer);
+
+	// With VK_KHR_dynamic_rendering there are no render pass or framebuffer objects and pipelines only know the attachment formats
+	bool DynamicRendering = false;
 
-	PipelineState* GetPipeline(DWORD polyflags);
+	// Bloom combine, color correction and dither run as a single compute pass that is blitted into the swap chain
+	bool UseFusedPresent = false;
+
+	PipelineState* GetPipeline(DWORD polyflags, uint32_t features = 0, PipelineState* current = nullptr);
 	PipelineState* GetEndFlashPipeline();
-	PipelineState* GetLinePipeline(bool occludeLines) { return &Scene.LinePipeline[occludeLines]; }
-	PipelineState* GetPointPipeline(bool occludeLines) { return &Scene.PointPipeline[occludeLines]; }
+	PipelineState* GetLinePipeline(bool occludeLines) { return &Scene.LinePipeline[Scene.HitTest][occludeLines]; }
+	PipelineState* GetPointPipeline(bool occludeLines) { return &Scene.PointPipeline[Scene.HitTest][occludeLines]; }
+
+	std::unique_ptr<VulkanPipelineCache> PipelineCache;
+
+	// Each blend state gets a few fragment shader variants with the unused flag branches specialized away. The last one handles all flags.
+	// Only that one is created up front. The others are created on a worker thread the first time a draw asks for them.
+	enum { SceneVariantCount = 6, SceneVariantAll = SceneVariantCount - 1 };
+	static const uint32_t SceneVariantFeatures[SceneVariantCount];
 
 	struct
 	{
 		std::unique_ptr<VulkanPipelineLayout> BindlessPipelineLayout;
-		std::unique_ptr<VulkanRenderPass> RenderPass;
-		std::unique_ptr<VulkanRenderPass> RenderPassContinue;
-		PipelineState Pipeline[32];
-		PipelineState LinePipeline[2];
-		PipelineState PointPipeline[2];
+		VkSampleCountFlagBits Samples = VK_SAMPLE_COUNT_1_BIT;
+
+		// Render passes and pipelines come in two sets. Set 1 also writes the R32_UINT hit buffer and is only used by frames that hit test.
+		bool HitTest = false;
+
+		// Indexed by [hitTest][continue][store]. Continue passes load the attachments instead of clearing them. Store passes end
+		// at a mid-frame flush and keep everything for the continue pass after it. All of them are compatible with each other.
+		std::unique_ptr<VulkanRenderPass> RenderPass[2][2][2];
+
+		// How the scene pass that is being recorded begins
+		bool Continued = false;
+		float ClearColor[4] = {};
+		PipelineState Pipeline[2][32][SceneVariantCount];
+		PipelineState LinePipeline[2][2];
+		PipelineState PointPipeline[2][2];
 	} Scene;
 
 	struct
 	{
 		std::unique_ptr<VulkanPipelineLayout> PipelineLayout;
 		std::unique_ptr<VulkanRenderPass> RenderPass;
+		VkFormat Format = VK_FORMAT_UNDEFINED;
 		std::unique_ptr<VulkanPipeline> Pipeline[16];
 		std::unique_ptr<VulkanPipeline> ScreenshotPipeline[16];
+		std::unique_ptr<VulkanPipeline> UpscalePipeline[16];
+		std::unique_ptr<VulkanPipeline> ScreenshotUpscalePipeline[16];
 	} Present;
 
 	struct
 	{
-		std::unique_ptr<VulkanPipelineLayout> PipelineLayout;
-		std::unique_ptr<VulkanPipeline> Extract;
-		std::unique_ptr<VulkanPipeline> Combine;
-		std::unique_ptr<VulkanPipeline> Scale;
-		std::unique_ptr<VulkanPipeline> BlurVertical;
-		std::unique_ptr<VulkanPipeline> BlurHorizontal;
+		std::unique_ptr<VulkanPipelineLayout> DownsampleLayout;
+		std::unique_ptr<VulkanPipelineLayout> UpsampleLayout;
+		std::unique_ptr<VulkanPipeline> Downsample;
+		std::unique_ptr<VulkanPipeline> BlurDownsample;
+		std::unique_ptr<VulkanPipeline> Upsample;
+		std::unique_ptr<VulkanPipeline> UpsampleCombine;
 	} Bloom;
 
+	struct
+	{
+		std::unique_ptr<VulkanPipelineLayout> PipelineLayout;
+		std::unique_ptr<VulkanPipeline> Pipeline[16][2]; // [present shader][bloom]
+	} FusedPresent;
+
+	struct
+	{
+		std::unique_ptr<VulkanPipelineLayout> PipelineLayout;
+		std::unique_ptr<VulkanPipeline> Pipeline;
+		std::unique_ptr<VulkanPipeline> PipelineMultisample;
+	} HitReduce;
+
 	struct
 	{
 		std::unique_ptr<VulkanRenderPass> RenderPass;
-		std::unique_ptr<VulkanRenderPass> RenderPassCombine;
 	} Postprocess;
 
 private:
+	void CreatePipelineCache();
+	void SavePipelineCache();
+	void CreateScenePassPipeline(int hitTest, int index);
+	PipelineState* GetScenePipeline(int index, int variant);
+	void CreateScenePipeline(int hitTest, int index, int variant);
+	void QueueSceneVariant(int hitTest, int index, int variant);
+	void CancelSceneVariants();
+	void SceneVariantWorkerMain();
+	void CreateLinePipeline(int hitTest, int index);
+	void CreatePointPipeline(int hitTest, int index);
+	void CreateSceneRenderPass(int hitTest, int continuePass, int store);
+	void BeginSceneCommands();
+
+	// Until a variant is ready GetScenePipeline returns the SceneVariantAll pipeline of the same blend state
+	enum { VariantMissing, VariantQueued, VariantReady };
+	std::atomic<int> SceneVariantStatus[2][32][SceneVariantCount] = {};
+
+	struct SceneVariantKey
+	{
+		int HitTest;
+		int Index;
+		int Variant;
+	};
+
+	struct
+	{
+		std::thread Thread;
+		std::mutex Mutex;
+		std::condition_variable Condition;
+		std::vector<SceneVariantKey> Queue;
+		bool Busy = false;
+		bool Stop = false;
+	} VariantWorker;
+
+	// Scene, line and point pipelines created up front for one set
+	enum { ScenePassPipelineCount = 32 + 2 + 2 };
 	void CreateSceneBindlessPipelineLayout();
 	void CreatePresentPipelineLayout();
 	void CreateBloomPipelineLayout();
+	void CreateFusedPresentPipelineLayout();
+	void CreateHitReducePipelineLayout();
+
+	// Stored in front of the driver's cache data so that a cache from another device or driver version is never used
+	struct PipelineCacheFileHeader
+	{
+		uint32_t Magic;
+		uint32_t VendorID;
+		uint32_t DeviceID;
+		uint32_t DriverVersion;
+		uint8_t CacheUUID[VK_UUID_SIZE];
+		uint32_t DataSize;
+		uint32_t Padding;
+		uint64_t DataHash;
+	};
+
+	bool IsPipelineCacheHeaderValid(const PipelineCacheFileHeader& header);
+	void InitPipelineCacheHeader(PipelineCacheFileHeader& header);
 
 	UVulkanRenderDevice* renderer = nullptr;
 };
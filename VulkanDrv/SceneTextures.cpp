@@ -3,43 +3,34 @@
 #include "SceneTextures.h"
 #include "UVulkanRenderDevice.h"
 
-SceneTextures::SceneTextures(UVulkanRenderDevice* renderer, int width, int height, int multisample) : Width(width), Height(height), Multisample(multisample)
+SceneTextures::SceneTextures(UVulkanRenderDevice* renderer, int width, int height, int multisample) : Width(width), Height(height), RenderWidth(width), RenderHeight(height), Multisample(multisample)
 {
 	SceneSamples = GetBestSampleCount(renderer->Device.get(), multisample);
+	ColorFormat = renderer->Textures->SceneColorFormat;
 
-	ColorBuffer = ImageBuilder()
-		.Size(width, height)
-		.Samples(SceneSamples)
-		.Format(VK_FORMAT_R16G16B16A16_SFLOAT)
-		.Usage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
-		.DebugName("colorBuffer")
-		.Create(renderer->Device.get());
+	if (SceneSamples != VK_SAMPLE_COUNT_1_BIT)
+	{
+		// The scene pass resolves the samples into PPImage[0] itself and nothing else reads them
+		ColorBuffer = CreateTransientAttachment(renderer, ColorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, "colorBuffer");
+	}
+	else
+	{
+		ColorBuffer = ImageBuilder()
+			.Size(width, height)
+			.Samples(SceneSamples)
+			.Format(ColorFormat)
+			.Usage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
+			.DebugName("colorBuffer")
+			.Create(renderer->Device.get());
+	}
 
 	ColorBufferView = ImageViewBuilder()
-		.Image(ColorBuffer.get(), VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT)
+		.Image(ColorBuffer.get(), ColorFormat, VK_IMAGE_ASPECT_COLOR_BIT)
 		.DebugName("colorBufferView")
 		.Create(renderer->Device.get());
 
-	HitBuffer = ImageBuilder()
-		.Size(width, height)
-		.Samples(SceneSamples)
-		.Format(VK_FORMAT_R32_UINT)
-		.Usage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
-		.DebugName("hitBuffer")
-		.Create(renderer->Device.get());
-
-	HitBufferView = ImageViewBuilder()
-		.Image(HitBuffer.get(), VK_FORMAT_R32_UINT, VK_IMAGE_ASPECT_COLOR_BIT)
-		.DebugName("hitBufferView")
-		.Create(renderer->Device.get());
-
-	DepthBuffer = ImageBuilder()
-		.Size(width, height)
-		.Samples(SceneSamples)
-		.Format(VK_FORMAT_D32_SFLOAT)
-		.Usage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT)
-		.DebugName("depthBuffer")
-		.Create(renderer->Device.get());
+	// Depth is only ever used as an attachment
+	DepthBuffer = CreateTransientAttachment(renderer, VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, "depthBuffer");
 
 	DepthBufferView = ImageViewBuilder()
 		.Image(DepthBuffer.get(), VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT)
@@ -51,29 +42,21 @@ SceneTextures::SceneTextures(UVulkanRenderDevice* renderer, int width, int heigh
 		PPImage[i] = ImageBuilder()
 			.Size(width, height)
 			.Samples(VK_SAMPLE_COUNT_1_BIT)
-			.Format(VK_FORMAT_R16G16B16A16_SFLOAT)
-			.Usage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+			.Format(ColorFormat)
+			.Usage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
 			.DebugName("ppImage")
 			.Create(renderer->Device.get());
 
 		PPImageView[i] = ImageViewBuilder()
-			.Image(PPImage[i].get(), VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT)
+			.Image(PPImage[i].get(), ColorFormat, VK_IMAGE_ASPECT_COLOR_BIT)
 			.DebugName("ppImageView")
 			.Create(renderer->Device.get());
 	}
 
-	PPHitBuffer = ImageBuilder()
-		.Size(width, height)
-		.Samples(VK_SAMPLE_COUNT_1_BIT)
-		.Format(VK_FORMAT_R32_UINT)
-		.Usage(VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
-		.DebugName("ppHitBuffer")
-		.Create(renderer->Device.get());
-
-	StagingHitBuffer = BufferBuilder()
-		.Usage(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU)
-		.Size(width * height * sizeof(uint32_t))
-		.DebugName("stagingHitBuffer")
+	HitResultBuffer = BufferBuilder()
+		.Usage(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU)
+		.Size(sizeof(uint32_t))
+		.DebugName("hitResultBuffer")
 		.Create(renderer->Device.get());
 
 	int bloomWidth = width;
@@ -83,33 +66,20 @@ SceneTextures::SceneTextures(UVulkanRenderDevice* renderer, int width, int heigh
 		bloomWidth = (bloomWidth + 1) / 2;
 		bloomHeight = (bloomHeight + 1) / 2;
 
-		BloomBlurLevels[level].Width = bloomWidth;
-		BloomBlurLevels[level].Height = bloomHeight;
-
-		BloomBlurLevels[level].VTexture = ImageBuilder()
-			.Size(bloomWidth, bloomHeight)
-			.Samples(VK_SAMPLE_COUNT_1_BIT)
-			.Format(VK_FORMAT_R16G16B16A16_SFLOAT)
-			.Usage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
-			.DebugName("BloomVTexture")
-			.Create(renderer->Device.get());
+		BloomLevels[level].Width = bloomWidth;
+		BloomLevels[level].Height = bloomHeight;
 
-		BloomBlurLevels[level].HTexture = ImageBuilder()
+		BloomLevels[level].Texture = ImageBuilder()
 			.Size(bloomWidth, bloomHeight)
 			.Samples(VK_SAMPLE_COUNT_1_BIT)
-			.Format(VK_FORMAT_R16G16B16A16_SFLOAT)
-			.Usage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
-			.DebugName("BloomHTexture")
-			.Create(renderer->Device.get());
-
-		BloomBlurLevels[level].VTextureView = ImageViewBuilder()
-			.Image(BloomBlurLevels[level].VTexture.get(), VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT)
-			.DebugName("BloomVTextureView")
+			.Format(ColorFormat)
+			.Usage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT)
+			.DebugName("BloomTexture")
 			.Create(renderer->Device.get());
 
-		BloomBlurLevels[level].HTextureView = ImageViewBuilder()
-			.Image(BloomBlurLevels[level].HTexture.get(), VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT)
-			.DebugName("BloomHTextureView")
+		BloomLevels[level].TextureView = ImageViewBuilder()
+			.Image(BloomLevels[level].Texture.get(), ColorFormat, VK_IMAGE_ASPECT_COLOR_BIT)
+			.DebugName("BloomTextureView")
 			.Create(renderer->Device.get());
 	}
 
@@ -123,14 +93,6 @@ SceneTextures::SceneTextures(UVulkanRenderDevice* renderer, int width, int heigh
 		VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
 		VK_IMAGE_ASPECT_COLOR_BIT);
 
-	barrier.AddImage(
-		HitBuffer.get(),
-		VK_IMAGE_LAYOUT_UNDEFINED,
-		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-		0,
-		VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-		VK_IMAGE_ASPECT_COLOR_BIT);
-
 	barrier.AddImage(
 		DepthBuffer.get(),
 		VK_IMAGE_LAYOUT_UNDEFINED,
@@ -142,31 +104,113 @@ SceneTextures::SceneTextures(UVulkanRenderDevice* renderer, int width, int heigh
 	for (int level = 0; level < NumBloomLevels; level++)
 	{
 		barrier.AddImage(
-			BloomBlurLevels[level].VTexture.get(),
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			0,
-			VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-			VK_IMAGE_ASPECT_COLOR_BIT);
-		barrier.AddImage(
-			BloomBlurLevels[level].HTexture.get(),
+			BloomLevels[level].Texture.get(),
 			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			VK_IMAGE_LAYOUT_GENERAL,
 			0,
-			VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
 			VK_IMAGE_ASPECT_COLOR_BIT);
 	}
 
 	barrier.Execute(
 		renderer->Commands->GetDrawCommands(),
 		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT);
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 }
 
 SceneTextures::~SceneTextures()
 {
 }
 
+std::unique_ptr<VulkanImage> SceneTextures::CreateTransientAttachment(UVulkanRenderDevice* renderer, VkFormat format, VkImageUsageFlags usage, const char* debugName)
+{
+	// Tile based GPUs can keep these in tile memory and may never back them with real memory, as long as the scene pass doesn't store them
+	auto image = ImageBuilder()
+		.Size(Width, Height)
+		.Samples(SceneSamples)
+		.Format(format)
+		.Usage(usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED)
+		.DebugName(debugName)
+		.TryCreate(renderer->Device.get());
+
+	if (!image)
+	{
+		// No lazily allocated memory type on this device
+		image = ImageBuilder()
+			.Size(Width, Height)
+			.Samples(SceneSamples)
+			.Format(format)
+			.Usage(usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
+			.DebugName(debugName)
+			.Create(renderer->Device.get());
+	}
+	return image;
+}
+
+void SceneTextures::CreateHitBuffer(UVulkanRenderDevice* renderer)
+{
+	HitBuffer = ImageBuilder()
+		.Size(Width, Height)
+		.Samples(SceneSamples)
+		.Format(VK_FORMAT_R32_UINT)
+		.Usage(VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
+		.DebugName("hitBuffer")
+		.Create(renderer->Device.get());
+
+	HitBufferView = ImageViewBuilder()
+		.Image(HitBuffer.get(), VK_FORMAT_R32_UINT, VK_IMAGE_ASPECT_COLOR_BIT)
+		.DebugName("hitBufferView")
+		.Create(renderer->Device.get());
+}
+
+void SceneTextures::CreateFusedPresentImage(UVulkanRenderDevice* renderer, VkFormat format)
+{
+	if (FusedPresentImage)
+	{
+		auto deletelist = renderer->Commands->GetCurrentDeleteList();
+		deletelist->images.push_back(std::move(FusedPresentImage));
+		deletelist->imageViews.push_back(std::move(FusedPresentImageView));
+	}
+
+	FusedPresentFormat = format;
+
+	FusedPresentImage = ImageBuilder()
+		.Size(Width, Height)
+		.Samples(VK_SAMPLE_COUNT_1_BIT)
+		.Format(format)
+		.Usage(VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT)
+		.DebugName("FusedPresentImage")
+		.Create(renderer->Device.get());
+
+	FusedPresentImageView = ImageViewBuilder()
+		.Image(FusedPresentImage.get(), format, VK_IMAGE_ASPECT_COLOR_BIT)
+		.DebugName("FusedPresentImageView")
+		.Create(renderer->Device.get());
+}
+
+VkFormat SceneTextures::GetColorFormat(UVulkanRenderDevice* renderer)
+{
+	if (renderer->VkCompactSceneFormat)
+	{
+		// The bloom pass writes the post processing images and bloom levels from compute shaders, and screenshots blit from them
+		VkFormatFeatureFlags required =
+			VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BLEND_BIT |
+			VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT |
+			VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+
+		VkFormatProperties properties = {};
+		vkGetPhysicalDeviceFormatProperties(renderer->Device->PhysicalDevice.Device, VK_FORMAT_B10G11R11_UFLOAT_PACK32, &properties);
+		if ((properties.optimalTilingFeatures & required) == required)
+		{
+			debugf(TEXT("Vulkan: using B10G11R11 scene color format"));
+			return VK_FORMAT_B10G11R11_UFLOAT_PACK32;
+		}
+
+		debugf(TEXT("Vulkan: device does not support B10G11R11 for the scene, using RGBA16F"));
+	}
+	return VK_FORMAT_R16G16B16A16_SFLOAT;
+}
+
 VkSampleCountFlagBits SceneTextures::GetBestSampleCount(VulkanDevice* device, int multisample)
 {
 	const auto& limits = device->PhysicalDevice.Properties.Properties.limits;
@@ -17,11 +17,14 @@ public:
 	// Current active multisample setting
 	VkSampleCountFlagBits SceneSamples = VK_SAMPLE_COUNT_1_BIT;
 
-	// Scene framebuffer color image
+	// Format of the scene color buffer, the post processing images and the bloom levels
+	VkFormat ColorFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+	// Scene framebuffer color image. Transient when multisampled.
 	std::unique_ptr<VulkanImage> ColorBuffer;
 	std::unique_ptr<VulkanImageView> ColorBufferView;
 
-	// Scene framebuffer hit results
+	// Scene framebuffer hit results. Created by the first frame that hit tests.
 	std::unique_ptr<VulkanImage> HitBuffer;
 	std::unique_ptr<VulkanImageView> HitBufferView;
 
@@ -33,26 +36,45 @@ public:
 	std::unique_ptr<VulkanImage> PPImage[2];
 	std::unique_ptr<VulkanImageView> PPImageView[2];
 
-	// Texture and buffer used to download the hitbuffer
-	std::unique_ptr<VulkanImage> PPHitBuffer;
-	std::unique_ptr<VulkanBuffer> StagingHitBuffer;
+	// The hit index found by the hit buffer reduction pass, read back by the CPU
+	std::unique_ptr<VulkanBuffer> HitResultBuffer;
 
 	// Size of the scene framebuffer
 	int Width = 0;
 	int Height = 0;
+
+	// Part of the images the scene is rendered into this frame, starting at the top left corner
+	int RenderWidth = 0;
+	int RenderHeight = 0;
+
 	int Multisample = 0;
 
-	// Bloom post processing buffers
+	// Bloom pyramid, written by compute shaders and always in the general layout
 	struct
 	{
-		std::unique_ptr<VulkanImage> VTexture;
-		std::unique_ptr<VulkanImageView> VTextureView;
-		std::unique_ptr<VulkanImage> HTexture;
-		std::unique_ptr<VulkanImageView> HTextureView;
+		std::unique_ptr<VulkanImage> Texture;
+		std::unique_ptr<VulkanImageView> TextureView;
 		int Width = 0;
 		int Height = 0;
-	} BloomBlurLevels[NumBloomLevels];
+	} BloomLevels[NumBloomLevels];
+
+	// Output of the fused present pass. Created on first use, as the format follows the swap chain.
+	std::unique_ptr<VulkanImage> FusedPresentImage;
+	std::unique_ptr<VulkanImageView> FusedPresentImageView;
+	VkFormat FusedPresentFormat = VK_FORMAT_UNDEFINED;
+
+	void CreateFusedPresentImage(UVulkanRenderDevice* renderer, VkFormat format);
+	void CreateHitBuffer(UVulkanRenderDevice* renderer);
+
+	// The single sampled scene image that post processing reads. The scene pass resolves a multisampled scene into PPImage[0].
+	VulkanImage* GetResolvedImage() { return SceneSamples != VK_SAMPLE_COUNT_1_BIT ? PPImage[0].get() : ColorBuffer.get(); }
+	VulkanImageView* GetResolvedView() { return SceneSamples != VK_SAMPLE_COUNT_1_BIT ? PPImageView[0].get() : ColorBufferView.get(); }
+
+	// Picks the scene color format from VkCompactSceneFormat and what the device supports. Shaders and pipelines are built for it once at startup.
+	static VkFormat GetColorFormat(UVulkanRenderDevice* renderer);
 
 private:
+	std::unique_ptr<VulkanImage> CreateTransientAttachment(UVulkanRenderDevice* renderer, VkFormat format, VkImageUsageFlags usage, const char* debugName);
+
 	static VkSampleCountFlagBits GetBestSampleCount(VulkanDevice* device, int multisample);
 };
@@ -3,34 +3,29 @@
 #include "ShaderManager.h"
 #include "FileResource.h"
 #include "UVulkanRenderDevice.h"
+#include "ParallelFor.h"
+#include "CacheHash.h"
+
+static const TCHAR* ShaderCacheFilename = TEXT("VulkanDrvShaderCache.bin");
 
 ShaderManager::ShaderManager(UVulkanRenderDevice* renderer) : renderer(renderer)
 {
+	double startTime = appSeconds();
+
 	ShaderBuilder::Init();
+	LoadSpirvCache();
+
+	AddShader(&Scene.VertexShader, ShaderType::Vertex, "shaders/Scene.vert", LoadShaderCode("shaders/Scene.vert", "#extension GL_EXT_nonuniform_qualifier : enable\r\n"), "vertexShader");
+
+	AddShader(&Scene.FragmentShader, ShaderType::Fragment, "shaders/Scene.frag", LoadShaderCode("shaders/Scene.frag", "#extension GL_EXT_nonuniform_qualifier : enable\r\n#"), "fragmentShader");
+
+	AddShader(&Scene.FragmentShaderAlphaTest, ShaderType::Fragment, "shaders/Scene.frag", LoadShaderCode("shaders/Scene.frag", "#extension GL_EXT_nonuniform_qualifier : enable\r\n#define ALPHATEST"), "fragmentShader");
 
-	Scene.VertexShader = ShaderBuilder()
-		.Type(ShaderType::Vertex)
-		.AddSource("shaders/Scene.vert", LoadShaderCode("shaders/Scene.vert", "#extension GL_EXT_nonuniform_qualifier : enable\r\n"))
-		.DebugName("vertexShader")
-		.Create("vertexShader", renderer->Device.get());
-
-	Scene.FragmentShader = ShaderBuilder()
-		.Type(ShaderType::Fragment)
-		.AddSource("shaders/Scene.frag", LoadShaderCode("shaders/Scene.frag", "#extension GL_EXT_nonuniform_qualifier : enable\r\n#"))
-		.DebugName("fragmentShader")
-		.Create("fragmentShader", renderer->Device.get());
-
-	Scene.FragmentShaderAlphaTest = ShaderBuilder()
-		.Type(ShaderType::Fragment)
-		.AddSource("shaders/Scene.frag", LoadShaderCode("shaders/Scene.frag", "#extension GL_EXT_nonuniform_qualifier : enable\r\n#define ALPHATEST"))
-		.DebugName("fragmentShader")
-		.Create("fragmentShader", renderer->Device.get());
-
-	Postprocess.VertexShader = ShaderBuilder()
-		.Type(ShaderType::Vertex)
-		.AddSource("shaders/PPStep.vert", LoadShaderCode("shaders/PPStep.vert"))
-		.DebugName("ppVertexShader")
-		.Create("ppVertexShader", renderer->Device.get());
+	AddShader(&Scene.FragmentShaderNoHit, ShaderType::Fragment, "shaders/Scene.frag", LoadShaderCode("shaders/Scene.frag", "#extension GL_EXT_nonuniform_qualifier : enable\r\n#define NOHIT"), "fragmentShader");
+
+	AddShader(&Scene.FragmentShaderAlphaTestNoHit, ShaderType::Fragment, "shaders/Scene.frag", LoadShaderCode("shaders/Scene.frag", "#extension GL_EXT_nonuniform_qualifier : enable\r\n#define ALPHATEST\r\n#define NOHIT"), "fragmentShader");
+
+	AddShader(&Postprocess.VertexShader, ShaderType::Vertex, "shaders/PPStep.vert", LoadShaderCode("shaders/PPStep.vert"), "ppVertexShader");
 
 	static const char* transferFunctions[2] = { nullptr, "HDR_MODE" };
 	static const char* gammaModes[2] = { "GAMMA_MODE_D3D9", "GAMMA_MODE_XOPENGL" };
@@ -42,36 +37,40 @@ ShaderManager::ShaderManager(UVulkanRenderDevice* renderer) : renderer(renderer)
 		if (gammaModes[(i >> 1) & 1]) defines += std::string("#define ") + gammaModes[(i >> 1) & 1] + "\r\n";
 		if (colorModes[(i >> 2) & 3]) defines += std::string("#define ") + colorModes[(i >> 2) & 3] + "\r\n";
 
-		Postprocess.FragmentPresentShader[i] = ShaderBuilder()
-			.Type(ShaderType::Fragment)
-			.AddSource("shaders/Present.frag", LoadShaderCode("shaders/Present.frag", defines))
-			.DebugName("ppFragmentPresentShader")
-			.Create("ppFragmentPresentShader", renderer->Device.get());
+		AddShader(&Postprocess.FragmentPresentShader[i], ShaderType::Fragment, "shaders/Present.frag", LoadShaderCode("shaders/Present.frag", defines), "ppFragmentPresentShader");
+
+		if (renderer->VkUpscaler == 1)
+		{
+			AddShader(&Postprocess.FragmentPresentUpscaleShader[i], ShaderType::Fragment, "shaders/Present.frag", LoadShaderCode("shaders/Present.frag", defines + "#define UPSCALE\r\n"), "ppFragmentPresentUpscaleShader");
+		}
+
+		if (renderer->VkFusedPresent)
+		{
+			AddShader(&FusedPresent.Shader[i], ShaderType::Compute, "shaders/FusedPresent.comp", LoadShaderCode("shaders/FusedPresent.comp", defines), "FusedPresentShader");
+		}
 	}
 
-	Bloom.Extract = ShaderBuilder()
-		.Type(ShaderType::Fragment)
-		.AddSource("shaders/BloomExtract.frag", LoadShaderCode("shaders/BloomExtract.frag"))
-		.DebugName("BloomPass.Extract")
-		.Create("BloomPass.Extract", renderer->Device.get());
-
-	Bloom.Combine = ShaderBuilder()
-		.Type(ShaderType::Fragment)
-		.AddSource("shaders/BloomCombine.frag", LoadShaderCode("shaders/BloomCombine.frag"))
-		.DebugName("BloomPass.Combine")
-		.Create("BloomPass.Combine", renderer->Device.get());
-
-	Bloom.BlurVertical = ShaderBuilder()
-		.Type(ShaderType::Fragment)
-		.AddSource("shaders/BlurVertical.frag", LoadShaderCode("shaders/Blur.frag", "#define BLUR_VERTICAL"))
-		.DebugName("BloomPass.BlurVertical")
-		.Create("BloomPass.BlurVertical", renderer->Device.get());
-
-	Bloom.BlurHorizontal = ShaderBuilder()
-		.Type(ShaderType::Fragment)
-		.AddSource("shaders/BlurHorizontal.frag", LoadShaderCode("shaders/Blur.frag", "#define BLUR_HORIZONTAL"))
-		.DebugName("BloomPass.BlurHorizontal")
-		.Create("BloomPass.BlurHorizontal", renderer->Device.get());
+	// The bloom shaders write the bloom levels and the post processing image as storage images, which must name their format
+	std::string sceneFormat = renderer->Textures->SceneColorFormat == VK_FORMAT_B10G11R11_UFLOAT_PACK32 ? "#define SCENE_FORMAT r11f_g11f_b10f\r\n" : "#define SCENE_FORMAT rgba16f\r\n";
+
+	AddShader(&Bloom.Downsample, ShaderType::Compute, "shaders/BloomDownsample.comp", LoadShaderCode("shaders/BloomDownsample.comp", sceneFormat), "BloomPass.Downsample");
+
+	AddShader(&Bloom.BlurDownsample, ShaderType::Compute, "shaders/BloomBlurDownsample.comp", LoadShaderCode("shaders/BloomUpsample.comp", sceneFormat + "#define DOWNSAMPLE"), "BloomPass.BlurDownsample");
+
+	AddShader(&Bloom.Upsample, ShaderType::Compute, "shaders/BloomUpsample.comp", LoadShaderCode("shaders/BloomUpsample.comp", sceneFormat), "BloomPass.Upsample");
+
+	AddShader(&Bloom.UpsampleCombine, ShaderType::Compute, "shaders/BloomUpsampleCombine.comp", LoadShaderCode("shaders/BloomUpsample.comp", sceneFormat + "#define COMBINE"), "BloomPass.UpsampleCombine");
+
+	AddShader(&HitReduce.Shader, ShaderType::Compute, "shaders/HitReduce.comp", LoadShaderCode("shaders/HitReduce.comp"), "HitReduce");
+
+	AddShader(&HitReduce.ShaderMultisample, ShaderType::Compute, "shaders/HitReduceMultisample.comp", LoadShaderCode("shaders/HitReduce.comp", "#define MULTISAMPLE"), "HitReduceMultisample");
+
+	CreateShaders();
+
+	if (SpirvCacheChanged)
+		SaveSpirvCache();
+
+	debugf(TEXT("Vulkan shaders created in %.1f ms (%d from SPIR-V cache, %d compiled)"), (appSeconds() - startTime) * 1000.0, SpirvCacheHits, SpirvCacheMisses);
 }
 
 ShaderManager::~ShaderManager()
@@ -85,5 +84,220 @@ std::string ShaderManager::LoadShaderCode(const std::string& filename, const std
 		#version 450
 		#extension GL_ARB_separate_shader_objects : enable
 	)";
-	return shaderversion + defines + "\r\n#line 1\r\n" + FileResource::readAllText(filename);
+	return shaderversion + defines + "\r\n#line 1\r\n" + ExpandIncludes(FileResource::readAllText(filename));
+}
+
+std::string ShaderManager::ExpandIncludes(const std::string& code)
+{
+	// Included files are pasted in here rather than through glslang's includer, so that the SPIR-V cache key covers them too
+	std::string result;
+	int line = 1;
+	size_t pos = 0;
+	while (pos < code.size())
+	{
+		size_t end = code.find('\n', pos);
+		end = (end == std::string::npos) ? code.size() : end + 1;
+
+		size_t start = code.find_first_not_of(" \t", pos);
+		if (start < end && code.compare(start, 10, "#include \"") == 0)
+		{
+			size_t nameEnd = code.find('"', start + 10);
+			if (nameEnd >= end)
+				VulkanError("Malformed #include in shader code");
+			result += ExpandIncludes(FileResource::readAllText(code.substr(start + 10, nameEnd - start - 10)));
+			result += "\r\n#line " + std::to_string(line + 1) + "\r\n";
+		}
+		else
+		{
+			result.append(code, pos, end - pos);
+		}
+
+		pos = end;
+		line++;
+	}
+	return result;
+}
+
+void ShaderManager::AddShader(std::unique_ptr<VulkanShader>* shader, ShaderType type, const char* sourceName, const std::string& code, const char* name)
+{
+	ShaderRequest request;
+	request.Shader = shader;
+	request.Type = type;
+	request.SourceName = sourceName;
+	request.Code = code;
+	request.Name = name;
+	request.Key = GetSpirvCacheKey(type, code);
+	Requests.push_back(std::move(request));
+}
+
+void ShaderManager::CreateShaders()
+{
+	std::vector<ShaderRequest*> misses;
+	for (ShaderRequest& request : Requests)
+	{
+		auto it = SpirvCache.find(request.Key);
+		if (it != SpirvCache.end())
+		{
+			try
+			{
+				*request.Shader = ShaderBuilder()
+					.Type(request.Type)
+					.SpirvCode(it->second)
+					.DebugName(request.Name)
+					.Create(request.Name, renderer->Device.get());
+				SpirvCacheHits++;
+				continue;
+			}
+			catch (const std::exception&)
+			{
+				// The driver rejected the cached code. Compile it again instead.
+				SpirvCache.erase(it);
+			}
+		}
+		misses.push_back(&request);
+	}
+
+	// glslang can compile independent shaders concurrently
+	ParallelFor((int)misses.size(), [&](int i)
+	{
+		ShaderRequest* request = misses[i];
+		request->Spirv = ShaderBuilder()
+			.Type(request->Type)
+			.AddSource(request->SourceName, request->Code)
+			.CompileSpirv(renderer->Device.get());
+	});
+
+	for (ShaderRequest* request : misses)
+	{
+		*request->Shader = ShaderBuilder()
+			.Type(request->Type)
+			.SpirvCode(request->Spirv)
+			.DebugName(request->Name)
+			.Create(request->Name, renderer->Device.get());
+
+		SpirvCache[request->Key] = std::move(request->Spirv);
+		SpirvCacheChanged = true;
+		SpirvCacheMisses++;
+	}
+
+	// Only what this run used is written back, so code for older versions or other settings doesn't pile up in the file
+	std::unordered_map<uint64_t, std::vector<uint32_t>> used;
+	for (ShaderRequest& request : Requests)
+	{
+		auto it = SpirvCache.find(request.Key);
+		if (it != SpirvCache.end() && used.find(request.Key) == used.end())
+			used[request.Key] = std::move(it->second);
+	}
+	if (used.size() != SpirvCache.size())
+		SpirvCacheChanged = true;
+	SpirvCache = std::move(used);
+
+	Requests.clear();
+}
+
+uint64_t ShaderManager::GetSpirvCacheKey(ShaderType type, const std::string& code)
+{
+	// The generated code depends on the compiler version and the Vulkan version glslang targets, besides the source itself
+	std::string key = ShaderBuilder::GetCompilerVersion();
+	key += renderer->Device->Instance->ApiVersion >= VK_API_VERSION_1_2 ? ";vulkan1.2;" : ";vulkan1.0;";
+	key += std::to_string((int)type);
+	key += ";";
+	key += code;
+	return HashCacheData((const uint8_t*)key.data(), key.size());
+}
+
+void ShaderManager::LoadSpirvCache()
+{
+	TArray<BYTE> file;
+	if (!appLoadFileToArray(file, ShaderCacheFilename))
+		return;
+
+	const uint8_t* data = file.Num() > 0 ? &file(0) : nullptr;
+	size_t size = file.Num();
+	size_t pos = 0;
+
+	SpirvCacheFileHeader header;
+	if (size < sizeof(SpirvCacheFileHeader))
+	{
+		debugf(TEXT("Vulkan shader cache is corrupt and will be rebuilt"));
+		SpirvCacheChanged = true;
+		return;
+	}
+	memcpy(&header, data, sizeof(SpirvCacheFileHeader));
+	pos += sizeof(SpirvCacheFileHeader);
+
+	if (header.Magic != SpirvCacheMagic || header.Version != SpirvCacheVersion)
+	{
+		debugf(TEXT("Vulkan shader cache is from another driver version and will be rebuilt"));
+		SpirvCacheChanged = true;
+		return;
+	}
+
+	for (uint32_t i = 0; i < header.EntryCount; i++)
+	{
+		SpirvCacheEntryHeader entry;
+		if (size - pos < sizeof(SpirvCacheEntryHeader))
+			break;
+		memcpy(&entry, data + pos, sizeof(SpirvCacheEntryHeader));
+		pos += sizeof(SpirvCacheEntryHeader);
+
+		size_t codeSize = (size_t)entry.WordCount * sizeof(uint32_t);
+		if (entry.WordCount == 0 || size - pos < codeSize)
+			break;
+
+		std::vector<uint32_t> spirv(entry.WordCount);
+		memcpy(spirv.data(), data + pos, codeSize);
+		pos += codeSize;
+
+		// Entries that don't hash right or don't start with the SPIR-V magic number are dropped and compiled again
+		if (entry.DataHash != HashCacheData((const uint8_t*)spirv.data(), codeSize) || spirv[0] != 0x07230203)
+		{
+			SpirvCacheChanged = true;
+			continue;
+		}
+
+		SpirvCache[entry.Key] = std::move(spirv);
+	}
+
+	if (SpirvCache.size() != header.EntryCount || pos != size)
+	{
+		debugf(TEXT("Vulkan shader cache is corrupt and will be partially rebuilt"));
+		SpirvCacheChanged = true;
+	}
+}
+
+void ShaderManager::SaveSpirvCache()
+{
+	size_t size = sizeof(SpirvCacheFileHeader);
+	for (const auto& it : SpirvCache)
+		size += sizeof(SpirvCacheEntryHeader) + it.second.size() * sizeof(uint32_t);
+
+	SpirvCacheFileHeader header = {};
+	header.Magic = SpirvCacheMagic;
+	header.Version = SpirvCacheVersion;
+	header.EntryCount = (uint32_t)SpirvCache.size();
+
+	TArray<BYTE> file;
+	file.Add(size);
+	uint8_t* data = &file(0);
+	memcpy(data, &header, sizeof(SpirvCacheFileHeader));
+	size_t pos = sizeof(SpirvCacheFileHeader);
+
+	for (const auto& it : SpirvCache)
+	{
+		size_t codeSize = it.second.size() * sizeof(uint32_t);
+
+		SpirvCacheEntryHeader entry = {};
+		entry.Key = it.first;
+		entry.DataHash = HashCacheData((const uint8_t*)it.second.data(), codeSize);
+		entry.WordCount = (uint32_t)it.second.size();
+		memcpy(data + pos, &entry, sizeof(SpirvCacheEntryHeader));
+		pos += sizeof(SpirvCacheEntryHeader);
+
+		memcpy(data + pos, it.second.data(), codeSize);
+		pos += codeSize;
+	}
+
+	appSaveArrayToFile(file, ShaderCacheFilename);
+	SpirvCacheChanged = false;
 }
@@ -31,6 +31,8 @@ struct PresentPushConstants
 	float Brightness;
 	float HdrScale;
 	vec4 GammaCorrection;
+	vec2 SourceScale;
+	float Sharpness;
 };
 
 struct BloomPushConstants
@@ -38,6 +40,26 @@ struct BloomPushConstants
 	float SampleWeights[8];
 };
 
+struct BloomDownsamplePushConstants
+{
+	int32_t SourceWidth;
+	int32_t SourceHeight;
+};
+
+struct HitReducePushConstants
+{
+	int32_t HitX;
+	int32_t HitY;
+	int32_t HitWidth;
+	int32_t HitHeight;
+};
+
+struct FusedPresentPushConstants
+{
+	PresentPushConstants Present;
+	BloomPushConstants Bloom;
+};
+
 class ShaderManager
 {
 public:
@@ -49,24 +71,88 @@ public:
 		std::unique_ptr<VulkanShader> VertexShader;
 		std::unique_ptr<VulkanShader> FragmentShader;
 		std::unique_ptr<VulkanShader> FragmentShaderAlphaTest;
+
+		// For frames without hit testing, where the scene pass has no hit buffer attachment
+		std::unique_ptr<VulkanShader> FragmentShaderNoHit;
+		std::unique_ptr<VulkanShader> FragmentShaderAlphaTestNoHit;
 	} Scene;
 
 	struct
 	{
 		std::unique_ptr<VulkanShader> VertexShader;
 		std::unique_ptr<VulkanShader> FragmentPresentShader[16];
+
+		// Only compiled when VkUpscaler selects the edge adaptive upscaler
+		std::unique_ptr<VulkanShader> FragmentPresentUpscaleShader[16];
 	} Postprocess;
 
 	struct
 	{
-		std::unique_ptr<VulkanShader> Extract;
-		std::unique_ptr<VulkanShader> Combine;
-		std::unique_ptr<VulkanShader> BlurVertical;
-		std::unique_ptr<VulkanShader> BlurHorizontal;
+		std::unique_ptr<VulkanShader> Downsample;
+		std::unique_ptr<VulkanShader> BlurDownsample;
+		std::unique_ptr<VulkanShader> Upsample;
+		std::unique_ptr<VulkanShader> UpsampleCombine;
 	} Bloom;
 
+	struct
+	{
+		std::unique_ptr<VulkanShader> Shader;
+		std::unique_ptr<VulkanShader> ShaderMultisample;
+	} HitReduce;
+
+	// Only compiled when VkFusedPresent is on. Indexed like FragmentPresentShader.
+	struct
+	{
+		std::unique_ptr<VulkanShader> Shader[16];
+	} FusedPresent;
+
 	static std::string LoadShaderCode(const std::string& filename, const std::string& defines = {});
 
 private:
+	static std::string ExpandIncludes(const std::string& code);
+	void AddShader(std::unique_ptr<VulkanShader>* shader, ShaderType type, const char* sourceName, const std::string& code, const char* name);
+	void CreateShaders();
+
+	struct ShaderRequest
+	{
+		std::unique_ptr<VulkanShader>* Shader = nullptr;
+		ShaderType Type = ShaderType::Vertex;
+		const char* SourceName = nullptr;
+		std::string Code;
+		const char* Name = nullptr;
+		uint64_t Key = 0;
+		std::vector<uint32_t> Spirv;
+	};
+	std::vector<ShaderRequest> Requests;
+
+	// Compiled SPIR-V is kept on disk so that later runs can skip glslang entirely
+	uint64_t GetSpirvCacheKey(ShaderType type, const std::string& code);
+	void LoadSpirvCache();
+	void SaveSpirvCache();
+
+	struct SpirvCacheFileHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t EntryCount;
+		uint32_t Padding;
+	};
+
+	struct SpirvCacheEntryHeader
+	{
+		uint64_t Key;
+		uint64_t DataHash;
+		uint32_t WordCount;
+		uint32_t Padding;
+	};
+
+	static const uint32_t SpirvCacheMagic = 0x43535256; // VRSC
+	static const uint32_t SpirvCacheVersion = 1;
+
+	std::unordered_map<uint64_t, std::vector<uint32_t>> SpirvCache;
+	bool SpirvCacheChanged = false;
+	int SpirvCacheHits = 0;
+	int SpirvCacheMisses = 0;
+
 	UVulkanRenderDevice* renderer = nullptr;
 };
@@ -0,0 +1,135 @@
+
+#include "Precomp.h"
+#include "TextureArrayPool.h"
+#include "UVulkanRenderDevice.h"
+#include "CachedTexture.h"
+
+TextureArrayPool::TextureArrayPool(UVulkanRenderDevice* renderer) : renderer(renderer)
+{
+	LayerLimit = std::min((int)renderer->Device->PhysicalDevice.Properties.Properties.limits.maxImageArrayLayers, (int)MaxLayers);
+}
+
+TextureArrayPool::~TextureArrayPool()
+{
+}
+
+bool TextureArrayPool::Allocate(CachedTexture* tex, const FTextureInfo& Info)
+{
+	// Realtime textures keep their own image so that they can use the dirty row uploads
+	if (Info.bRealtime || Info.NumMips < 1 || LayerLimit < 2)
+		return false;
+
+	TextureUploader* uploader = TextureUploader::GetUploader(Info.Format);
+	if (!uploader)
+		return false;
+
+	uint32_t maxSize = renderer->Device->PhysicalDevice.Properties.Properties.limits.maxImageDimension2D;
+	if (Info.USize <= 0 || Info.VSize <= 0 || (uint32_t)Info.USize > maxSize || (uint32_t)Info.VSize > maxSize)
+		return false;
+
+	int layerSize = 0;
+	for (INT level = 0; level < Info.NumMips; level++)
+	{
+		FMipmapBase* Mip = Info.Mips[level];
+		layerSize += uploader->GetUploadSize(0, 0, Mip->USize, Mip->VSize);
+		if (layerSize > MaxLayerSize)
+			return false;
+	}
+
+	SizeClass sizeClass;
+	sizeClass.Format = uploader->GetVkFormat();
+	sizeClass.Width = Info.USize;
+	sizeClass.Height = Info.VSize;
+	sizeClass.MipCount = Info.NumMips;
+
+	TextureArray* array = nullptr;
+	for (auto& it : Arrays[sizeClass])
+	{
+		if (!it->FreeLayers.empty())
+		{
+			array = it.get();
+			break;
+		}
+	}
+
+	if (!array)
+		array = CreateArray(sizeClass, layerSize);
+
+	tex->ArrayTexture = array->Texture.get();
+	tex->ArrayLayer = array->FreeLayers.back();
+	array->FreeLayers.pop_back();
+	return true;
+}
+
+void TextureArrayPool::Free(CachedTexture* tex)
+{
+	if (!tex->ArrayTexture)
+		return;
+
+	for (auto& sizeClass : Arrays)
+	{
+		for (auto& array : sizeClass.second)
+		{
+			if (array->Texture.get() == tex->ArrayTexture)
+			{
+				array->FreeLayers.push_back(tex->ArrayLayer);
+				break;
+			}
+		}
+	}
+
+	tex->ArrayTexture = nullptr;
+	tex->ArrayLayer = 0;
+}
+
+void TextureArrayPool::Clear()
+{
+	Arrays.clear();
+	ArrayCount = 0;
+}
+
+void TextureArrayPool::ClearAllBindlessIndexes()
+{
+	for (auto& sizeClass : Arrays)
+	{
+		for (auto& array : sizeClass.second)
+		{
+			array->Texture->BindlessIndex = -1;
+		}
+	}
+}
+
+TextureArrayPool::TextureArray* TextureArrayPool::CreateArray(const SizeClass& sizeClass, int layerSize)
+{
+	auto& arrays = Arrays[sizeClass];
+
+	// Most size classes only ever hold a handful of textures. Start with a small array and make each further array
+	// of the same size class twice as large as the last one. That keeps about half of the allocated layers in use at worst.
+	int maxLayers = std::max(std::min(MaxArraySize / std::max(layerSize, 1), LayerLimit), 1);
+	int layers = std::min(arrays.empty() ? (int)MinLayers : arrays.back()->LayerCount * 2, maxLayers);
+
+	auto array = std::make_unique<TextureArray>();
+	array->LayerCount = layers;
+	array->Texture.reset(new CachedTexture());
+
+	array->Texture->image = ImageBuilder()
+		.Format(sizeClass.Format)
+		.Size(sizeClass.Width, sizeClass.Height, sizeClass.MipCount, layers)
+		.Usage(VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT)
+		.DebugName("TextureArrayPool.Image")
+		.Create(renderer->Device.get());
+
+	array->Texture->imageView = ImageViewBuilder()
+		.Type(VK_IMAGE_VIEW_TYPE_2D_ARRAY)
+		.Image(array->Texture->image.get(), sizeClass.Format)
+		.DebugName("TextureArrayPool.ImageView")
+		.Create(renderer->Device.get());
+
+	// Hand out the lowest layers first
+	for (int i = layers - 1; i >= 0; i--)
+		array->FreeLayers.push_back(i);
+
+	arrays.push_back(std::move(array));
+	ArrayCount++;
+	return arrays.back().get();
+}
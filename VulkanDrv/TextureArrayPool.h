@@ -0,0 +1,61 @@
+#pragma once
+
+class UVulkanRenderDevice;
+class CachedTexture;
+struct FTextureInfo;
+
+// Places textures of identical size, format and mip count into layers of shared 2D array images
+class TextureArrayPool
+{
+public:
+	TextureArrayPool(UVulkanRenderDevice* renderer);
+	~TextureArrayPool();
+
+	bool Allocate(CachedTexture* tex, const FTextureInfo& Info);
+	void Free(CachedTexture* tex);
+
+	void Clear();
+	void ClearAllBindlessIndexes();
+
+	int GetArrayCount() const { return ArrayCount; }
+
+	static const int MaxLayerSize = 1024 * 1024;
+	static const int MaxArraySize = 16 * 1024 * 1024;
+	static const int MaxLayers = 256;
+	static const int MinLayers = 4;
+
+private:
+	struct SizeClass
+	{
+		VkFormat Format;
+		int Width;
+		int Height;
+		int MipCount;
+
+		bool operator<(const SizeClass& other) const
+		{
+			if (Format != other.Format)
+				return Format < other.Format;
+			else if (Width != other.Width)
+				return Width < other.Width;
+			else if (Height != other.Height)
+				return Height < other.Height;
+			else
+				return MipCount < other.MipCount;
+		}
+	};
+
+	struct TextureArray
+	{
+		std::unique_ptr<CachedTexture> Texture;
+		std::vector<int> FreeLayers;
+		int LayerCount = 0;
+	};
+
+	TextureArray* CreateArray(const SizeClass& sizeClass, int layerSize);
+
+	UVulkanRenderDevice* renderer = nullptr;
+	std::map<SizeClass, std::vector<std::unique_ptr<TextureArray>>> Arrays;
+	int ArrayCount = 0;
+	int LayerLimit = MaxLayers;
+};
@@ -6,21 +6,38 @@
 
 TextureManager::TextureManager(UVulkanRenderDevice* renderer) : renderer(renderer)
 {
+	Images.reset(new ImagePool(renderer));
+	SceneColorFormat = SceneTextures::GetColorFormat(renderer);
+
 	CreateNullTexture();
 	CreateDitherTexture();
+
+	if (renderer->VkLightmapAtlas)
+		Atlas.reset(new LightmapAtlas(renderer));
+
+	if (renderer->VkTextureArrays)
+		Arrays.reset(new TextureArrayPool(renderer));
 }
 
 TextureManager::~TextureManager()
 {
+	EndDefragment();
 }
 
 void TextureManager::UpdateTextureRect(FTextureInfo* info, int x, int y, int w, int h)
 {
 	std::unique_ptr<CachedTexture>& tex = TextureCache[0][info->CacheID];
-	if (tex)
+	if (tex && tex->AtlasPage)
+	{
+		Atlas->Update(tex.get(), *info);
+		info->bRealtimeChanged = 0;
+		tex->ContentHash = 0;
+	}
+	else if (tex && (tex->image || tex->ArrayTexture))
 	{
 		renderer->Uploads->UploadTextureRect(tex.get(), *info, x, y, w, h);
 		info->bRealtimeChanged = 0;
+		tex->ContentHash = 0;
 	}
 }
 
@@ -35,33 +52,443 @@ CachedTexture* TextureManager::GetTexture(FTextureInfo* info, bool masked)
 	std::unique_ptr<CachedTexture>& tex = TextureCache[(int)masked][info->CacheID];
 	if (!tex)
 	{
+		bool loaded = LoadTexture(info);
 		tex.reset(new CachedTexture());
-		renderer->Uploads->UploadTexture(tex.get(), *info, masked);
+		tex->ContentHash = GetContentHash(*info);
+		if (Arrays)
+			Arrays->Allocate(tex.get(), *info);
+		renderer->Uploads->UploadTexture(tex.get(), *info, masked, !loaded);
+		if (loaded)
+			UnloadTexture(info);
+	}
+	else if (tex->NeedsRevalidate)
+	{
+		RevalidateTexture(info, tex.get(), masked);
+	}
+	else if (CheckRealtimeChanged(info, tex.get()))
+	{
+		tex->ContentHash = 0;
+		renderer->Uploads->UploadRealtimeTexture(tex.get(), *info, masked);
+	}
+	else if (tex->WantedMip < tex->ResidentMip)
+	{
+		StreamTexture(info, tex.get(), masked);
+	}
+	return tex.get();
+}
+
+CachedTexture* TextureManager::GetLightmap(FTextureInfo* info)
+{
+	if (!info)
+		return nullptr;
+
+	if (!Atlas || !Atlas->CanInsert(*info))
+		return GetTexture(info, false);
+
+	bool loaded = false;
+	std::unique_ptr<CachedTexture>& tex = TextureCache[0][info->CacheID];
+	if (!tex)
+	{
+		loaded = LoadTexture(info);
+		tex.reset(new CachedTexture());
+		tex->ContentHash = GetContentHash(*info);
+	}
+	else if (tex->NeedsRevalidate)
+	{
+		RevalidateTexture(info, tex.get(), false);
+	}
+
+	if (tex->image || tex->ArrayTexture) // Didn't fit in the atlas when it was first seen
+	{
+		if (CheckRealtimeChanged(info, tex.get()))
+		{
+			tex->ContentHash = 0;
+			renderer->Uploads->UploadRealtimeTexture(tex.get(), *info, false);
+		}
+	}
+	else if (!tex->AtlasPage) // New or evicted
+	{
+		CheckRealtimeChanged(info, tex.get());
+		if (!Atlas->Insert(tex.get(), *info))
+		{
+			if (Arrays)
+				Arrays->Allocate(tex.get(), *info);
+			renderer->Uploads->UploadTexture(tex.get(), *info, false, !loaded);
+		}
+	}
+	else
+	{
+		if (CheckRealtimeChanged(info, tex.get()))
+		{
+			tex->ContentHash = 0;
+			Atlas->Update(tex.get(), *info);
+		}
+		Atlas->MarkUsed(tex.get());
+	}
+
+	if (loaded)
+		UnloadTexture(info);
+	return tex.get();
+}
+
+void TextureManager::RevalidateTexture(FTextureInfo* info, CachedTexture* tex, bool masked)
+{
+	// Keep what is on the GPU if the texture is unchanged since the cache was flushed
+	tex->NeedsRevalidate = false;
+	bool loaded = LoadTexture(info);
+	bool changed = CheckRealtimeChanged(info, tex);
+	uint64_t hash = GetContentHash(*info);
+	if (changed || hash == 0 || hash != tex->ContentHash)
+	{
+		tex->ContentHash = hash;
+		tex->RealtimeShadow.clear();
+		if (tex->AtlasPage)
+			Atlas->Update(tex, *info);
+		else if (tex->image || tex->ArrayTexture)
+			renderer->Uploads->UploadTexture(tex, *info, masked, !loaded);
+	}
+
+	if (loaded)
+		UnloadTexture(info);
+}
+
+void TextureManager::StreamTexture(FTextureInfo* info, CachedTexture* tex, bool masked)
+{
+	// One mip per use and a per frame budget, so a texture reaching full size is spread over several frames
+	if (StreamedBytes >= StreamingBudget)
+		return;
+
+	INT level = tex->ResidentMip - 1;
+	bool loaded = false;
+#if !defined(OLDUNREAL469SDK)
+	if (level < info->NumMips && info->Mips[level] && !info->Mips[level]->DataPtr)
+	{
+		info->Load();
+		loaded = true;
+	}
+#endif
+
+	StreamedBytes += renderer->Uploads->UploadMip(tex, *info, masked, level, !loaded);
+
+	if (loaded)
+		UnloadTexture(info);
+}
+
+void TextureManager::RequestMip(CachedTexture* tex, float texelsPerPixel)
+{
+	int level = 0;
+	while (texelsPerPixel >= 2.0f && level < tex->WantedMip)
+	{
+		texelsPerPixel *= 0.5f;
+		level++;
+	}
+	tex->WantedMip = level;
+}
+
+bool TextureManager::LoadTexture(FTextureInfo* info)
+{
+	// With SupportsLazyTextures the engine leaves it to us to load the mip data of textures we actually use.
+	// Returns true if we loaded it, in which case it is unloaded again right after the upload. Its mips are then copied
+	// into the upload buffer, as the GPU would otherwise read them after they were freed.
+#if !defined(OLDUNREAL469SDK)
+	for (INT level = 0; level < info->NumMips; level++)
+	{
+		if (info->Mips[level] && !info->Mips[level]->DataPtr)
+		{
+			info->Load();
+			return true;
+		}
+	}
+#endif
+	return false;
+}
+
+void TextureManager::UnloadTexture(FTextureInfo* info)
+{
+#if !defined(OLDUNREAL469SDK)
+	info->Unload();
+#endif
+}
+
+void TextureManager::NextFrame()
+{
+	StreamedBytes = 0;
+
+	if (Atlas)
+		Atlas->NextFrame();
+}
+
+uint64_t TextureManager::GetContentHash(const FTextureInfo& info)
+{
+	// Zero means there is no hash and the texture always gets uploaded again after a flush
+	if (!renderer->VkKeepTexturesOnFlush || info.bRealtime || info.NumMips < 1 || !info.Mips[0] || !info.Mips[0]->DataPtr)
+		return 0;
+
+	TextureUploader* uploader = TextureUploader::GetUploader(info.Format);
+	if (!uploader)
+		return 0;
+
+	const uint64_t prime = 0x100000001b3ULL;
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	auto mix = [&](uint64_t value)
+	{
+		hash = (hash ^ value) * prime;
+		hash ^= hash >> 29;
+	};
+
+	mix(info.Format);
+	mix(info.NumMips);
+	for (INT level = 0; level < info.NumMips; level++)
+	{
+		mix(info.Mips[level]->USize);
+		mix(info.Mips[level]->VSize);
+	}
+
+	FMipmapBase* Mip = info.Mips[0];
+	const uint8_t* data = (const uint8_t*)Mip->DataPtr;
+	size_t size = uploader->GetSourceSize(Mip->USize, Mip->VSize);
+	size_t pos = 0;
+	for (; pos + 8 <= size; pos += 8)
+	{
+		uint64_t value;
+		memcpy(&value, data + pos, 8);
+		mix(value);
 	}
+	for (; pos < size; pos++)
+		mix(data[pos]);
+
+	if (info.Format == TEXF_P8 && info.Palette)
+	{
+		const uint32_t* palette = (const uint32_t*)info.Palette;
+		for (int i = 0; i < 256; i++)
+			mix(palette[i]);
+	}
+
+	return hash != 0 ? hash : 1;
+}
+
+bool TextureManager::CheckRealtimeChanged(FTextureInfo* info, CachedTexture* tex)
+{
 #if defined(OLDUNREAL469SDK)
-	else if (info->bRealtimeChanged && (!info->Texture || info->Texture->RealtimeChangeCount != tex->RealtimeChangeCount))
+	if (info->bRealtimeChanged && (!info->Texture || info->Texture->RealtimeChangeCount != tex->RealtimeChangeCount))
 	{
 		if (info->Texture)
 			tex->RealtimeChangeCount = info->Texture->RealtimeChangeCount;
 		info->bRealtimeChanged = 0;
-		renderer->Uploads->UploadTexture(tex.get(), *info, masked);
+		return true;
 	}
 #else
-	else if (info->bRealtimeChanged)
+	if (info->bRealtimeChanged)
 	{
 		info->bRealtimeChanged = 0;
-		renderer->Uploads->UploadTexture(tex.get(), *info, masked);
+		return true;
 	}
 #endif
-	return tex.get();
+	return false;
+}
+
+void TextureManager::RevalidateCache()
+{
+	// Textures not used since the previous flush are released, the rest are checked again on their next use
+	for (auto& cache : TextureCache)
+	{
+		for (auto it = cache.begin(); it != cache.end();)
+		{
+			CachedTexture* tex = it->second.get();
+			if (!tex || tex->NeedsRevalidate)
+			{
+				if (tex)
+					ReleaseTexture(tex);
+				it = cache.erase(it);
+			}
+			else
+			{
+				tex->NeedsRevalidate = true;
+				++it;
+			}
+		}
+	}
+
+	ClearAllBindlessIndexes();
+}
+
+void TextureManager::ReleaseTexture(CachedTexture* tex)
+{
+	if (tex->AtlasPage)
+		Atlas->Remove(tex);
+
+	if (tex->ArrayTexture)
+		Arrays->Free(tex);
+
+	if (tex->imageView)
+		renderer->Commands->GetCurrentDeleteList()->imageViews.push_back(std::move(tex->imageView));
+	Images->Release(std::move(tex->image));
+}
+
+void TextureManager::BeginDefragment()
+{
+	EndDefragment();
+
+	// Pool images are only freed while nothing on the GPU uses them
+	renderer->Commands->WaitForTransfer();
+	vkDeviceWaitIdle(renderer->Device->device);
+	renderer->Commands->DeleteFrameObjects();
+	Images->ReleaseUnused();
+
+	VmaDefragmentationInfo info = {};
+	info.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_FAST_BIT;
+	info.maxBytesPerPass = DefragmentBytesPerPass;
+
+	if (vmaBeginDefragmentation(renderer->Device->allocator, &info, &DefragContext) != VK_SUCCESS)
+		DefragContext = VK_NULL_HANDLE;
+	DefragMovedTextures = 0;
+}
+
+void TextureManager::DefragmentIdleFrame()
+{
+	// Frames that upload textures already have enough to do
+	if (!DefragContext || !renderer->Uploads->IsIdle())
+		return;
+
+	VmaAllocator allocator = renderer->Device->allocator;
+
+	VmaDefragmentationPassMoveInfo moves = {};
+	if (vmaBeginDefragmentationPass(allocator, DefragContext, &moves) == VK_SUCCESS)
+	{
+		EndDefragment();
+		return;
+	}
+
+	// Only standalone texture images are moved. Atlas pages, texture arrays and everything else stay where they are.
+	std::unordered_map<VmaAllocation, CachedTexture*> textures;
+	for (auto& cache : TextureCache)
+	{
+		for (auto& it : cache)
+		{
+			CachedTexture* tex = it.second.get();
+			if (tex && tex->image && tex->imageLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL && Images->GetFormat(tex->image.get()) != VK_FORMAT_UNDEFINED)
+				textures[tex->image->GetAllocation()] = tex;
+		}
+	}
+
+	auto cmdbuffer = renderer->Commands->GetTransferCommands();
+	std::vector<VkImage> oldImages;
+	for (uint32_t i = 0; i < moves.moveCount; i++)
+	{
+		VmaDefragmentationMove& move = moves.pMoves[i];
+		auto it = textures.find(move.srcAllocation);
+		if (it == textures.end() || !MoveTexture(it->second, move.dstTmpAllocation, cmdbuffer, oldImages))
+			move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+	}
+
+	// The copies wait for earlier frames to stop sampling the old images, so once they are done nothing uses them.
+	// This stalls the CPU for the previous frame and at most DefragmentBytesPerPass of copies.
+	renderer->Commands->WaitForTransfer();
+	for (VkImage image : oldImages)
+		vkDestroyImage(renderer->Device->device, image, nullptr);
+	DefragMovedTextures += (int)oldImages.size();
+
+	if (vmaEndDefragmentationPass(allocator, DefragContext, &moves) == VK_SUCCESS)
+		EndDefragment();
+}
+
+void TextureManager::EndDefragment()
+{
+	if (!DefragContext)
+		return;
+
+	VmaDefragmentationStats stats = {};
+	vmaEndDefragmentation(renderer->Device->allocator, DefragContext, &stats);
+	DefragContext = VK_NULL_HANDLE;
+
+	debugf(TEXT("VulkanDrv: defragmentation moved %d textures and freed %d KB in %d memory blocks"), DefragMovedTextures, (int)(stats.bytesFreed / 1024), (int)stats.deviceMemoryBlocksFreed);
+}
+
+bool TextureManager::MoveTexture(CachedTexture* tex, VmaAllocation dstAllocation, VulkanCommandBuffer* cmdbuffer, std::vector<VkImage>& oldImages)
+{
+	VulkanImage* image = tex->image.get();
+	VkFormat format = Images->GetFormat(image);
+
+	VkImageCreateInfo imageInfo = {};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = format;
+	imageInfo.extent = { (uint32_t)image->width, (uint32_t)image->height, 1 };
+	imageInfo.mipLevels = image->mipLevels;
+	imageInfo.arrayLayers = image->layerCount;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	VkImage newImage = VK_NULL_HANDLE;
+	if (vkCreateImage(renderer->Device->device, &imageInfo, nullptr, &newImage) != VK_SUCCESS)
+		return false;
+
+	if (vmaBindImageMemory(renderer->Device->allocator, dstAllocation, newImage) != VK_SUCCESS)
+	{
+		vkDestroyImage(renderer->Device->device, newImage, nullptr);
+		return false;
+	}
+
+	// Mips that streaming hasn't made resident yet hold nothing worth copying
+	int firstLevel = tex->ResidentMip;
+	int levelCount = image->mipLevels - firstLevel;
+
+	PipelineBarrier()
+		.AddImage(image->image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_ASPECT_COLOR_BIT, 0, image->mipLevels, 0, image->layerCount)
+		.AddImage(newImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_ASPECT_COLOR_BIT, 0, image->mipLevels, 0, image->layerCount)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+	std::vector<VkImageCopy> regions;
+	for (int level = firstLevel; level < image->mipLevels; level++)
+	{
+		VkImageCopy region = {};
+		region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.srcSubresource.mipLevel = level;
+		region.srcSubresource.layerCount = image->layerCount;
+		region.dstSubresource = region.srcSubresource;
+		region.extent = { (uint32_t)std::max(image->width >> level, 1), (uint32_t)std::max(image->height >> level, 1), 1 };
+		regions.push_back(region);
+	}
+	cmdbuffer->copyImage(image->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, newImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, (uint32_t)regions.size(), regions.data());
+
+	PipelineBarrier()
+		.AddImage(newImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_ASPECT_COLOR_BIT, 0, image->mipLevels, 0, image->layerCount)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+	// The allocation handle stays the same, VMA points it at the new memory when the pass ends
+	oldImages.push_back(image->image);
+	image->image = newImage;
+
+	// The texture keeps its bindless slot, which is pointed at the new view before the frame's draws are submitted
+	renderer->Commands->GetCurrentDeleteList()->imageViews.push_back(std::move(tex->imageView));
+	tex->imageView = ImageViewBuilder()
+		.Type(VK_IMAGE_VIEW_TYPE_2D_ARRAY)
+		.Image(image, format, VK_IMAGE_ASPECT_COLOR_BIT, firstLevel, 0, levelCount)
+		.DebugName("CachedTexture.ImageView")
+		.Create(renderer->Device.get());
+	renderer->DescriptorSets->UpdateTextureView(tex);
+	return true;
 }
 
 void TextureManager::ClearCache()
 {
+	EndDefragment();
+
+	if (Atlas)
+		Atlas->Clear();
+
 	for (auto& cache : TextureCache)
 	{
 		cache.clear();
 	}
+
+	if (Arrays)
+		Arrays->Clear();
+
+	Images->Clear();
 }
 
 void TextureManager::ClearAllBindlessIndexes()
@@ -70,10 +497,15 @@ void TextureManager::ClearAllBindlessIndexes()
 	{
 		for (auto& it : cache)
 		{
-			for (int& index : it.second->BindlessIndex)
-				index = -1;
+			it.second->BindlessIndex = -1;
 		}
 	}
+
+	if (Atlas)
+		Atlas->ClearAllBindlessIndexes();
+
+	if (Arrays)
+		Arrays->ClearAllBindlessIndexes();
 }
 
 void TextureManager::CreateNullTexture()
@@ -88,6 +520,7 @@ void TextureManager::CreateNullTexture()
 		.Create(renderer->Device.get());
 
 	NullTextureView = ImageViewBuilder()
+		.Type(VK_IMAGE_VIEW_TYPE_2D_ARRAY)
 		.Image(NullTexture.get(), VK_FORMAT_R8G8B8A8_UNORM)
 		.DebugName("NullTextureView")
 		.Create(renderer->Device.get());
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "SceneTextures.h"
+#include "LightmapAtlas.h"
+#include "TextureArrayPool.h"
+#include "ImagePool.h"
 
 struct FTextureInfo;
 class UVulkanRenderDevice;
@@ -14,9 +17,15 @@ public:
 
 	void UpdateTextureRect(FTextureInfo* info, int x, int y, int w, int h);
 	CachedTexture* GetTexture(FTextureInfo* info, bool masked);
+	CachedTexture* GetLightmap(FTextureInfo* info);
+	void RequestMip(CachedTexture* tex, float texelsPerPixel);
+	void NextFrame();
 
 	void ClearCache();
+	void RevalidateCache();
 	void ClearAllBindlessIndexes();
+	void BeginDefragment();
+	void DefragmentIdleFrame();
 
 	std::unique_ptr<VulkanImage> NullTexture;
 	std::unique_ptr<VulkanImageView> NullTextureView;
@@ -25,13 +34,36 @@ public:
 	std::unique_ptr<VulkanImageView> DitherImageView;
 
 	std::unique_ptr<SceneTextures> Scene;
+	VkFormat SceneColorFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+	std::unique_ptr<LightmapAtlas> Atlas;
+	std::unique_ptr<TextureArrayPool> Arrays;
+	std::unique_ptr<ImagePool> Images;
 
 	int GetTexturesInCache() { return TextureCache[0].size() + TextureCache[1].size(); }
 
 private:
 	void CreateNullTexture();
 	void CreateDitherTexture();
+	bool CheckRealtimeChanged(FTextureInfo* info, CachedTexture* tex);
+	void RevalidateTexture(FTextureInfo* info, CachedTexture* tex, bool masked);
+	void ReleaseTexture(CachedTexture* tex);
+	void StreamTexture(FTextureInfo* info, CachedTexture* tex, bool masked);
+	bool LoadTexture(FTextureInfo* info);
+	void UnloadTexture(FTextureInfo* info);
+	uint64_t GetContentHash(const FTextureInfo& info);
+	bool MoveTexture(CachedTexture* tex, VmaAllocation dstAllocation, VulkanCommandBuffer* cmdbuffer, std::vector<VkImage>& oldImages);
+	void EndDefragment();
 
 	UVulkanRenderDevice* renderer = nullptr;
 	std::unordered_map<QWORD, std::unique_ptr<CachedTexture>> TextureCache[2];
+
+	// Bytes of streamed mips uploaded this frame
+	int StreamedBytes = 0;
+	enum { StreamingBudget = 4 * 1024 * 1024 };
+
+	// Defragmentation started by a flush, one pass runs per idle frame until it is done
+	VmaDefragmentationContext DefragContext = VK_NULL_HANDLE;
+	int DefragMovedTextures = 0;
+	enum { DefragmentBytesPerPass = 8 * 1024 * 1024 };
 };
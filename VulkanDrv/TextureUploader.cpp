@@ -2,9 +2,7 @@
 #include "Precomp.h"
 #include "TextureUploader.h"
 
-#ifdef USE_SSE2
-#include <immintrin.h>
-#endif
+#include <textureconvert/textureconvert.h>
 
 TextureUploader* TextureUploader::GetUploader(ETextureFormat format)
 {
@@ -199,31 +197,23 @@ void TextureUploader_P8::UploadRect(void* d, FMipmapBase* mip, int x, int y, int
 {
 	int pitch = mip->USize;
 	BYTE* src = mip->DataPtr + x + y * pitch;
-	FColor* Ptr = (FColor*)d;
+	uint32_t* Ptr = (uint32_t*)d;
+
+	// Masking only changes palette entry zero. Patch a copy of the palette to keep the inner loop free of branches.
+	FColor maskedPalette[256];
 	if (masked)
 	{
-		FColor translucent(0, 0, 0, 0);
-		for (int i = 0; i < h; i++)
-		{
-			for (int j = 0; j < w; j++)
-			{
-				int idx = src[j];
-				*Ptr++ = (idx != 0) ? palette[idx] : translucent;
-			}
-			src += pitch;
-		}
+		memcpy(maskedPalette, palette, sizeof(maskedPalette));
+		maskedPalette[0] = FColor(0, 0, 0, 0);
+		palette = maskedPalette;
 	}
-	else
+
+	auto convert = TextureConvert::Get().P8;
+	for (int i = 0; i < h; i++)
 	{
-		for (int i = 0; i < h; i++)
-		{
-			for (int j = 0; j < w; j++)
-			{
-				int idx = src[j];
-				*Ptr++ = palette[idx];
-			}
-			src += pitch;
-		}
+		convert(Ptr, src, w, (const uint32_t*)palette);
+		Ptr += w;
+		src += pitch;
 	}
 }
 
@@ -236,66 +226,16 @@ int TextureUploader_BGRA8_LM::GetUploadSize(int x, int y, int w, int h)
 
 void TextureUploader_BGRA8_LM::UploadRect(void* dst, FMipmapBase* mip, int x, int y, int w, int h, FColor* palette, bool masked)
 {
-#ifdef USE_SSE2
-	int pitch = mip->USize;
-	FColor* src = ((FColor*)mip->DataPtr) + x + y * pitch;
-	auto Ptr = (FColor*)dst;
-	if (w % 4 == 0)
-	{
-		for (int i = 0; i < h; i++)
-		{
-			for (int j = 0; j < w; j += 4)
-			{
-				__m128i p = _mm_loadu_si128((const __m128i*)(src + j));
-				__m128i p_hi = _mm_unpackhi_epi8(p, _mm_setzero_si128());
-				__m128i p_lo = _mm_unpacklo_epi8(p, _mm_setzero_si128());
-				p_hi = _mm_shufflehi_epi16(p_hi, _MM_SHUFFLE(3, 0, 1, 2));
-				p_hi = _mm_shufflelo_epi16(p_hi, _MM_SHUFFLE(3, 0, 1, 2));
-				p_hi = _mm_slli_epi16(p_hi, 1);
-				p_lo = _mm_shufflehi_epi16(p_lo, _MM_SHUFFLE(3, 0, 1, 2));
-				p_lo = _mm_shufflelo_epi16(p_lo, _MM_SHUFFLE(3, 0, 1, 2));
-				p_lo = _mm_slli_epi16(p_lo, 1);
-				p = _mm_packus_epi16(p_lo, p_hi);
-				_mm_storeu_si128((__m128i*)(Ptr + j), p);
-			}
-			Ptr += w;
-			src += pitch;
-		}
-	}
-	else
-	{
-		for (int i = 0; i < h; i++)
-		{
-			for (int j = 0; j < w; j++)
-			{
-				FColor Src = src[j];
-				Ptr->R = Src.B << 1;
-				Ptr->G = Src.G << 1;
-				Ptr->B = Src.R << 1;
-				Ptr->A = Src.A << 1;
-				Ptr++;
-			}
-			src += pitch;
-		}
-	}
-#else
-	int pitch = mip->USize;
-	FColor* src = ((FColor*)mip->DataPtr) + x + y * pitch;
-	auto Ptr = (FColor*)dst;
+	int pitch = mip->USize * 4;
+	BYTE* src = mip->DataPtr + x * 4 + y * pitch;
+	BYTE* Ptr = (BYTE*)dst;
+	auto convert = TextureConvert::Get().BGRA8_LM;
 	for (int i = 0; i < h; i++)
 	{
-		for (int j = 0; j < w; j++)
-		{
-			FColor Src = src[j];
-			Ptr->R = Src.B << 1;
-			Ptr->G = Src.G << 1;
-			Ptr->B = Src.R << 1;
-			Ptr->A = Src.A << 1;
-			Ptr++;
-		}
+		convert(Ptr, src, w);
+		Ptr += w * 4;
 		src += pitch;
 	}
-#endif
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -310,26 +250,11 @@ void TextureUploader_RGB10A2::UploadRect(void* dst, FMipmapBase* mip, int x, int
 	int pitch = mip->USize;
 	uint32_t* src = ((uint32_t*)mip->DataPtr) + x + y * pitch;
 	uint16_t* Ptr = (uint16_t*)dst;
+	auto convert = TextureConvert::Get().RGB10A2;
 	for (int i = 0; i < h; i++)
 	{
-		for (int j = 0; j < w; j++)
-		{
-			uint32_t c = *Ptr;
-			uint32_t r = (c >> 22) & 0x3ff;
-			uint32_t g = (c >> 12) & 0x3ff;
-			uint32_t b = (c >> 2) & 0x3ff;
-			uint32_t a = c & 0x3;
-
-			r = r * 0xffff / 0x3ff;
-			g = g * 0xffff / 0x3ff;
-			b = b * 0xffff / 0x3ff;
-			a = a * 0xffff / 0x3;
-
-			*(Ptr++) = r;
-			*(Ptr++) = g;
-			*(Ptr++) = b;
-			*(Ptr++) = a;
-		}
+		convert(Ptr, src, w);
+		Ptr += w * 4;
 		src += pitch;
 	}
 }
@@ -346,21 +271,11 @@ void TextureUploader_RGB10A2_UI::UploadRect(void* dst, FMipmapBase* mip, int x,
 	int pitch = mip->USize;
 	uint32_t* src = ((uint32_t*)mip->DataPtr) + x + y * pitch;
 	uint16_t* Ptr = (uint16_t*)dst;
+	auto convert = TextureConvert::Get().RGB10A2_UI;
 	for (int i = 0; i < h; i++)
 	{
-		for (int j = 0; j < w; j++)
-		{
-			uint32_t c = *Ptr;
-			uint32_t r = (c >> 22) & 0x3ff;
-			uint32_t g = (c >> 12) & 0x3ff;
-			uint32_t b = (c >> 2) & 0x3ff;
-			uint32_t a = c & 0x3;
-
-			*(Ptr++) = r;
-			*(Ptr++) = g;
-			*(Ptr++) = b;
-			*(Ptr++) = a;
-		}
+		convert(Ptr, src, w);
+		Ptr += w * 4;
 		src += pitch;
 	}
 }
@@ -377,26 +292,11 @@ void TextureUploader_RGB10A2_LM::UploadRect(void* dst, FMipmapBase* mip, int x,
 	int pitch = mip->USize;
 	uint32_t* src = ((uint32_t*)mip->DataPtr) + x + y * pitch;
 	uint16_t* Ptr = (uint16_t*)dst;
+	auto convert = TextureConvert::Get().RGB10A2_LM;
 	for (int i = 0; i < h; i++)
 	{
-		for (int j = 0; j < w; j++)
-		{
-			uint32_t c = *Ptr;
-			uint32_t r = (c >> 22) & 0x3ff;
-			uint32_t g = (c >> 12) & 0x3ff;
-			uint32_t b = (c >> 2) & 0x3ff;
-			uint32_t a = c & 0x3;
-
-			r = (r << 1) * 0xffff / 0xff;
-			g = (g << 1) * 0xffff / 0xff;
-			b = (b << 1) * 0xffff / 0xff;
-			a = (a << 1) * 0xffff / 0x3;
-
-			*(Ptr++) = r;
-			*(Ptr++) = g;
-			*(Ptr++) = b;
-			*(Ptr++) = a;
-		}
+		convert(Ptr, src, w);
+		Ptr += w * 4;
 		src += pitch;
 	}
 }
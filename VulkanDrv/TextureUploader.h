@@ -11,7 +11,10 @@ public:
 	virtual ~TextureUploader() = default;
 
 	virtual int GetUploadSize(int x, int y, int w, int h) = 0;
+	virtual int GetSourceSize(int w, int h) { return GetUploadSize(0, 0, w, h); }
 	virtual void UploadRect(void* dst, FMipmapBase* mip, int x, int y, int w, int h, FColor* palette, bool masked) = 0;
+	virtual int GetBlockHeight() const { return 1; }
+	virtual bool IsVerbatimCopy() const { return false; } // Whole mips can be copied straight from the source data
 
 	VkFormat GetVkFormat() const { return Format; }
 
@@ -27,6 +30,7 @@ public:
 	TextureUploader_P8() : TextureUploader(VK_FORMAT_R8G8B8A8_UNORM) { }
 
 	int GetUploadSize(int x, int y, int w, int h) override;
+	int GetSourceSize(int w, int h) override { return w * h; }
 	void UploadRect(void* dst, FMipmapBase* mip, int x, int y, int w, int h, FColor* palette, bool masked) override;
 };
 
@@ -45,6 +49,7 @@ public:
 	TextureUploader_RGB10A2() : TextureUploader(VK_FORMAT_R16G16B16A16_UNORM) { }
 
 	int GetUploadSize(int x, int y, int w, int h) override;
+	int GetSourceSize(int w, int h) override { return w * h * 4; }
 	void UploadRect(void* dst, FMipmapBase* mip, int x, int y, int w, int h, FColor* palette, bool masked) override;
 };
 
@@ -54,6 +59,7 @@ public:
 	TextureUploader_RGB10A2_UI() : TextureUploader(VK_FORMAT_R16G16B16A16_UINT) { }
 
 	int GetUploadSize(int x, int y, int w, int h) override;
+	int GetSourceSize(int w, int h) override { return w * h * 4; }
 	void UploadRect(void* dst, FMipmapBase* mip, int x, int y, int w, int h, FColor* palette, bool masked) override;
 };
 
@@ -63,6 +69,7 @@ public:
 	TextureUploader_RGB10A2_LM() : TextureUploader(VK_FORMAT_R16G16B16A16_UNORM) { }
 
 	int GetUploadSize(int x, int y, int w, int h) override;
+	int GetSourceSize(int w, int h) override { return w * h * 4; }
 	void UploadRect(void* dst, FMipmapBase* mip, int x, int y, int w, int h, FColor* palette, bool masked) override;
 };
 
@@ -73,6 +80,7 @@ public:
 
 	int GetUploadSize(int x, int y, int w, int h) override;
 	void UploadRect(void* dst, FMipmapBase* mip, int x, int y, int w, int h, FColor* palette, bool masked) override;
+	bool IsVerbatimCopy() const override { return true; }
 
 private:
 	int BytesPerPixel;
@@ -85,6 +93,8 @@ public:
 
 	int GetUploadSize(int x, int y, int w, int h) override;
 	void UploadRect(void* dst, FMipmapBase* mip, int x, int y, int w, int h, FColor* palette, bool masked) override;
+	int GetBlockHeight() const override { return 4; }
+	bool IsVerbatimCopy() const override { return true; }
 
 private:
 	int BytesPerBlock;
@@ -97,6 +107,8 @@ public:
 
 	int GetUploadSize(int x, int y, int w, int h) override;
 	void UploadRect(void* dst, FMipmapBase* mip, int x, int y, int w, int h, FColor* palette, bool masked) override;
+	int GetBlockHeight() const override { return BlockY; }
+	bool IsVerbatimCopy() const override { return true; }
 
 private:
 	int BlockX;
@@ -73,7 +73,11 @@ void UVulkanRenderDevice::StaticConstructor()
 	SupportsFogMaps = 1;
 	SupportsDistanceFog = 0;
 	SupportsTC = 1;
-	SupportsLazyTextures = 0;
+#if defined(OLDUNREAL469SDK)
+	SupportsLazyTextures = 0; // TextureManager only does the Load/Unload calls with the older SDKs
+#else
+	SupportsLazyTextures = 1;
+#endif
 	PrefersDeferredLoad = 0;
 	UseVSync = 1;
 	AntialiasMode = 0;
@@ -87,7 +91,7 @@ void UVulkanRenderDevice::StaticConstructor()
 	VolumetricLighting = 1;
 
 #if defined(OLDUNREAL469SDK)
-	UseLightmapAtlas = 0; // Note: do not turn this on. It does not work and generates broken fogmaps.
+	UseLightmapAtlas = 0; // Note: do not turn this on. It does not work and generates broken fogmaps. VkLightmapAtlas packs them on the driver side instead.
 	SupportsUpdateTextureRect = 1;
 	MaxTextureSize = 4096;
 	NeedsMaskedFonts = 0;
@@ -121,6 +125,20 @@ void UVulkanRenderDevice::StaticConstructor()
 	VkDeviceIndex = 0;
 	VkDebug = 0;
 	VkExclusiveFullscreen = 0;
+	VkHostMemoryImport = 0;
+	VkLightmapAtlas = 1;
+	VkTextureArrays = 0;
+	VkKeepTexturesOnFlush = 1;
+	VkMipStreaming = 1;
+	VkDefragment = 0;
+	VkDynamicRendering = 1;
+	VkFusedPresent = 0;
+	VkRenderScale = 1.0f;
+	VkDynamicResolution = 0;
+	VkDynamicResolutionTarget = 14.0f;
+	VkUpscaler = 0;
+	VkUpscaleSharpness = 0;
+	VkCompactSceneFormat = 0;
 
 #if defined(OLDUNREAL469SDK)
 	new(GetClass(), TEXT("UseLightmapAtlas"), RF_Public) UBoolProperty(CPP_PROPERTY(UseLightmapAtlas), TEXT("Display"), CPF_Config);
@@ -166,6 +184,20 @@ void UVulkanRenderDevice::StaticConstructor()
 	new(GetClass(), TEXT("VkDeviceIndex"), RF_Public) UIntProperty(CPP_PROPERTY(VkDeviceIndex), TEXT("Display"), CPF_Config);
 	new(GetClass(), TEXT("VkDebug"), RF_Public) UBoolProperty(CPP_PROPERTY(VkDebug), TEXT("Display"), CPF_Config);
 	new(GetClass(), TEXT("VkExclusiveFullscreen"), RF_Public) UBoolProperty(CPP_PROPERTY(VkExclusiveFullscreen), TEXT("Display"), CPF_Config);
+	new(GetClass(), TEXT("VkHostMemoryImport"), RF_Public) UBoolProperty(CPP_PROPERTY(VkHostMemoryImport), TEXT("Display"), CPF_Config);
+	new(GetClass(), TEXT("VkLightmapAtlas"), RF_Public) UBoolProperty(CPP_PROPERTY(VkLightmapAtlas), TEXT("Display"), CPF_Config);
+	new(GetClass(), TEXT("VkTextureArrays"), RF_Public) UBoolProperty(CPP_PROPERTY(VkTextureArrays), TEXT("Display"), CPF_Config);
+	new(GetClass(), TEXT("VkKeepTexturesOnFlush"), RF_Public) UBoolProperty(CPP_PROPERTY(VkKeepTexturesOnFlush), TEXT("Display"), CPF_Config);
+	new(GetClass(), TEXT("VkMipStreaming"), RF_Public) UBoolProperty(CPP_PROPERTY(VkMipStreaming), TEXT("Display"), CPF_Config);
+	new(GetClass(), TEXT("VkDefragment"), RF_Public) UBoolProperty(CPP_PROPERTY(VkDefragment), TEXT("Display"), CPF_Config);
+	new(GetClass(), TEXT("VkDynamicRendering"), RF_Public) UBoolProperty(CPP_PROPERTY(VkDynamicRendering), TEXT("Display"), CPF_Config);
+	new(GetClass(), TEXT("VkFusedPresent"), RF_Public) UBoolProperty(CPP_PROPERTY(VkFusedPresent), TEXT("Display"), CPF_Config);
+	new(GetClass(), TEXT("VkRenderScale"), RF_Public) UFloatProperty(CPP_PROPERTY(VkRenderScale), TEXT("Display"), CPF_Config);
+	new(GetClass(), TEXT("VkDynamicResolution"), RF_Public) UBoolProperty(CPP_PROPERTY(VkDynamicResolution), TEXT("Display"), CPF_Config);
+	new(GetClass(), TEXT("VkDynamicResolutionTarget"), RF_Public) UFloatProperty(CPP_PROPERTY(VkDynamicResolutionTarget), TEXT("Display"), CPF_Config);
+	new(GetClass(), TEXT("VkUpscaler"), RF_Public) UByteProperty(CPP_PROPERTY(VkUpscaler), TEXT("Display"), CPF_Config);
+	new(GetClass(), TEXT("VkUpscaleSharpness"), RF_Public) UByteProperty(CPP_PROPERTY(VkUpscaleSharpness), TEXT("Display"), CPF_Config);
+	new(GetClass(), TEXT("VkCompactSceneFormat"), RF_Public) UBoolProperty(CPP_PROPERTY(VkCompactSceneFormat), TEXT("Display"), CPF_Config);
 
 	unguard;
 }
@@ -243,6 +275,8 @@ UBOOL UVulkanRenderDevice::Init(UViewport* InViewport, INT NewX, INT NewY, INT N
 
 		deviceBuilder.RequireExtension(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
 		deviceBuilder.RequireExtension(VK_KHR_SAMPLER_MIRROR_CLAMP_TO_EDGE_EXTENSION_NAME);
+		deviceBuilder.OptionalExtension(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+		deviceBuilder.OptionalDynamicRendering();
 		deviceBuilder.SelectDevice(VkDeviceIndex);
 
 		Device = deviceBuilder.Create(instance);
@@ -268,6 +302,8 @@ UBOOL UVulkanRenderDevice::Init(UViewport* InViewport, INT NewX, INT NewY, INT N
 		DescriptorSets.reset(new DescriptorSetManager(this));
 		RenderPasses.reset(new RenderPassManager(this));
 		Framebuffers.reset(new FramebufferManager(this));
+		Capture.reset(new FrameCapture(this));
+		DynamicRes.reset(new DynamicResolution(this));
 
 		const auto& props = Device->PhysicalDevice.Properties.Properties;
 
@@ -414,6 +450,8 @@ void UVulkanRenderDevice::Exit()
 
 	if (Device) vkDeviceWaitIdle(Device->device);
 
+	DynamicRes.reset();
+	Capture.reset();
 	Framebuffers.reset();
 	RenderPasses.reset();
 	DescriptorSets.reset();
@@ -448,23 +486,26 @@ void UVulkanRenderDevice::Flush()
 
 	if (IsLocked)
 	{
+		// The pass after the flush clears everything again, so nothing has to be stored
 		DrawBatch(Commands->GetDrawCommands());
-		RenderPasses->EndScene(Commands->GetDrawCommands());
+		RenderPasses->EndScene(false);
 		SubmitAndWait(false, 0, 0, false);
 
-		ClearTextureCache();
+		FlushTextureCache();
 
-		auto cmdbuffer = Commands->GetDrawCommands();
-		RenderPasses->BeginScene(cmdbuffer, 0.0f, 0.0f, 0.0f, 1.0f);
+		RenderPasses->BeginScene(0.0f, 0.0f, 0.0f, 1.0f);
 
+		auto cmdbuffer = Commands->GetDrawCommands();
 		VkBuffer vertexBuffers[] = { Buffers->SceneVertexBuffers[Commands->CurrentFrameIndex]->buffer };
 		VkDeviceSize offsets[] = { 0 };
 		cmdbuffer->bindVertexBuffers(0, 1, vertexBuffers, offsets);
 		cmdbuffer->bindIndexBuffer(Buffers->SceneIndexBuffers[Commands->CurrentFrameIndex]->buffer, 0, VK_INDEX_TYPE_UINT32);
+		cmdbuffer->setViewport(0, 1, &viewportdesc);
+		SetSceneScissor(cmdbuffer);
 	}
 	else
 	{
-		ClearTextureCache();
+		FlushTextureCache();
 	}
 
 	if (UsePrecache && !GIsEditor)
@@ -482,10 +523,10 @@ void UVulkanRenderDevice::Flush(UBOOL AllowPrecache)
 	if (IsLocked)
 	{
 		DrawBatch(Commands->GetDrawCommands());
-		Commands->GetDrawCommands()->endRenderPass();
+		RenderPasses->EndScene(true);
 		SubmitAndWait(false, 0, 0, false);
 
-		ClearTextureCache();
+		FlushTextureCache();
 
 		auto cmdbuffer = Commands->GetDrawCommands();
 
@@ -496,29 +537,28 @@ void UVulkanRenderDevice::Flush(UBOOL AllowPrecache)
 		VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 		VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 
-		PipelineBarrier()
-			.AddImage(Textures->Scene->ColorBuffer.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess)
-			.AddImage(Textures->Scene->HitBuffer.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess)
-			.AddImage(Textures->Scene->DepthBuffer.get(), VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, srcDepthAccess, dstDepthAccess, VK_IMAGE_ASPECT_DEPTH_BIT)
-			.Execute(cmdbuffer, srcStages, dstStages);
+		PipelineBarrier barrier;
+		barrier.AddImage(Textures->Scene->ColorBuffer.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess);
+		if (Textures->Scene->SceneSamples != VK_SAMPLE_COUNT_1_BIT)
+			barrier.AddImage(Textures->Scene->PPImage[0].get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess);
+		if (RenderPasses->Scene.HitTest)
+			barrier.AddImage(Textures->Scene->HitBuffer.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess);
+		barrier.AddImage(Textures->Scene->DepthBuffer.get(), VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, srcDepthAccess, dstDepthAccess, VK_IMAGE_ASPECT_DEPTH_BIT);
+		barrier.Execute(cmdbuffer, srcStages, dstStages);
 
-		RenderPassBegin()
-			.RenderPass(RenderPasses->Scene.RenderPassContinue.get())
-			.Framebuffer(Framebuffers->SceneFramebuffer.get())
-			.RenderArea(0, 0, Textures->Scene->Width, Textures->Scene->Height)
-			.AddClearColor(0.0f, 0.0f, 0.0f, 0.0f)
-			.AddClearColor(0.0f, 0.0f, 0.0f, 0.0f)
-			.AddClearDepthStencil(1.0f, 0)
-			.Execute(cmdbuffer);
+		RenderPasses->ContinueScene();
 
+		cmdbuffer = Commands->GetDrawCommands();
 		VkBuffer vertexBuffers[] = { Buffers->SceneVertexBuffers[Commands->CurrentFrameIndex]->buffer };
 		VkDeviceSize offsets[] = { 0 };
 		cmdbuffer->bindVertexBuffers(0, 1, vertexBuffers, offsets);
 		cmdbuffer->bindIndexBuffer(Buffers->SceneIndexBuffers[Commands->CurrentFrameIndex]->buffer, 0, VK_INDEX_TYPE_UINT32);
+		cmdbuffer->setViewport(0, 1, &viewportdesc);
+		SetSceneScissor(cmdbuffer);
 	}
 	else
 	{
-		ClearTextureCache();
+		FlushTextureCache();
 	}
 
 	if (AllowPrecache && UsePrecache && !GIsEditor)
@@ -619,6 +659,30 @@ UBOOL UVulkanRenderDevice::Exec(const TCHAR* Cmd, FOutputDevice& Ar)
 		Ar.Log(*Str.LeftChop(1));
 		return 1;
 	}
+	else if (ParseCommand(&Cmd, TEXT("VKCAPTURE")))
+	{
+		if (ParseCommand(&Cmd, TEXT("STOP")))
+		{
+			Capture->StopStream();
+			return 1;
+		}
+
+		ParseCommand(&Cmd, TEXT("START"));
+
+		INT framerate = 60;
+		Parse(Cmd, TEXT("FPS="), framerate);
+
+		TCHAR filename[256] = {};
+		if (!ParseToken(Cmd, filename, ARRAY_COUNT(filename), 0))
+		{
+			Ar.Log(TEXT("Usage: VKCAPTURE START <file.y4m|file.raw> [FPS=60], VKCAPTURE STOP"));
+			return 1;
+		}
+
+		if (!Capture->StartStream(filename, framerate))
+			Ar.Logf(TEXT("Could not open %s"), filename);
+		return 1;
+	}
 #if WIN32 // To do: what does the Unix build use for the TEXT() template?
 	else if (ParseCommand(&Cmd, TEXT("GetVkDevices")))
 	{
@@ -658,6 +722,7 @@ void UVulkanRenderDevice::Lock(FPlane InFlashScale, FPlane InFlashFog, FPlane Sc
 
 	pushconstants.hitIndex = 0;
 	ForceHitIndex = -1;
+	FusedPresentFrame = false;
 
 	try
 	{
@@ -667,41 +732,66 @@ void UVulkanRenderDevice::Lock(FPlane InFlashScale, FPlane InFlashFog, FPlane Sc
 			Framebuffers->DestroySceneFramebuffer();
 			Textures->Scene.reset();
 			Textures->Scene.reset(new SceneTextures(this, Viewport->SizeX, Viewport->SizeY, GetSettingsMultisample()));
-			RenderPasses->CreateRenderPass();
-			RenderPasses->CreatePipelines();
+
+			// Viewport and scissor are dynamic, so the render pass and pipelines only depend on the sample count
+			if (!RenderPasses->Scene.Pipeline[0][0][RenderPassManager::SceneVariantAll].Pipeline || RenderPasses->Scene.Samples != Textures->Scene->SceneSamples)
+			{
+				RenderPasses->CreateRenderPass();
+				RenderPasses->CreatePipelines();
+			}
+
 			Framebuffers->CreateSceneFramebuffer();
 			DescriptorSets->UpdateFrameDescriptors();
 		}
 
+		// Frames that don't hit test leave out the hit buffer attachment
+		RenderPasses->Scene.HitTest = HitData != nullptr;
+		if (RenderPasses->Scene.HitTest && !RenderPasses->Scene.Pipeline[1][0][RenderPassManager::SceneVariantAll].Pipeline)
+			RenderPasses->CreateHitTestPipelines();
+		if (RenderPasses->Scene.HitTest && !Textures->Scene->HitBuffer)
+		{
+			Textures->Scene->CreateHitBuffer(this);
+			Framebuffers->CreateSceneHitFramebuffer();
+			DescriptorSets->UpdateHitReduceSet();
+		}
+
+		Textures->NextFrame();
+
+		// Texture moves have to be recorded before any draw that samples them
+		Textures->DefragmentIdleFrame();
+
 		auto cmdbuffer = Commands->GetDrawCommands();
 
+		// Below full scale the scene is only drawn into the top left part of the scene images
+		DynamicRes->BeginFrame(cmdbuffer);
+		Textures->Scene->RenderWidth = std::max((int)std::round(Textures->Scene->Width * DynamicRes->GetRenderScale()), 1);
+		Textures->Scene->RenderHeight = std::max((int)std::round(Textures->Scene->Height * DynamicRes->GetRenderScale()), 1);
+
 		// Special thanks to Khronos and AMD for making this absolute hell to use.
 		VkAccessFlags srcColorAccess = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
 		VkAccessFlags dstColorAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
 		VkAccessFlags srcDepthAccess = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 		VkAccessFlags dstDepthAccess = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-		VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 		VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 
-		PipelineBarrier()
-			.AddImage(Textures->Scene->ColorBuffer.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess)
-			.AddImage(Textures->Scene->HitBuffer.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess)
-			.AddImage(Textures->Scene->DepthBuffer.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, srcDepthAccess, dstDepthAccess, VK_IMAGE_ASPECT_DEPTH_BIT)
-			.Execute(cmdbuffer, srcStages, dstStages);
+		PipelineBarrier barrier;
+		barrier.AddImage(Textures->Scene->ColorBuffer.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess);
+		if (Textures->Scene->SceneSamples != VK_SAMPLE_COUNT_1_BIT)
+			barrier.AddImage(Textures->Scene->PPImage[0].get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess);
+		if (RenderPasses->Scene.HitTest)
+			barrier.AddImage(Textures->Scene->HitBuffer.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess);
+		barrier.AddImage(Textures->Scene->DepthBuffer.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, srcDepthAccess, dstDepthAccess, VK_IMAGE_ASPECT_DEPTH_BIT);
+		barrier.Execute(cmdbuffer, srcStages, dstStages);
 
-		RenderPassBegin()
-			.RenderPass(RenderPasses->Scene.RenderPass.get())
-			.Framebuffer(Framebuffers->SceneFramebuffer.get())
-			.RenderArea(0, 0, Textures->Scene->Width, Textures->Scene->Height)
-			.AddClearColor(ScreenClear.X, ScreenClear.Y, ScreenClear.Z, ScreenClear.W)
-			.AddClearColor(0.0f, 0.0f, 0.0f, 0.0f)
-			.AddClearDepthStencil(1.0f, 0)
-			.Execute(cmdbuffer);
+		RenderPasses->BeginScene(ScreenClear.X, ScreenClear.Y, ScreenClear.Z, ScreenClear.W);
 
+		cmdbuffer = Commands->GetDrawCommands();
 		VkBuffer vertexBuffers[] = { Buffers->SceneVertexBuffers[Commands->CurrentFrameIndex]->buffer };
 		VkDeviceSize offsets[] = { 0 };
 		cmdbuffer->bindVertexBuffers(0, 1, vertexBuffers, offsets);
 		cmdbuffer->bindIndexBuffer(Buffers->SceneIndexBuffers[Commands->CurrentFrameIndex]->buffer, 0, VK_INDEX_TYPE_UINT32);
+		SetSceneScissor(cmdbuffer);
 
 		IsLocked = true;
 	}
@@ -720,7 +810,7 @@ void UVulkanRenderDevice::Lock(FPlane InFlashScale, FPlane InFlashFog, FPlane Sc
 void UVulkanRenderDevice::FlushDrawBatchAndWait()
 {
 	DrawBatch(Commands->GetDrawCommands());
-	Commands->GetDrawCommands()->endRenderPass();
+	RenderPasses->EndScene(true);
 	SubmitAndWait(false, 0, 0, false);
 
 	auto drawcommands = Commands->GetDrawCommands();
@@ -732,23 +822,24 @@ void UVulkanRenderDevice::FlushDrawBatchAndWait()
 	VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 	VkPipelineStageFlags dstStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
 
-	PipelineBarrier()
-		.AddImage(Textures->Scene->ColorBuffer.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess)
-		.AddImage(Textures->Scene->HitBuffer.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess)
-		.AddImage(Textures->Scene->DepthBuffer.get(), VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, srcDepthAccess, dstDepthAccess, VK_IMAGE_ASPECT_DEPTH_BIT)
-		.Execute(drawcommands, srcStages, dstStages);
+	PipelineBarrier barrier;
+	barrier.AddImage(Textures->Scene->ColorBuffer.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess);
+	if (Textures->Scene->SceneSamples != VK_SAMPLE_COUNT_1_BIT)
+		barrier.AddImage(Textures->Scene->PPImage[0].get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess);
+	if (RenderPasses->Scene.HitTest)
+		barrier.AddImage(Textures->Scene->HitBuffer.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess);
+	barrier.AddImage(Textures->Scene->DepthBuffer.get(), VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, srcDepthAccess, dstDepthAccess, VK_IMAGE_ASPECT_DEPTH_BIT);
+	barrier.Execute(drawcommands, srcStages, dstStages);
 
-	RenderPassBegin()
-		.RenderPass(RenderPasses->Scene.RenderPassContinue.get())
-		.Framebuffer(Framebuffers->SceneFramebuffer.get())
-		.RenderArea(0, 0, Textures->Scene->Width, Textures->Scene->Height)
-		.Execute(drawcommands);
+	RenderPasses->ContinueScene();
 
+	drawcommands = Commands->GetDrawCommands();
 	VkBuffer vertexBuffers[] = { Buffers->SceneVertexBuffers[Commands->CurrentFrameIndex]->buffer };
 	VkDeviceSize offsets[] = { 0 };
 	drawcommands->bindVertexBuffers(0, 1, vertexBuffers, offsets);
 	drawcommands->bindIndexBuffer(Buffers->SceneIndexBuffers[Commands->CurrentFrameIndex]->buffer, 0, VK_INDEX_TYPE_UINT32);
 	drawcommands->setViewport(0, 1, &viewportdesc);
+	SetSceneScissor(drawcommands);
 }
 
 void UVulkanRenderDevice::DrawStats(FSceneNode* Frame)
@@ -756,7 +847,7 @@ void UVulkanRenderDevice::DrawStats(FSceneNode* Frame)
 	Super::DrawStats(Frame);
 
 #if defined(OLDUNREAL469SDK)
-	GRender->ShowStat(CurrentFrame, TEXT("Vulkan: Draw calls: %d, Complex surfaces: %d, Gouraud polygons: %d, Tiles: %d; Uploads: %d, Rect Uploads: %d\r\n"), Stats.DrawCalls, Stats.ComplexSurfaces, Stats.GouraudPolygons, Stats.Tiles, Stats.Uploads, Stats.RectUploads);
+	GRender->ShowStat(CurrentFrame, TEXT("Vulkan: Draw calls: %d, Complex surfaces: %d, Gouraud polygons: %d, Tiles: %d; Uploads: %d, Rect Uploads: %d, Host Imports: %d, Image pool hits: %d, misses: %d\r\n"), Stats.DrawCalls, Stats.ComplexSurfaces, Stats.GouraudPolygons, Stats.Tiles, Stats.Uploads, Stats.RectUploads, Stats.HostImports, Stats.ImagePoolHits, Stats.ImagePoolMisses);
 #endif
 
 	Stats.DrawCalls = 0;
@@ -765,6 +856,9 @@ void UVulkanRenderDevice::DrawStats(FSceneNode* Frame)
 	Stats.Tiles = 0;
 	Stats.Uploads = 0;
 	Stats.RectUploads = 0;
+	Stats.HostImports = 0;
+	Stats.ImagePoolHits = 0;
+	Stats.ImagePoolMisses = 0;
 }
 
 void UVulkanRenderDevice::Unlock(UBOOL Blit)
@@ -773,13 +867,36 @@ void UVulkanRenderDevice::Unlock(UBOOL Blit)
 
 	try
 	{
+		// Last pass of the frame. Depth and multisampled color are not needed after it.
 		DrawBatch(Commands->GetDrawCommands());
-		Commands->GetDrawCommands()->endRenderPass();
+		RenderPasses->EndScene(false);
 
-		BlitSceneToPostprocess();
-		if (Bloom)
+		// A capture stream copies the post processed image, which the fused pass skips
+		FusedPresentFrame = Blit && !Capture->IsStreaming() && CanUseFusedPresent();
+		if (FusedPresentFrame)
 		{
-			RunBloomPass();
+			// DrawPresentTexture reads the scene straight from the color buffer, or from PPImage[0] when the scene pass resolved into it
+			PipelineBarrier()
+				.AddImage(Textures->Scene->GetResolvedImage(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+				.Execute(Commands->GetDrawCommands(), VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+			if (Bloom)
+			{
+				BuildBloomLevels(true);
+			}
+		}
+		else
+		{
+			BlitSceneToPostprocess();
+			if (Bloom)
+			{
+				RunBloomPass();
+			}
+		}
+
+		if (HitData && Viewport->HitXL > 0 && Viewport->HitYL > 0)
+		{
+			ReduceHitBuffer();
 		}
 
 #ifdef WIN32
@@ -794,10 +911,26 @@ void UVulkanRenderDevice::Unlock(UBOOL Blit)
 		SDLVulkanGetDrawableSizeCompat(window, &windowWidth, &windowHeight);
 #endif
 
+		if (Capture->IsStreaming())
+		{
+			int width, height;
+			VulkanImage* image = PrepareScreenshotImage(width, height);
+			Capture->Record(image, width, height, true);
+		}
+
+		DynamicRes->EndFrame(Commands->GetDrawCommands());
+
+		uint64_t frameSerial = Commands->GetNextSubmitSerial();
 		SubmitAndWait(Blit ? true : false, windowWidth, windowHeight, Viewport->IsFullscreen());
 
 		Batch.Pipeline = nullptr;
 
+		// Only the frame before this one may still be on its way back
+		if (Capture->IsStreaming())
+		{
+			Capture->WriteStreamedFrames(1);
+		}
+
 		if (Samplers->LODBias != LODBias)
 		{
 			DescriptorSets->ClearCache();
@@ -807,22 +940,19 @@ void UVulkanRenderDevice::Unlock(UBOOL Blit)
 
 		if (HitData)
 		{
-			// Look for the last hit
-			int width = Viewport->HitXL;
-			int height = Viewport->HitYL;
+			// The reduction pass left the last hit plus one, or zero if nothing was hit
 			int hit = 0;
-			const int32_t* data = (const int32_t*)Textures->Scene->StagingHitBuffer->Map(0, width * height * sizeof(int32_t));
-			if (data)
+			if (Viewport->HitXL > 0 && Viewport->HitYL > 0)
 			{
-				for (int y = 0; y < height; y++)
+				// The submit doesn't wait for the GPU. The editor needs the result now, so wait for this frame to finish.
+				Commands->WaitForSubmit(frameSerial);
+
+				const int32_t* data = (const int32_t*)Textures->Scene->HitResultBuffer->Map(0, sizeof(int32_t));
+				if (data)
 				{
-					const INT* line = data + y * width;
-					for (int x = 0; x < width; x++)
-					{
-						hit = std::max(hit, line[x]);
-					}
+					hit = data[0];
+					Textures->Scene->HitResultBuffer->Unmap();
 				}
-				Textures->Scene->StagingHitBuffer->Unmap();
 			}
 			hit--;
 
@@ -880,6 +1010,14 @@ void UVulkanRenderDevice::UpdateTextureRect(FTextureInfo& Info, INT U, INT V, IN
 
 #endif
 
+void UVulkanRenderDevice::SetSceneScissor(VulkanCommandBuffer* cmdbuffer)
+{
+	VkRect2D scissor = {};
+	scissor.extent.width = Textures->Scene->RenderWidth;
+	scissor.extent.height = Textures->Scene->RenderHeight;
+	cmdbuffer->setScissor(0, 1, &scissor);
+}
+
 void UVulkanRenderDevice::DrawBatch(VulkanCommandBuffer* cmdbuffer)
 {
 	if (!Batch.Pipeline)
@@ -905,6 +1043,28 @@ void UVulkanRenderDevice::DrawBatch(VulkanCommandBuffer* cmdbuffer)
 	}
 }
 
+void UVulkanRenderDevice::RequestTextureMip(CachedTexture* tex, const FTextureInfo* Info, const FVector& p0, const FVector& p1, const FVector& p2, const vec2& t0, const vec2& t1, const vec2& t2)
+{
+	if (!tex || tex->WantedMip == 0)
+		return;
+
+	// Anything crossing the near plane is close enough to need the full texture
+	if (p0.Z < 1.0f || p1.Z < 1.0f || p2.Z < 1.0f)
+	{
+		Textures->RequestMip(tex, 0.0f);
+		return;
+	}
+
+	// Compare the triangle's area on screen with its area in the texture
+	float x0 = p0.X / (p0.Z * RFX2), y0 = p0.Y / (p0.Z * RFY2);
+	float x1 = p1.X / (p1.Z * RFX2), y1 = p1.Y / (p1.Z * RFY2);
+	float x2 = p2.X / (p2.Z * RFX2), y2 = p2.Y / (p2.Z * RFY2);
+	float pixelArea = std::abs((x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0));
+	float texelArea = std::abs((t1.s - t0.s) * (t2.t - t0.t) - (t2.s - t0.s) * (t1.t - t0.t)) * Info->USize * Info->VSize;
+	if (pixelArea > 1.0f)
+		Textures->RequestMip(tex, std::sqrt(texelArea / pixelArea));
+}
+
 void UVulkanRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Surface, FSurfaceFacet& Facet)
 {
 	guardSlow(UVulkanRenderDevice::DrawComplexSurface);
@@ -913,10 +1073,10 @@ void UVulkanRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 
 	CachedTexture* tex = Textures->GetTexture(Surface.Texture, (PolyFlags & PF_Masked) || 
 		(Surface.Texture->Texture && (Surface.Texture->Texture->PolyFlags & PF_Masked)));
-	CachedTexture* lightmap = Textures->GetTexture(Surface.LightMap, false);
+	CachedTexture* lightmap = Textures->GetLightmap(Surface.LightMap);
 	CachedTexture* macrotex = Textures->GetTexture(Surface.MacroTexture, false);
 	CachedTexture* detailtex = Textures->GetTexture(Surface.DetailTexture, false);
-	CachedTexture* fogmap = (Surface.FogMap && Surface.FogMap->Mips[0] && Surface.FogMap->Mips[0]->DataPtr) ? Textures->GetTexture(Surface.FogMap, false) : nullptr;
+	CachedTexture* fogmap = (Surface.FogMap && Surface.FogMap->Mips[0] && Surface.FogMap->Mips[0]->DataPtr) ? Textures->GetLightmap(Surface.FogMap) : nullptr;
 
 #if defined(UNREALGOLD)
 	if (Surface.DetailTexture && Surface.FogMap) detailtex = nullptr;
@@ -933,8 +1093,10 @@ void UVulkanRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 	float VMult = tex ? GetVMult(*Surface.Texture) : 0.0f;
 	float LMUPan = lightmap ? UDot + Surface.LightMap->Pan.X - 0.5f * Surface.LightMap->UScale : 0.0f;
 	float LMVPan = lightmap ? VDot + Surface.LightMap->Pan.Y - 0.5f * Surface.LightMap->VScale : 0.0f;
-	float LMUMult = lightmap ? GetUMult(*Surface.LightMap) : 0.0f;
-	float LMVMult = lightmap ? GetVMult(*Surface.LightMap) : 0.0f;
+	float LMUMult = lightmap ? GetUMult(*Surface.LightMap) * lightmap->AtlasScale[0] : 0.0f;
+	float LMVMult = lightmap ? GetVMult(*Surface.LightMap) * lightmap->AtlasScale[1] : 0.0f;
+	float LMUOffset = lightmap ? lightmap->AtlasOffset[0] : 0.0f;
+	float LMVOffset = lightmap ? lightmap->AtlasOffset[1] : 0.0f;
 	float MacroUPan = macrotex ? UDot + Surface.MacroTexture->Pan.X : 0.0f;
 	float MacroVPan = macrotex ? VDot + Surface.MacroTexture->Pan.Y : 0.0f;
 	float MacroUMult = macrotex ? GetUMult(*Surface.MacroTexture) : 0.0f;
@@ -943,6 +1105,8 @@ void UVulkanRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 	float DetailVPan = VPan;
 	float DetailUMult = detailtex ? GetUMult(*Surface.DetailTexture) : 0.0f;
 	float DetailVMult = detailtex ? GetVMult(*Surface.DetailTexture) : 0.0f;
+	float DetailUOffset = 0.0f;
+	float DetailVOffset = 0.0f;
 
 	uint32_t flags = 0;
 	if (lightmap) flags |= 1;
@@ -954,18 +1118,26 @@ void UVulkanRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 
 	if (fogmap) // if Surface.FogMap exists, use instead of detail texture
 	{
-		detailtex = fogmap;
 		DetailUPan = UDot + Surface.FogMap->Pan.X - 0.5f * Surface.FogMap->UScale;
 		DetailVPan = VDot + Surface.FogMap->Pan.Y - 0.5f * Surface.FogMap->VScale;
-		DetailUMult = GetUMult(*Surface.FogMap);
-		DetailVMult = GetVMult(*Surface.FogMap);
+		DetailUMult = GetUMult(*Surface.FogMap) * fogmap->AtlasScale[0];
+		DetailVMult = GetVMult(*Surface.FogMap) * fogmap->AtlasScale[1];
+		DetailUOffset = fogmap->AtlasOffset[0];
+		DetailVOffset = fogmap->AtlasOffset[1];
+		detailtex = fogmap->GetImageTexture();
 	}
 
-	SetPipeline(RenderPasses->GetPipeline(PolyFlags));
+	// Lightmaps and fogmaps may live in an atlas page
+	if (lightmap)
+		lightmap = lightmap->GetImageTexture();
+
+	SetPipeline(RenderPasses->GetPipeline(PolyFlags, flags, Batch.Pipeline));
 
 	ivec4 textureBinds = GetTextureIndexes(PolyFlags, tex, lightmap, macrotex, detailtex);
 	vec4 color(1.0f);
 
+	bool wantMips = (tex && tex->WantedMip > 0) || (macrotex && macrotex->WantedMip > 0) || (!fogmap && detailtex && detailtex->WantedMip > 0);
+
 	for (FSavedPoly* Poly = Facet.Polys; Poly; Poly = Poly->Next)
 	{
 		auto pts = Poly->Pts;
@@ -992,12 +1164,12 @@ void UVulkanRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 				vptr->Position.z = point.Z;
 				vptr->TexCoord.s = (u - UPan) * UMult;
 				vptr->TexCoord.t = (v - VPan) * VMult;
-				vptr->TexCoord2.s = (u - LMUPan) * LMUMult;
-				vptr->TexCoord2.t = (v - LMVPan) * LMVMult;
+				vptr->TexCoord2.s = (u - LMUPan) * LMUMult + LMUOffset;
+				vptr->TexCoord2.t = (v - LMVPan) * LMVMult + LMVOffset;
 				vptr->TexCoord3.s = (u - MacroUPan) * MacroUMult;
 				vptr->TexCoord3.t = (v - MacroVPan) * MacroVMult;
-				vptr->TexCoord4.s = (u - DetailUPan) * DetailUMult;
-				vptr->TexCoord4.t = (v - DetailVPan) * DetailVMult;
+				vptr->TexCoord4.s = (u - DetailUPan) * DetailUMult + DetailUOffset;
+				vptr->TexCoord4.t = (v - DetailVPan) * DetailVMult + DetailVOffset;
 				vptr->Color = color;
 				vptr->TextureBinds = textureBinds;
 				vptr++;
@@ -1010,6 +1182,28 @@ void UVulkanRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 				*(iptr++) = i;
 			}
 
+			if (wantMips)
+			{
+				// Recompute from the source points. The vertex buffer is write combined memory and slow to read back.
+				const FVector& p0 = pts[0]->Point;
+				const FVector& p1 = pts[1]->Point;
+				const FVector& p2 = pts[2]->Point;
+				vec2 uv0(Facet.MapCoords.XAxis | p0, Facet.MapCoords.YAxis | p0);
+				vec2 uv1(Facet.MapCoords.XAxis | p1, Facet.MapCoords.YAxis | p1);
+				vec2 uv2(Facet.MapCoords.XAxis | p2, Facet.MapCoords.YAxis | p2);
+
+				// Panning only moves the triangle in texture space, so the scale is all the mip selection needs
+				vec2 scale(UMult, VMult);
+				RequestTextureMip(tex, Surface.Texture, p0, p1, p2, uv0 * scale, uv1 * scale, uv2 * scale);
+				scale = vec2(MacroUMult, MacroVMult);
+				RequestTextureMip(macrotex, Surface.MacroTexture, p0, p1, p2, uv0 * scale, uv1 * scale, uv2 * scale);
+				if (!fogmap)
+				{
+					scale = vec2(DetailUMult, DetailVMult);
+					RequestTextureMip(detailtex, Surface.DetailTexture, p0, p1, p2, uv0 * scale, uv1 * scale, uv2 * scale);
+				}
+			}
+
 			UseVertices(vcount, icount);
 		}
 	}
@@ -1069,12 +1263,12 @@ void UVulkanRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Su
 				vptr->Position.z = point.Z;
 				vptr->TexCoord.s = (u - UPan) * UMult;
 				vptr->TexCoord.t = (v - VPan) * VMult;
-				vptr->TexCoord2.s = (u - LMUPan) * LMUMult;
-				vptr->TexCoord2.t = (v - LMVPan) * LMVMult;
+				vptr->TexCoord2.s = (u - LMUPan) * LMUMult + LMUOffset;
+				vptr->TexCoord2.t = (v - LMVPan) * LMVMult + LMVOffset;
 				vptr->TexCoord3.s = (u - MacroUPan) * MacroUMult;
 				vptr->TexCoord3.t = (v - MacroVPan) * MacroVMult;
-				vptr->TexCoord4.s = (u - DetailUPan) * DetailUMult;
-				vptr->TexCoord4.t = (v - DetailVPan) * DetailVMult;
+				vptr->TexCoord4.s = (u - DetailUPan) * DetailUMult + DetailUOffset;
+				vptr->TexCoord4.t = (v - DetailVPan) * DetailVMult + DetailVOffset;
 				vptr->Color = color;
 				vptr->TextureBinds = textureBinds;
 				vptr++;
@@ -1102,8 +1296,6 @@ void UVulkanRenderDevice::DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& In
 
 	PolyFlags = ApplyPrecedenceRules(PolyFlags);
 
-	SetPipeline(RenderPasses->GetPipeline(PolyFlags));
-
 	CachedTexture* tex = Textures->GetTexture(&Info, !!(PolyFlags & PF_Masked));
 	ivec4 textureBinds = GetTextureIndexes(PolyFlags, tex);
 
@@ -1113,6 +1305,8 @@ void UVulkanRenderDevice::DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& In
 
 	if ((PolyFlags & (PF_Translucent | PF_Modulated)) == 0 && LightMode == 2) flags |= 32;
 
+	SetPipeline(RenderPasses->GetPipeline(PolyFlags, flags, Batch.Pipeline));
+
 	auto alloc = ReserveVertices(NumPts, (NumPts - 2) * 3);
 	if (alloc.vptr)
 	{
@@ -1182,6 +1376,9 @@ void UVulkanRenderDevice::DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& In
 			*(iptr++) = i;
 		}
 
+		RequestTextureMip(tex, &Info, Pts[0]->Point, Pts[1]->Point, Pts[2]->Point,
+			vec2(Pts[0]->U * UMult, Pts[0]->V * VMult), vec2(Pts[1]->U * UMult, Pts[1]->V * VMult), vec2(Pts[2]->U * UMult, Pts[2]->V * VMult));
+
 		UseVertices(NumPts, (NumPts - 2) * 3);
 	}
 
@@ -1207,8 +1404,6 @@ void UVulkanRenderDevice::DrawGouraudTriangles(const FSceneNode* Frame, const FT
 
 	PolyFlags = ApplyPrecedenceRules(PolyFlags);
 
-	SetPipeline(RenderPasses->GetPipeline(PolyFlags));
-
 	CachedTexture* tex = Textures->GetTexture(const_cast<FTextureInfo*>(&Info), !!(PolyFlags & PF_Masked));
 	ivec4 textureBinds = GetTextureIndexes(PolyFlags, tex);
 
@@ -1218,6 +1413,8 @@ void UVulkanRenderDevice::DrawGouraudTriangles(const FSceneNode* Frame, const FT
 
 	if ((PolyFlags & (PF_Translucent | PF_Modulated)) == 0 && LightMode == 2) flags |= 32;
 
+	SetPipeline(RenderPasses->GetPipeline(PolyFlags, flags, Batch.Pipeline));
+
 	if (PolyFlags & PF_Environment)
 	{
 		FLOAT UScale = Info.UScale * Info.USize * (1.0f / 256.0f);
@@ -1287,6 +1484,16 @@ void UVulkanRenderDevice::DrawGouraudTriangles(const FSceneNode* Frame, const FT
 			}
 		}
 
+		if (tex && tex->WantedMip > 0)
+		{
+			for (INT i = 2; i < NumPts; i += 3)
+			{
+				const FTransTexture* P = &Pts[i - 2];
+				RequestTextureMip(tex, &Info, P[0].Point, P[1].Point, P[2].Point,
+					vec2(P[0].U * UMult, P[0].V * VMult), vec2(P[1].U * UMult, P[1].V * VMult), vec2(P[2].U * UMult, P[2].V * VMult));
+			}
+		}
+
 		bool mirror = (Frame->Mirror == -1.0);
 
 		size_t vstart = vpos;
@@ -1358,6 +1565,9 @@ void UVulkanRenderDevice::DrawTile(FSceneNode* Frame, FTextureInfo& Info, FLOAT
 	float v1 = (V + VL) * VMult;
 	bool clamp = (u0 >= 0.0f && u1 <= 1.00001f && v0 >= 0.0f && v1 <= 1.00001f);
 
+	if (tex && XL > 0.0f && YL > 0.0f)
+		Textures->RequestMip(tex, std::max(Abs(UL) / XL, Abs(VL) / YL));
+
 	SetPipeline(RenderPasses->GetPipeline(PolyFlags));
 	ivec4 textureBinds = GetTextureIndexes(PolyFlags, tex, clamp);
 
@@ -1570,8 +1780,8 @@ void UVulkanRenderDevice::ClearZ(FSceneNode* Frame)
 	attachment.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
 	attachment.clearValue.depthStencil.depth = 1.0f;
 	rect.layerCount = 1;
-	rect.rect.extent.width = Textures->Scene->Width;
-	rect.rect.extent.height = Textures->Scene->Height;
+	rect.rect.extent.width = Textures->Scene->RenderWidth;
+	rect.rect.extent.height = Textures->Scene->RenderHeight;
 	Commands->GetDrawCommands()->clearAttachments(1, &attachment, 1, &rect);
 	unguard;
 }
@@ -1636,9 +1846,34 @@ void UVulkanRenderDevice::ReadPixels(FColor* Pixels)
 {
 	guard(UVulkanRenderDevice::ReadPixels);
 
+	DrawBatch(Commands->GetDrawCommands());
+
+	// Converted to bgra8 on the GPU and copied into one of the persistent readback buffers
+	int width, height;
+	VulkanImage* image = PrepareScreenshotImage(width, height);
+	int readback = Capture->Record(image, width, height, false);
+
+	SubmitAndWait(false, 0, 0, false);
+
+	Capture->Read(readback, Pixels);
+
+	unguard;
+}
+
+VulkanImage* UVulkanRenderDevice::PrepareScreenshotImage(int& width, int& height)
+{
 	auto cmdbuffer = Commands->GetDrawCommands();
 
-	DrawBatch(cmdbuffer);
+	if (FusedPresentFrame)
+	{
+		// The fused present pass never filled the post process image. The color buffer and bloom levels it read are still there.
+		BlitSceneToPostprocess(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		if (Bloom)
+		{
+			CombineBloom();
+		}
+		FusedPresentFrame = false;
+	}
 
 	if (GammaCorrectScreenshots)
 	{
@@ -1661,8 +1896,6 @@ void UVulkanRenderDevice::ReadPixels(FColor* Pixels)
 		scissor.extent.width = Textures->Scene->Width;
 		scissor.extent.height = Textures->Scene->Height;
 
-		auto cmdbuffer = Commands->GetDrawCommands();
-
 		VkAccessFlags srcColorAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
 		VkAccessFlags dstColorAccess = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
 		VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
@@ -1672,93 +1905,30 @@ void UVulkanRenderDevice::ReadPixels(FColor* Pixels)
 			.AddImage(Textures->Scene->PPImage[1].get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, srcColorAccess, dstColorAccess)
 			.Execute(cmdbuffer, srcStages, dstStages);
 
-		RenderPassBegin()
-			.RenderPass(RenderPasses->Postprocess.RenderPass.get())
-			.Framebuffer(Framebuffers->PPImageFB[1].get())
-			.RenderArea(0, 0, Textures->Scene->Width, Textures->Scene->Height)
-			.AddClearColor(0.0f, 0.0f, 0.0f, 1.0f)
-			.Execute(cmdbuffer);
+		RenderPasses->BeginPostprocess(cmdbuffer, Framebuffers->PPImageFB[1].get(), Textures->Scene->PPImageView[1].get(), Textures->Scene->Width, Textures->Scene->Height);
 
 		cmdbuffer->setViewport(0, 1, &viewport);
 		cmdbuffer->setScissor(0, 1, &scissor);
-		cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, RenderPasses->Present.ScreenshotPipeline[presentShader].get());
+		VulkanPipeline* pipeline = RenderPasses->Present.ScreenshotPipeline[presentShader].get();
+		if (RenderPasses->Present.ScreenshotUpscalePipeline[presentShader] && (Textures->Scene->RenderWidth < Textures->Scene->Width || Textures->Scene->RenderHeight < Textures->Scene->Height))
+			pipeline = RenderPasses->Present.ScreenshotUpscalePipeline[presentShader].get();
+
+		cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 		cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, RenderPasses->Present.PipelineLayout.get(), 0, DescriptorSets->GetPresentSet());
 		cmdbuffer->pushConstants(RenderPasses->Present.PipelineLayout.get(), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PresentPushConstants), &pushconstants);
 		cmdbuffer->draw(6, 1, 0, 0);
 
-		cmdbuffer->endRenderPass();
+		RenderPasses->EndPass(cmdbuffer);
 
 		PipelineBarrier()
 			.AddImage(Textures->Scene->PPImage[1].get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
 			.Execute(cmdbuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
 	}
 
-	// Convert from rgba16f to bgra8 using the GPU:
-	auto srcimage = Textures->Scene->PPImage[GammaCorrectScreenshots ? 1 : 0].get();
-
-	int w = Viewport->SizeX;
-	int h = Viewport->SizeY;
-	void* data = Pixels;
-
-	auto dstimage = ImageBuilder()
-		.Format(VK_FORMAT_B8G8R8A8_UNORM)
-		.Usage(VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT)
-		.Size(w, h)
-		.DebugName("ReadPixelsDstImage")
-		.Create(Device.get());
-
-	PipelineBarrier()
-		.AddImage(srcimage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_READ_BIT)
-		.AddImage(dstimage.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT)
-		.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
-
-	VkImageBlit blit = {};
-	blit.srcOffsets[0] = { 0, 0, 0 };
-	blit.srcOffsets[1] = { srcimage->width, srcimage->height, 1 };
-	blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	blit.srcSubresource.mipLevel = 0;
-	blit.srcSubresource.baseArrayLayer = 0;
-	blit.srcSubresource.layerCount = 1;
-	blit.dstOffsets[0] = { 0, 0, 0 };
-	blit.dstOffsets[1] = { dstimage->width, dstimage->height, 1 };
-	blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	blit.dstSubresource.mipLevel = 0;
-	blit.dstSubresource.baseArrayLayer = 0;
-	blit.dstSubresource.layerCount = 1;
-	cmdbuffer->blitImage(
-		srcimage->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-		dstimage->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		1, &blit, VK_FILTER_NEAREST);
-
-	PipelineBarrier()
-		.AddImage(srcimage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
-		.AddImage(dstimage.get(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT)
-		.Execute(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
-
-	// Staging buffer for download
-	auto staging = BufferBuilder()
-		.Size(w * h * 4)
-		.Usage(VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU)
-		.DebugName("ReadPixelsStaging")
-		.Create(Device.get());
-
-	// Copy from image to buffer
-	VkBufferImageCopy region = {};
-	region.imageExtent.width = w;
-	region.imageExtent.height = h;
-	region.imageExtent.depth = 1;
-	region.imageSubresource.layerCount = 1;
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	cmdbuffer->copyImageToBuffer(dstimage->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, staging->buffer, 1, &region);
-
-	// Submit command buffers and wait for device to finish the work
-	SubmitAndWait(false, 0, 0, false);
-
-	uint8_t* pixels = (uint8_t*)staging->Map(0, w * h * 4);
-	memcpy(data, pixels, w * h * 4);
-	staging->Unmap();
-
-	unguard;
+	// The screenshot pass scales the image up to the output size like the present pass does
+	width = GammaCorrectScreenshots ? Textures->Scene->Width : Textures->Scene->RenderWidth;
+	height = GammaCorrectScreenshots ? Textures->Scene->Height : Textures->Scene->RenderHeight;
+	return Textures->Scene->PPImage[GammaCorrectScreenshots ? 1 : 0].get();
 }
 
 void UVulkanRenderDevice::EndFlash()
@@ -1819,11 +1989,15 @@ void UVulkanRenderDevice::SetSceneNode(FSceneNode* Frame)
 	RFX2 = 2.0f * RProjZ / Frame->FX;
 	RFY2 = 2.0f * RProjZ * Aspect / Frame->FY;
 
+	// The frame is in output pixels, the scene may be rendered at a lower resolution
+	float scaleX = Textures->Scene->RenderWidth / (float)Textures->Scene->Width;
+	float scaleY = Textures->Scene->RenderHeight / (float)Textures->Scene->Height;
+
 	viewportdesc = {};
-	viewportdesc.x = Frame->XB;
-	viewportdesc.y = Frame->YB;
-	viewportdesc.width = Frame->X;
-	viewportdesc.height = Frame->Y;
+	viewportdesc.x = Frame->XB * scaleX;
+	viewportdesc.y = Frame->YB * scaleY;
+	viewportdesc.width = Frame->X * scaleX;
+	viewportdesc.height = Frame->Y * scaleY;
 	viewportdesc.minDepth = 0.1f;
 	viewportdesc.maxDepth = 1.0f;
 	commands->setViewport(0, 1, &viewportdesc);
@@ -1842,6 +2016,27 @@ void UVulkanRenderDevice::PrecacheTexture(FTextureInfo& Info, DWORD PolyFlags)
 	unguard;
 }
 
+void UVulkanRenderDevice::FlushTextureCache()
+{
+	// The engine may free texture data after a flush, for example when it changes level
+	Uploads->WaitForHostImports();
+
+	if (VkKeepTexturesOnFlush)
+	{
+		Uploads->SubmitUploads();
+		DescriptorSets->ClearCache();
+		Textures->RevalidateCache();
+
+		// Textures released by the revalidation leave holes behind, which is what the defragmentation compacts
+		if (VkDefragment)
+			Textures->BeginDefragment();
+	}
+	else
+	{
+		ClearTextureCache();
+	}
+}
+
 void UVulkanRenderDevice::ClearTextureCache()
 {
 	DescriptorSets->ClearCache();
@@ -1849,35 +2044,37 @@ void UVulkanRenderDevice::ClearTextureCache()
 	Uploads->ClearCache();
 }
 
-void UVulkanRenderDevice::BlitSceneToPostprocess()
+void UVulkanRenderDevice::BlitSceneToPostprocess(VkImageLayout colorBufferLayout)
 {
 	auto buffers = Textures->Scene.get();
 	auto cmdbuffer = Commands->GetDrawCommands();
 
+	VkAccessFlags colorBufferAccess = (colorBufferLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : VK_ACCESS_SHADER_READ_BIT;
+
+	if (buffers->SceneSamples != VK_SAMPLE_COUNT_1_BIT)
+	{
+		// The scene pass already resolved the samples into PPImage[0]
+		PipelineBarrier()
+			.AddImage(
+				buffers->PPImage[0].get(),
+				colorBufferLayout,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				colorBufferAccess,
+				VK_ACCESS_SHADER_READ_BIT)
+			.Execute(
+				cmdbuffer,
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		return;
+	}
+
 	PipelineBarrier barrer0;
-	VkPipelineStageFlags srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 	barrer0.AddImage(
 		buffers->ColorBuffer.get(),
-		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		colorBufferLayout,
 		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-		VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+		colorBufferAccess,
 		VK_ACCESS_TRANSFER_READ_BIT);
-	if (HitData)
-	{
-		barrer0.AddImage(
-			buffers->HitBuffer.get(),
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-			VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-			VK_ACCESS_TRANSFER_READ_BIT);
-		barrer0.AddImage(
-			buffers->PPHitBuffer.get(),
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			VK_ACCESS_TRANSFER_READ_BIT,
-			VK_ACCESS_TRANSFER_WRITE_BIT);
-		srcStageMask |= VK_ACCESS_TRANSFER_WRITE_BIT;
-	}
 	barrer0.AddImage(
 		buffers->PPImage[0].get(),
 		VK_IMAGE_LAYOUT_UNDEFINED,
@@ -1886,255 +2083,186 @@ void UVulkanRenderDevice::BlitSceneToPostprocess()
 		VK_ACCESS_TRANSFER_WRITE_BIT);
 	barrer0.Execute(
 		Commands->GetDrawCommands(),
-		srcStageMask,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
 		VK_PIPELINE_STAGE_TRANSFER_BIT);
 
-	if (buffers->SceneSamples != VK_SAMPLE_COUNT_1_BIT)
-	{
-		VkImageResolve resolve = {};
-		resolve.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		resolve.srcSubresource.layerCount = 1;
-		resolve.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		resolve.dstSubresource.layerCount = 1;
-		resolve.extent = { (uint32_t)buffers->ColorBuffer->width, (uint32_t)buffers->ColorBuffer->height, 1 };
-		cmdbuffer->resolveImage(
-			buffers->ColorBuffer->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-			buffers->PPImage[0]->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1, &resolve);
-		if (HitData)
-		{
-			cmdbuffer->resolveImage(
-				buffers->HitBuffer->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				buffers->PPHitBuffer->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				1, &resolve);
-		}
-	}
-	else
-	{
-		auto colorBuffer = buffers->ColorBuffer.get();
-		VkImageBlit blit = {};
-		blit.srcOffsets[0] = { 0, 0, 0 };
-		blit.srcOffsets[1] = { colorBuffer->width, colorBuffer->height, 1 };
-		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		blit.srcSubresource.layerCount = 1;
-		blit.dstOffsets[0] = { 0, 0, 0 };
-		blit.dstOffsets[1] = { colorBuffer->width, colorBuffer->height, 1 };
-		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		blit.dstSubresource.layerCount = 1;
-		cmdbuffer->blitImage(
-			colorBuffer->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-			buffers->PPImage[0]->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1, &blit, VK_FILTER_NEAREST);
-		if (HitData)
-		{
-			VkImageCopy copy = {};
-			copy.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			copy.srcSubresource.layerCount = 1;
-			copy.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			copy.dstSubresource.layerCount = 1;
-			copy.extent = { (uint32_t)colorBuffer->width, (uint32_t)colorBuffer->height, (uint32_t)1 };
-			cmdbuffer->copyImage(
-				buffers->HitBuffer->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				buffers->PPHitBuffer->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-				1, &copy);
-		}
-	}
+	VkImageBlit blit = {};
+	blit.srcOffsets[0] = { 0, 0, 0 };
+	blit.srcOffsets[1] = { buffers->RenderWidth, buffers->RenderHeight, 1 };
+	blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	blit.srcSubresource.layerCount = 1;
+	blit.dstOffsets[0] = { 0, 0, 0 };
+	blit.dstOffsets[1] = { buffers->RenderWidth, buffers->RenderHeight, 1 };
+	blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	blit.dstSubresource.layerCount = 1;
+	cmdbuffer->blitImage(
+		buffers->ColorBuffer->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		buffers->PPImage[0]->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		1, &blit, VK_FILTER_NEAREST);
 
-	PipelineBarrier barrier1;
-	barrier1.AddImage(
-		buffers->PPImage[0].get(),
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		VK_ACCESS_TRANSFER_WRITE_BIT,
-		VK_ACCESS_SHADER_READ_BIT);
-	if (HitData)
-	{
-		barrier1.AddImage(
-			buffers->PPHitBuffer.get(),
+	PipelineBarrier()
+		.AddImage(
+			buffers->PPImage[0].get(),
 			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 			VK_ACCESS_TRANSFER_WRITE_BIT,
-			VK_ACCESS_TRANSFER_READ_BIT);
-	}
-	barrier1.Execute(
-		Commands->GetDrawCommands(),
-		VK_PIPELINE_STAGE_TRANSFER_BIT,
-		HitData ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+			VK_ACCESS_SHADER_READ_BIT)
+		.Execute(
+			Commands->GetDrawCommands(),
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+}
 
-	if (HitData)
-	{
-		VkBufferImageCopy copy = {};
-		copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		copy.imageSubresource.layerCount = 1;
-		copy.imageOffset = { (int32_t)Viewport->HitX, (int32_t)Viewport->HitY, (int32_t)0 };
-		copy.imageExtent = { (uint32_t)Viewport->HitXL, (uint32_t)Viewport->HitYL, (uint32_t)1 };
-		cmdbuffer->copyImageToBuffer(buffers->PPHitBuffer->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffers->StagingHitBuffer->buffer, 1, &copy);
+void UVulkanRenderDevice::ReduceHitBuffer()
+{
+	auto buffers = Textures->Scene.get();
+	auto cmdbuffer = Commands->GetDrawCommands();
 
-		PipelineBarrier()
-			.AddBuffer(buffers->StagingHitBuffer.get(), VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT)
-			.Execute(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
-	}
+	PipelineBarrier()
+		.AddBuffer(buffers->HitResultBuffer.get(), VK_ACCESS_HOST_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+	cmdbuffer->fillBuffer(buffers->HitResultBuffer->buffer, 0, sizeof(uint32_t), 0);
+
+	PipelineBarrier()
+		.AddImage(
+			buffers->HitBuffer.get(),
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT)
+		.AddBuffer(buffers->HitResultBuffer.get(), VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+		.Execute(
+			cmdbuffer,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	// Find the last hit in the requested rectangle on the GPU, so only a single value has to be read back
+	// The hit rectangle is in output pixels
+	int x0 = Viewport->HitX * buffers->RenderWidth / buffers->Width;
+	int y0 = Viewport->HitY * buffers->RenderHeight / buffers->Height;
+	int x1 = ((Viewport->HitX + Viewport->HitXL) * buffers->RenderWidth + buffers->Width - 1) / buffers->Width;
+	int y1 = ((Viewport->HitY + Viewport->HitYL) * buffers->RenderHeight + buffers->Height - 1) / buffers->Height;
+
+	HitReducePushConstants pushconstants;
+	pushconstants.HitX = x0;
+	pushconstants.HitY = y0;
+	pushconstants.HitWidth = std::max(x1 - x0, 1);
+	pushconstants.HitHeight = std::max(y1 - y0, 1);
+
+	VulkanPipeline* pipeline = buffers->SceneSamples != VK_SAMPLE_COUNT_1_BIT ? RenderPasses->HitReduce.PipelineMultisample.get() : RenderPasses->HitReduce.Pipeline.get();
+	cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_COMPUTE, RenderPasses->HitReduce.PipelineLayout.get(), 0, DescriptorSets->GetHitReduceSet());
+	cmdbuffer->pushConstants(RenderPasses->HitReduce.PipelineLayout.get(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HitReducePushConstants), &pushconstants);
+	cmdbuffer->dispatch((pushconstants.HitWidth + 15) / 16, (pushconstants.HitHeight + 15) / 16, 1);
+
+	PipelineBarrier()
+		.AddBuffer(buffers->HitResultBuffer.get(), VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT);
 }
 
 void UVulkanRenderDevice::RunBloomPass()
 {
-	float blurAmount = 0.6f + BloomAmount * (1.9f / 255.0f);
-	BloomPushConstants pushconstants;
-	ComputeBlurSamples(7, blurAmount, pushconstants.SampleWeights);
+	BuildBloomLevels(false);
+	CombineBloom();
+}
+
+void UVulkanRenderDevice::BuildBloomLevels(bool fromColorBuffer)
+{
+	BloomPushConstants pushconstants = GetBloomPushConstants();
 
 	auto cmdbuffer = Commands->GetDrawCommands();
+	auto scene = Textures->Scene.get();
+
+	// The previous frame may still be reading the bloom levels
+	PipelineBarrier barrier0;
+	for (int level = 0; level < NumBloomLevels; level++)
+		barrier0.AddImage(scene->BloomLevels[level].Texture.get(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+	barrier0.Execute(cmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	// Extract overbright pixels into the first level:
+	VulkanPipeline* downsample = RenderPasses->Bloom.Downsample.get();
+	VulkanDescriptorSet* downsampleSet = DescriptorSets->GetBloomDownsampleSet();
+	if (fromColorBuffer)
+		downsampleSet = DescriptorSets->GetBloomSceneDownsampleSet();
+
+	// Only the part of each level covering the rendered part of the scene is needed
+	int levelWidth[NumBloomLevels], levelHeight[NumBloomLevels];
+	for (int level = 0; level < NumBloomLevels; level++)
+	{
+		levelWidth[level] = ((level == 0 ? scene->RenderWidth : levelWidth[level - 1]) + 1) / 2;
+		levelHeight[level] = ((level == 0 ? scene->RenderHeight : levelHeight[level - 1]) + 1) / 2;
+	}
 
-	PipelineBarrier()
-		.AddImage(Textures->Scene->BloomBlurLevels[0].VTexture.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT)
-		.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-
-	// Extract overbright pixels that we want to bloom:
-	BloomStep(cmdbuffer,
-		RenderPasses->Bloom.Extract.get(),
-		DescriptorSets->GetBloomPPImageSet(),
-		Framebuffers->BloomBlurLevels[0].VTextureFB.get(),
-		Textures->Scene->BloomBlurLevels[0].Width,
-		Textures->Scene->BloomBlurLevels[0].Height,
-		pushconstants);
-
-	// Blur and downscale:
+	BloomDownsamplePushConstants downsampleConstants;
+	downsampleConstants.SourceWidth = scene->RenderWidth;
+	downsampleConstants.SourceHeight = scene->RenderHeight;
+
+	cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE, downsample);
+	cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_COMPUTE, RenderPasses->Bloom.DownsampleLayout.get(), 0, downsampleSet);
+	cmdbuffer->pushConstants(RenderPasses->Bloom.DownsampleLayout.get(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BloomDownsamplePushConstants), &downsampleConstants);
+	cmdbuffer->dispatch((levelWidth[0] + 15) / 16, (levelHeight[0] + 15) / 16, 1);
+
+	// Blur and downscale each level into the next smaller one. Blurring on the way down too gives the same weights as the old render pass chain.
 	for (int i = 0; i < NumBloomLevels - 1; i++)
 	{
+		// The level is written again by the upsample steps
 		PipelineBarrier()
-			.AddImage(Textures->Scene->BloomBlurLevels[i].HTexture.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT)
-			.AddImage(Textures->Scene->BloomBlurLevels[i].VTexture.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
-			.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-
-		// Gaussian blur
-		BloomStep(cmdbuffer,
-			RenderPasses->Bloom.BlurVertical.get(),
-			DescriptorSets->GetBloomVTextureSet(i),
-			Framebuffers->BloomBlurLevels[i].HTextureFB.get(),
-			Textures->Scene->BloomBlurLevels[i].Width,
-			Textures->Scene->BloomBlurLevels[i].Height,
-			pushconstants);
-
-		PipelineBarrier()
-			.AddImage(Textures->Scene->BloomBlurLevels[i].VTexture.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT)
-			.AddImage(Textures->Scene->BloomBlurLevels[i].HTexture.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
-			.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-
-		BloomStep(cmdbuffer,
-			RenderPasses->Bloom.BlurHorizontal.get(),
-			DescriptorSets->GetBloomHTextureSet(i),
-			Framebuffers->BloomBlurLevels[i].VTextureFB.get(),
-			Textures->Scene->BloomBlurLevels[i].Width,
-			Textures->Scene->BloomBlurLevels[i].Height,
-			pushconstants);
+			.AddImage(scene->BloomLevels[i].Texture.get(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+			.Execute(cmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 
-		PipelineBarrier()
-			.AddImage(Textures->Scene->BloomBlurLevels[i + 1].VTexture.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT)
-			.AddImage(Textures->Scene->BloomBlurLevels[i].VTexture.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
-			.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-
-		// Linear downscale
-		BloomStep(cmdbuffer,
-			RenderPasses->Bloom.Scale.get(),
-			DescriptorSets->GetBloomVTextureSet(i),
-			Framebuffers->BloomBlurLevels[i + 1].VTextureFB.get(),
-			Textures->Scene->BloomBlurLevels[i + 1].Width,
-			Textures->Scene->BloomBlurLevels[i + 1].Height,
-			pushconstants);
+		cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE, RenderPasses->Bloom.BlurDownsample.get());
+		cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_COMPUTE, RenderPasses->Bloom.UpsampleLayout.get(), 0, DescriptorSets->GetBloomBlurDownsampleSet(i));
+		cmdbuffer->pushConstants(RenderPasses->Bloom.UpsampleLayout.get(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BloomPushConstants), &pushconstants);
+		cmdbuffer->dispatch((levelWidth[i + 1] + 7) / 8, (levelHeight[i + 1] + 7) / 8, 1);
 	}
 
-	// Blur and upscale:
-	for (int i = NumBloomLevels - 1; i >= 0; i--)
+	// Blur and upscale each level into the next larger one, down to the first level:
+	for (int i = NumBloomLevels - 1; i > 0; i--)
 	{
 		PipelineBarrier()
-			.AddImage(Textures->Scene->BloomBlurLevels[i].HTexture.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT)
-			.AddImage(Textures->Scene->BloomBlurLevels[i].VTexture.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
-			.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-
-		// Gaussian blur
-		BloomStep(cmdbuffer,
-			RenderPasses->Bloom.BlurVertical.get(),
-			DescriptorSets->GetBloomVTextureSet(i),
-			Framebuffers->BloomBlurLevels[i].HTextureFB.get(),
-			Textures->Scene->BloomBlurLevels[i].Width,
-			Textures->Scene->BloomBlurLevels[i].Height,
-			pushconstants);
+			.AddImage(scene->BloomLevels[i].Texture.get(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+			.Execute(cmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 
-		PipelineBarrier()
-			.AddImage(Textures->Scene->BloomBlurLevels[i].VTexture.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT)
-			.AddImage(Textures->Scene->BloomBlurLevels[i].HTexture.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
-			.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-
-		BloomStep(cmdbuffer,
-			RenderPasses->Bloom.BlurHorizontal.get(),
-			DescriptorSets->GetBloomHTextureSet(i),
-			Framebuffers->BloomBlurLevels[i].VTextureFB.get(),
-			Textures->Scene->BloomBlurLevels[i].Width,
-			Textures->Scene->BloomBlurLevels[i].Height,
-			pushconstants);
-
-		// Linear upscale
-		if (i > 0)
-		{
-			PipelineBarrier()
-				.AddImage(Textures->Scene->BloomBlurLevels[i - 1].VTexture.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT)
-				.AddImage(Textures->Scene->BloomBlurLevels[i].VTexture.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
-				.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-
-			BloomStep(cmdbuffer,
-				RenderPasses->Bloom.Scale.get(),
-				DescriptorSets->GetBloomVTextureSet(i),
-				Framebuffers->BloomBlurLevels[i - 1].VTextureFB.get(),
-				Textures->Scene->BloomBlurLevels[i - 1].Width,
-				Textures->Scene->BloomBlurLevels[i - 1].Height,
-				pushconstants);
-		}
+		cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE, RenderPasses->Bloom.Upsample.get());
+		cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_COMPUTE, RenderPasses->Bloom.UpsampleLayout.get(), 0, DescriptorSets->GetBloomUpsampleSet(i));
+		cmdbuffer->pushConstants(RenderPasses->Bloom.UpsampleLayout.get(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BloomPushConstants), &pushconstants);
+		cmdbuffer->dispatch((levelWidth[i - 1] + 15) / 16, (levelHeight[i - 1] + 15) / 16, 1);
 	}
 
 	PipelineBarrier()
-		.AddImage(Textures->Scene->PPImage[0].get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT)
-		.AddImage(Textures->Scene->BloomBlurLevels[0].VTexture.get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
-		.Execute(cmdbuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
-
-	// Add bloom back to frame post process texture:
-	BloomStep(cmdbuffer,
-		RenderPasses->Bloom.Combine.get(),
-		DescriptorSets->GetBloomVTextureSet(0),
-		Framebuffers->PPImageFB[0].get(),
-		Textures->Scene->Width,
-		Textures->Scene->Height,
-		pushconstants);
-
-	PipelineBarrier()
-		.AddImage(Textures->Scene->PPImage[0].get(), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_SHADER_READ_BIT)
-		.Execute(cmdbuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+		.AddImage(scene->BloomLevels[0].Texture.get(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 }
 
-void UVulkanRenderDevice::BloomStep(VulkanCommandBuffer* cmdbuffer, VulkanPipeline* pipeline, VulkanDescriptorSet* input, VulkanFramebuffer* output, int width, int height, const BloomPushConstants& pushconstants)
+void UVulkanRenderDevice::CombineBloom()
 {
-	RenderPassBegin()
-		.RenderPass(pipeline != RenderPasses->Bloom.Combine.get() ? RenderPasses->Postprocess.RenderPass.get() : RenderPasses->Postprocess.RenderPassCombine.get())
-		.Framebuffer(output)
-		.RenderArea(0, 0, width, height)
-		.AddClearColor(0.0f, 0.0f, 0.0f, 1.0f)
-		.Execute(cmdbuffer);
+	BloomPushConstants pushconstants = GetBloomPushConstants();
 
-	VkViewport viewport = {};
-	viewport.width = (float)width;
-	viewport.height = (float)height;
-	viewport.maxDepth = 1.0f;
+	auto cmdbuffer = Commands->GetDrawCommands();
+	auto scene = Textures->Scene.get();
 
-	VkRect2D scissor = {};
-	scissor.extent.width = width;
-	scissor.extent.height = height;
+	PipelineBarrier()
+		.AddImage(scene->PPImage[0].get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 
-	cmdbuffer->setViewport(0, 1, &viewport);
-	cmdbuffer->setScissor(0, 1, &scissor);
-	cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-	cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, RenderPasses->Bloom.PipelineLayout.get(), 0, input);
-	cmdbuffer->pushConstants(RenderPasses->Bloom.PipelineLayout.get(), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(BloomPushConstants), &pushconstants);
-	cmdbuffer->draw(6, 1, 0, 0);
+	// The last step blurs the first level and adds it to the frame post process texture:
+	cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE, RenderPasses->Bloom.UpsampleCombine.get());
+	cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_COMPUTE, RenderPasses->Bloom.UpsampleLayout.get(), 0, DescriptorSets->GetBloomUpsampleSet(0));
+	cmdbuffer->pushConstants(RenderPasses->Bloom.UpsampleLayout.get(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(BloomPushConstants), &pushconstants);
+	cmdbuffer->dispatch((scene->RenderWidth + 15) / 16, (scene->RenderHeight + 15) / 16, 1);
 
-	cmdbuffer->endRenderPass();
+	PipelineBarrier()
+		.AddImage(scene->PPImage[0].get(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+}
+
+BloomPushConstants UVulkanRenderDevice::GetBloomPushConstants()
+{
+	float blurAmount = 0.6f + BloomAmount * (1.9f / 255.0f);
+	BloomPushConstants pushconstants;
+	ComputeBlurSamples(7, blurAmount, pushconstants.SampleWeights);
+	return pushconstants;
 }
 
 float UVulkanRenderDevice::ComputeBlurGaussian(float n, float theta) // theta = Blur Amount
@@ -2168,6 +2296,8 @@ PresentPushConstants UVulkanRenderDevice::GetPresentPushConstants()
 {
 	PresentPushConstants pushconstants;
 	pushconstants.HdrScale = 0.8f + HdrScale * (3.0f / 255.0f);
+	pushconstants.SourceScale = vec2(Textures->Scene->RenderWidth / (float)Textures->Scene->Width, Textures->Scene->RenderHeight / (float)Textures->Scene->Height);
+	pushconstants.Sharpness = VkUpscaleSharpness * (1.0f / 255.0f);
 	if (Viewport->IsOrtho())
 	{
 		pushconstants.GammaCorrection = { 1.0f };
@@ -2252,27 +2382,116 @@ void UVulkanRenderDevice::DrawPresentTexture(int width, int height)
 	scissor.extent.width = letterboxWidth;
 	scissor.extent.height = letterboxHeight;
 
+	if (FusedPresentFrame)
+	{
+		DrawFusedPresent(presentShader, pushconstants, scissor);
+		return;
+	}
+
 	auto cmdbuffer = Commands->GetDrawCommands();
 
 	PipelineBarrier()
 		.AddImage(Commands->SwapChain->GetImage(Commands->PresentImageIndex), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 0, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT)
 		.Execute(cmdbuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
 
-	RenderPassBegin()
-		.RenderPass(RenderPasses->Present.RenderPass.get())
-		.Framebuffer(Framebuffers->GetSwapChainFramebuffer())
-		.RenderArea(0, 0, Commands->SwapChain->Width(), Commands->SwapChain->Height())
-		.AddClearColor(0.0f, 0.0f, 0.0f, 1.0f)
-		.Execute(cmdbuffer);
+	RenderPasses->BeginPresent(cmdbuffer);
 	cmdbuffer->setViewport(0, 1, &viewport);
 	cmdbuffer->setScissor(0, 1, &scissor);
-	cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, RenderPasses->Present.Pipeline[presentShader].get());
+	// Only worth it when the scene is actually scaled up. A 1:1 present would come out the same, just slower.
+	VulkanPipeline* pipeline = RenderPasses->Present.Pipeline[presentShader].get();
+	if (RenderPasses->Present.UpscalePipeline[presentShader] && (letterboxWidth > Textures->Scene->RenderWidth || letterboxHeight > Textures->Scene->RenderHeight))
+		pipeline = RenderPasses->Present.UpscalePipeline[presentShader].get();
+
+	cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 	cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_GRAPHICS, RenderPasses->Present.PipelineLayout.get(), 0, DescriptorSets->GetPresentSet());
 	cmdbuffer->pushConstants(RenderPasses->Present.PipelineLayout.get(), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PresentPushConstants), &pushconstants);
 	cmdbuffer->draw(6, 1, 0, 0);
-	cmdbuffer->endRenderPass();
+	RenderPasses->EndPass(cmdbuffer);
 
 	PipelineBarrier()
 		.AddImage(Commands->SwapChain->GetImage(Commands->PresentImageIndex), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0)
 		.Execute(cmdbuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
 }
+
+bool UVulkanRenderDevice::CanUseFusedPresent()
+{
+	if (!RenderPasses->UseFusedPresent || !(Commands->SwapChain->ImageUsage() & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
+		return false;
+
+	// The fused pass reads the scene pixel for pixel and has no upscaling
+	if (Textures->Scene->RenderWidth != Textures->Scene->Width || Textures->Scene->RenderHeight != Textures->Scene->Height)
+		return false;
+
+	VkFormatProperties props = {};
+	vkGetPhysicalDeviceFormatProperties(Device->PhysicalDevice.Device, Commands->SwapChain->Format().format, &props);
+	return (props.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT) != 0;
+}
+
+void UVulkanRenderDevice::DrawFusedPresent(int presentShader, const PresentPushConstants& presentConstants, const VkRect2D& letterbox)
+{
+	auto scene = Textures->Scene.get();
+	auto cmdbuffer = Commands->GetDrawCommands();
+	auto swapImage = Commands->SwapChain->GetImage(Commands->PresentImageIndex);
+
+	// Storage images can't be BGRA8 portably, so the pass writes into an image of its own that is then blitted into the swap chain
+	VkFormat format = (presentShader & 1) ? VK_FORMAT_R16G16B16A16_SFLOAT : VK_FORMAT_R8G8B8A8_UNORM;
+	if (scene->FusedPresentFormat != format)
+	{
+		// The old image goes on the delete list and each frame index picks up the new one the next time it is used
+		scene->CreateFusedPresentImage(this, format);
+		DescriptorSets->InvalidateFusedPresentSets();
+	}
+
+	FusedPresentPushConstants pushconstants;
+	pushconstants.Present = presentConstants;
+	pushconstants.Bloom = GetBloomPushConstants();
+
+	PipelineBarrier()
+		.AddImage(scene->FusedPresentImage.get(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+	cmdbuffer->bindPipeline(VK_PIPELINE_BIND_POINT_COMPUTE, RenderPasses->FusedPresent.Pipeline[presentShader][Bloom ? 1 : 0].get());
+	cmdbuffer->bindDescriptorSet(VK_PIPELINE_BIND_POINT_COMPUTE, RenderPasses->FusedPresent.PipelineLayout.get(), 0, DescriptorSets->GetFusedPresentSet());
+	cmdbuffer->pushConstants(RenderPasses->FusedPresent.PipelineLayout.get(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(FusedPresentPushConstants), &pushconstants);
+	cmdbuffer->dispatch((scene->Width + 15) / 16, (scene->Height + 15) / 16, 1);
+
+	// The acquire semaphore waits at the color attachment output stage, so the swap chain transition has to chain from there
+	PipelineBarrier()
+		.AddImage(scene->FusedPresentImage.get(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT)
+		.AddImage(swapImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+	bool letterboxed = letterbox.offset.x != 0 || letterbox.offset.y != 0 || (int)letterbox.extent.width != swapImage->width || (int)letterbox.extent.height != swapImage->height;
+	if (letterboxed)
+	{
+		VkClearColorValue black = {};
+		VkImageSubresourceRange range = {};
+		range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		range.levelCount = 1;
+		range.layerCount = 1;
+		cmdbuffer->clearColorImage(swapImage->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &black, 1, &range);
+
+		PipelineBarrier()
+			.AddImage(swapImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_WRITE_BIT)
+			.Execute(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	}
+
+	VkImageBlit blit = {};
+	blit.srcOffsets[0] = { 0, 0, 0 };
+	blit.srcOffsets[1] = { scene->Width, scene->Height, 1 };
+	blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	blit.srcSubresource.layerCount = 1;
+	blit.dstOffsets[0] = { letterbox.offset.x, letterbox.offset.y, 0 };
+	blit.dstOffsets[1] = { letterbox.offset.x + (int32_t)letterbox.extent.width, letterbox.offset.y + (int32_t)letterbox.extent.height, 1 };
+	blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	blit.dstSubresource.layerCount = 1;
+	bool scaled = (int)letterbox.extent.width != scene->Width || (int)letterbox.extent.height != scene->Height;
+	cmdbuffer->blitImage(
+		scene->FusedPresentImage->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		swapImage->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		1, &blit, scaled ? VK_FILTER_LINEAR : VK_FILTER_NEAREST);
+
+	PipelineBarrier()
+		.AddImage(swapImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_ACCESS_TRANSFER_WRITE_BIT, 0)
+		.Execute(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+}
@@ -9,6 +9,8 @@
 #include "ShaderManager.h"
 #include "TextureManager.h"
 #include "UploadManager.h"
+#include "FrameCapture.h"
+#include "DynamicResolution.h"
 #include "vec.h"
 #include "mat.h"
 
@@ -85,6 +87,8 @@ public:
 	std::unique_ptr<DescriptorSetManager> DescriptorSets;
 	std::unique_ptr<RenderPassManager> RenderPasses;
 	std::unique_ptr<FramebufferManager> Framebuffers;
+	std::unique_ptr<FrameCapture> Capture;
+	std::unique_ptr<DynamicResolution> DynamicRes;
 
 	// Configuration.
 	BITFIELD UseVSync;
@@ -112,13 +116,30 @@ public:
 	INT VkDeviceIndex;
 	BITFIELD VkDebug;
 	BITFIELD VkExclusiveFullscreen;
+	BITFIELD VkHostMemoryImport;
+	BITFIELD VkLightmapAtlas;
+	BITFIELD VkTextureArrays;
+	BITFIELD VkKeepTexturesOnFlush;
+	BITFIELD VkMipStreaming;
+	BITFIELD VkDefragment;
+	BITFIELD VkDynamicRendering;
+	BITFIELD VkFusedPresent;
+	FLOAT VkRenderScale;
+	BITFIELD VkDynamicResolution;
+	FLOAT VkDynamicResolutionTarget;
+	BYTE VkUpscaler;
+	BYTE VkUpscaleSharpness;
+	BITFIELD VkCompactSceneFormat;
 
 	void RunBloomPass();
-	void BloomStep(VulkanCommandBuffer* cmdbuffer, VulkanPipeline* pipeline, VulkanDescriptorSet* input, VulkanFramebuffer* output, int width, int height, const BloomPushConstants &pushconstants);
+	void BuildBloomLevels(bool fromColorBuffer);
+	void CombineBloom();
+	BloomPushConstants GetBloomPushConstants();
 	static float ComputeBlurGaussian(float n, float theta);
 	static void ComputeBlurSamples(int sampleCount, float blurAmount, float* sampleWeights);
 
 	void DrawPresentTexture(int width, int height);
+	void DrawFusedPresent(int presentShader, const PresentPushConstants& presentConstants, const VkRect2D& letterbox);
 	PresentPushConstants GetPresentPushConstants();
 
 	struct
@@ -129,6 +150,9 @@ public:
 		int DrawCalls = 0;
 		int Uploads = 0;
 		int RectUploads = 0;
+		int HostImports = 0;
+		int ImagePoolHits = 0;
+		int ImagePoolMisses = 0;
 	} Stats;
 
 	int GetSettingsMultisample()
@@ -143,8 +167,15 @@ public:
 	}
 
 private:
+	void FlushTextureCache();
 	void ClearTextureCache();
-	void BlitSceneToPostprocess();
+	void BlitSceneToPostprocess(VkImageLayout colorBufferLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	void ReduceHitBuffer();
+	VulkanImage* PrepareScreenshotImage(int& width, int& height);
+	bool CanUseFusedPresent();
+
+	// Set when the fused present pass handles the current frame. Without multisampling PPImage[0] is then left unfilled until ReadPixels asks for it.
+	bool FusedPresentFrame = false;
 
 	struct VertexReserveInfo
 	{
@@ -198,7 +229,9 @@ private:
 	void SetPipeline(PipelineState* pipeline);
 	ivec4 GetTextureIndexes(DWORD PolyFlags, CachedTexture* tex, bool clamp = false);
 	ivec4 GetTextureIndexes(DWORD PolyFlags, CachedTexture* tex, CachedTexture* lightmap, CachedTexture* macrotex, CachedTexture* detailtex);
+	void RequestTextureMip(CachedTexture* tex, const FTextureInfo* Info, const FVector& p0, const FVector& p1, const FVector& p2, const vec2& t0, const vec2& t1, const vec2& t2);
 	void DrawBatch(VulkanCommandBuffer* cmdbuffer);
+	void SetSceneScissor(VulkanCommandBuffer* cmdbuffer);
 	void SubmitAndWait(bool present, int presentWidth, int presentHeight, bool presentFullscreen);
 
 	vec4 ApplyInverseGamma(vec4 color);
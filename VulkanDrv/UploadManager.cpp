@@ -6,6 +6,8 @@
 
 UploadManager::UploadManager(UVulkanRenderDevice* renderer) : renderer(renderer)
 {
+	if (renderer->VkHostMemoryImport && renderer->Device->SupportsExtension(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME))
+		HostImportAlignment = renderer->Device->PhysicalDevice.Properties.ExternalMemoryHost.minImportedHostPointerAlignment;
 }
 
 UploadManager::~UploadManager()
@@ -15,6 +17,7 @@ UploadManager::~UploadManager()
 void UploadManager::ClearCache()
 {
 	PendingUploads.clear();
+	HostImports.clear();
 }
 
 bool UploadManager::SupportsTextureFormat(ETextureFormat Format) const
@@ -22,7 +25,7 @@ bool UploadManager::SupportsTextureFormat(ETextureFormat Format) const
 	return TextureUploader::GetUploader(Format);
 }
 
-void UploadManager::UploadTexture(CachedTexture* tex, const FTextureInfo& Info, bool masked)
+void UploadManager::UploadTexture(CachedTexture* tex, const FTextureInfo& Info, bool masked, bool hostImport)
 {
 	int width = Info.USize;
 	int height = Info.VSize;
@@ -42,36 +45,250 @@ void UploadManager::UploadTexture(CachedTexture* tex, const FTextureInfo& Info,
 
 	VkFormat format = uploader ? uploader->GetVkFormat() : VK_FORMAT_R8G8B8A8_UNORM;
 
-	if (!tex->image)
+	// Move the texture out of its array layer if it no longer matches the size class
+	if (tex->ArrayTexture)
 	{
-		tex->image = ImageBuilder()
-			.Format(format)
-			.Size(width, height, mipcount)
-			.Usage(VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT)
-			.DebugName("CachedTexture.Image")
-			.Create(renderer->Device.get());
+		VulkanImage* arrayImage = tex->ArrayTexture->image.get();
+		if (!uploader || arrayImage->width != width || arrayImage->height != height || arrayImage->mipLevels != mipcount)
+		{
+			ClearPendingUploads(tex);
+			renderer->Textures->Arrays->Free(tex);
+		}
+	}
+
+	// Replace the image if the texture changed size
+	if (tex->image && (tex->image->width != width || tex->image->height != height || tex->image->mipLevels != mipcount))
+	{
+		renderer->Commands->GetCurrentDeleteList()->imageViews.push_back(std::move(tex->imageView));
+		renderer->Textures->Images->Release(std::move(tex->image));
+		tex->imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		tex->BindlessIndex = -1;
+	}
 
-		tex->imageView = ImageViewBuilder()
-			.Image(tex->image.get(), format)
-			.DebugName("CachedTexture.ImageView")
-			.Create(renderer->Device.get());
+	if (!tex->image && !tex->ArrayTexture)
+	{
+		tex->image = renderer->Textures->Images->Acquire(format, width, height, mipcount);
+		tex->imageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 	}
 
-	tex->pendingUploads[0].clear();
-	tex->pendingUploads[1].clear();
+	ClearPendingUploads(tex);
+
+	// Array layers share a single view and can't be streamed
+	INT firstLevel = uploader && tex->image ? GetStreamingTailLevel(Info) : 0;
+	if (tex->image)
+		SetResidentMip(tex, firstLevel, format);
+	tex->WantedMip = firstLevel;
 
 	if (uploader)
-		UploadData(tex, Info, masked, uploader);
+		UploadData(tex, Info, masked, uploader, firstLevel, -1, hostImport);
 	else
 		UploadWhite(tex);
 }
 
+int UploadManager::UploadMip(CachedTexture* tex, const FTextureInfo& Info, bool masked, INT level, bool hostImport)
+{
+	TextureUploader* uploader = TextureUploader::GetUploader(Info.Format);
+	if (!uploader || !tex->image || level < 0 || level >= Info.NumMips || tex->image->mipLevels != Info.NumMips || !Info.Mips[level]->DataPtr)
+		return 0;
+
+	UploadData(tex, Info, masked, uploader, level, level + 1, hostImport);
+	SetResidentMip(tex, level, uploader->GetVkFormat());
+
+	FMipmapBase* Mip = Info.Mips[level];
+	return uploader->GetUploadSize(0, 0, Mip->USize, Mip->VSize);
+}
+
+INT UploadManager::GetStreamingTailLevel(const FTextureInfo& Info) const
+{
+	// Realtime textures change every frame, so they always get all mips
+	if (!renderer->VkMipStreaming || Info.bRealtime || Info.NumMips < 2)
+		return 0;
+
+	INT level = 0;
+	while (level + 1 < Info.NumMips && std::max(Info.Mips[level]->USize, Info.Mips[level]->VSize) > StreamingTailSize)
+		level++;
+	return level;
+}
+
+void UploadManager::SetResidentMip(CachedTexture* tex, INT level, VkFormat format)
+{
+	if (tex->imageView && tex->ResidentMip == level)
+		return;
+
+	// Frames still in flight may use the old view until the bindless slot points at the new one
+	if (tex->imageView)
+		renderer->Commands->GetCurrentDeleteList()->imageViews.push_back(std::move(tex->imageView));
+
+	tex->imageView = ImageViewBuilder()
+		.Type(VK_IMAGE_VIEW_TYPE_2D_ARRAY)
+		.Image(tex->image.get(), format, VK_IMAGE_ASPECT_COLOR_BIT, level, 0, tex->image->mipLevels - level)
+		.DebugName("CachedTexture.ImageView")
+		.Create(renderer->Device.get());
+
+	tex->ResidentMip = level;
+	renderer->DescriptorSets->UpdateTextureView(tex);
+}
+
+void UploadManager::UploadRealtimeTexture(CachedTexture* tex, const FTextureInfo& Info, bool masked)
+{
+	// Only mip 0 is diffed. Anything that doesn't map directly onto the existing image gets a normal full upload.
+	TextureUploader* uploader = TextureUploader::GetUploader(Info.Format);
+	FMipmapBase* Mip = Info.NumMips > 0 ? Info.Mips[0] : nullptr;
+	if (!tex->image || !uploader || !Mip || !Mip->DataPtr ||
+		tex->image->width != Mip->USize || tex->image->height != Mip->VSize || tex->image->mipLevels != Info.NumMips)
+	{
+		tex->RealtimeShadow.clear();
+		UploadTexture(tex, Info, masked);
+		return;
+	}
+
+	RealtimeScratch.resize(uploader->GetUploadSize(0, 0, Mip->USize, Mip->VSize));
+	uploader->UploadRect(RealtimeScratch.data(), Mip, 0, 0, Mip->USize, Mip->VSize, Info.Palette, masked);
+
+	if (UploadDirtyRows(tex, Mip->USize, Mip->VSize, uploader) && Info.NumMips > 1)
+		UploadData(tex, Info, masked, uploader, 1);
+
+	std::swap(tex->RealtimeShadow, RealtimeScratch);
+}
+
+bool UploadManager::UploadDirtyRows(CachedTexture* tex, int width, int height, TextureUploader* uploader)
+{
+	const uint8_t* src = RealtimeScratch.data();
+	const uint8_t* shadow = tex->RealtimeShadow.data();
+	bool haveShadow = tex->RealtimeShadow.size() == RealtimeScratch.size();
+
+	// Block compressed formats can only be compared in whole block rows
+	int blockHeight = uploader->GetBlockHeight();
+	int bandHeight = blockHeight * std::max(16 / blockHeight, 1);
+	int pixelSize = blockHeight == 1 ? uploader->GetUploadSize(0, 0, 1, 1) : 0;
+	size_t pitch = (size_t)width * pixelSize;
+
+	auto uploadRect = [&](int x0, int y0, int x1, int y1, bool isPartial)
+	{
+		int w = x1 - x0;
+		int h = y1 - y0;
+		size_t pixelsSize = uploader->GetUploadSize(x0, y0, w, h);
+		size_t alignedSize = (pixelsSize + 15) / 16 * 16; // memory alignment
+
+		WaitIfUploadBufferIsFull(alignedSize);
+
+		uint8_t* data = renderer->Buffers->UploadDataArray[renderer->Commands->CurrentFrameIndex];
+		size_t& UploadBufferPos = renderer->Buffers->UploadBufferPositions[renderer->Commands->CurrentFrameIndex];
+		uint8_t* Ptr = data + UploadBufferPos;
+		if (blockHeight == 1)
+		{
+			for (int y = y0; y < y1; y++)
+			{
+				memcpy(Ptr, src + y * pitch + x0 * pixelSize, w * pixelSize);
+				Ptr += w * pixelSize;
+			}
+		}
+		else
+		{
+			memcpy(Ptr, src + uploader->GetUploadSize(0, 0, width, y0), pixelsSize);
+		}
+
+		VkBufferImageCopy region = {};
+		region.bufferOffset = UploadBufferPos;
+		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.imageSubresource.mipLevel = 0;
+		region.imageSubresource.layerCount = 1;
+		region.imageOffset = { (int32_t)x0, (int32_t)y0, 0 };
+		region.imageExtent = { (uint32_t)w, (uint32_t)h, 1 };
+		AddPendingUpload(tex, region, isPartial);
+
+		UploadBufferPos += alignedSize;
+	};
+
+	if (!haveShadow)
+	{
+		ClearPendingUploads(tex);
+		uploadRect(0, 0, width, height, false);
+		return true;
+	}
+
+	// Find the changed columns of each band and merge touching bands into a single region
+	bool changed = false;
+	bool inRect = false;
+	int rectX0 = 0, rectY0 = 0, rectX1 = 0, rectY1 = 0;
+	for (int y = 0; y < height; y += bandHeight)
+	{
+		int y1 = std::min(y + bandHeight, height);
+		int x0 = width;
+		int x1 = 0;
+		if (blockHeight == 1)
+		{
+			for (int row = y; row < y1; row++)
+			{
+				const uint8_t* a = src + row * pitch;
+				const uint8_t* b = shadow + row * pitch;
+				if (memcmp(a, b, pitch) == 0)
+					continue;
+
+				int first = 0;
+				while (memcmp(a + first * pixelSize, b + first * pixelSize, pixelSize) == 0)
+					first++;
+				int last = width - 1;
+				while (memcmp(a + last * pixelSize, b + last * pixelSize, pixelSize) == 0)
+					last--;
+
+				x0 = std::min(x0, first);
+				x1 = std::max(x1, last + 1);
+			}
+		}
+		else
+		{
+			size_t offset = uploader->GetUploadSize(0, 0, width, y);
+			if (memcmp(src + offset, shadow + offset, uploader->GetUploadSize(0, y, width, y1 - y)) != 0)
+			{
+				x0 = 0;
+				x1 = width;
+			}
+		}
+
+		if (x0 < x1)
+		{
+			if (inRect)
+			{
+				rectX0 = std::min(rectX0, x0);
+				rectX1 = std::max(rectX1, x1);
+				rectY1 = y1;
+			}
+			else
+			{
+				rectX0 = x0;
+				rectY0 = y;
+				rectX1 = x1;
+				rectY1 = y1;
+				inRect = true;
+			}
+		}
+		else if (inRect)
+		{
+			uploadRect(rectX0, rectY0, rectX1, rectY1, true);
+			inRect = false;
+			changed = true;
+		}
+	}
+
+	if (inRect)
+	{
+		uploadRect(rectX0, rectY0, rectX1, rectY1, true);
+		changed = true;
+	}
+
+	return changed;
+}
+
 void UploadManager::UploadTextureRect(CachedTexture* tex, const FTextureInfo& Info, int x, int y, int w, int h)
 {
 	TextureUploader* uploader = TextureUploader::GetUploader(Info.Format);
 	if (!uploader || Info.NumMips < 1 || x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > Info.Mips[0]->USize || y + h > Info.Mips[0]->VSize || !Info.Mips[0]->DataPtr)
 		return;
 
+	// The realtime shadow no longer matches what is on the GPU
+	tex->RealtimeShadow.clear();
+
 	size_t pixelsSize = uploader->GetUploadSize(x, y, w, h);
 	pixelsSize = (pixelsSize + 15) / 16 * 16; // memory alignment
 
@@ -95,13 +312,72 @@ void UploadManager::UploadTextureRect(CachedTexture* tex, const FTextureInfo& In
 	UploadBufferPos += pixelsSize;
 }
 
-void UploadManager::UploadData(CachedTexture* tex, const FTextureInfo& Info, bool masked, TextureUploader* uploader)
+void UploadManager::UploadAtlasRect(CachedTexture* page, const FTextureInfo& Info, int x, int y, int padding)
+{
+	TextureUploader* uploader = TextureUploader::GetUploader(Info.Format);
+	FMipmapBase* Mip = Info.Mips[0];
+	int width = Mip->USize;
+	int height = Mip->VSize;
+
+	AtlasScratch.resize((size_t)width * height);
+	uploader->UploadRect(AtlasScratch.data(), Mip, 0, 0, width, height, Info.Palette, false);
+
+	// Repeat the edge texels into the padding so that filtering never reads a neighbour
+	int paddedWidth = width + padding * 2;
+	int paddedHeight = height + padding * 2;
+	size_t pixelsSize = (size_t)paddedWidth * paddedHeight * sizeof(uint32_t);
+	pixelsSize = (pixelsSize + 15) / 16 * 16; // memory alignment
+
+	WaitIfUploadBufferIsFull(pixelsSize);
+
+	uint8_t* data = renderer->Buffers->UploadDataArray[renderer->Commands->CurrentFrameIndex];
+	size_t& UploadBufferPos = renderer->Buffers->UploadBufferPositions[renderer->Commands->CurrentFrameIndex];
+	uint32_t* Ptr = (uint32_t*)(data + UploadBufferPos);
+	for (int py = 0; py < paddedHeight; py++)
+	{
+		const uint32_t* src = AtlasScratch.data() + (size_t)std::min(std::max(py - padding, 0), height - 1) * width;
+		for (int px = 0; px < padding; px++)
+			*(Ptr++) = src[0];
+		memcpy(Ptr, src, width * sizeof(uint32_t));
+		Ptr += width;
+		for (int px = 0; px < padding; px++)
+			*(Ptr++) = src[width - 1];
+	}
+
+	VkBufferImageCopy region = {};
+	region.bufferOffset = UploadBufferPos;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset = { (int32_t)(x - padding), (int32_t)(y - padding), 0 };
+	region.imageExtent = { (uint32_t)paddedWidth, (uint32_t)paddedHeight, 1 };
+	AddPendingUpload(page, region, true);
+
+	UploadBufferPos += pixelsSize;
+}
+
+void UploadManager::UploadData(CachedTexture* tex, const FTextureInfo& Info, bool masked, TextureUploader* uploader, INT firstLevel, INT endLevel, bool hostImport)
 {
+	if (endLevel < 0 || endLevel > Info.NumMips)
+		endLevel = Info.NumMips;
+
+	// Large mips that the GPU can read directly from engine memory skip the upload buffer
+	uint32_t importedMips = 0;
+	if (hostImport && HostImportAlignment && !Info.bRealtime && !Info.bRealtimeChanged)
+	{
+		for (INT level = firstLevel; level < endLevel && level < 32; level++)
+		{
+			FMipmapBase* Mip = Info.Mips[level];
+			if (Mip->DataPtr && ImportHostMip(tex, Mip, level, uploader))
+				importedMips |= 1 << level;
+		}
+	}
+
 	size_t pixelsSize = 0;
-	for (INT level = 0; level < Info.NumMips; level++)
+	for (INT level = firstLevel; level < endLevel; level++)
 	{
 		FMipmapBase* Mip = Info.Mips[level];
-		if (Mip->DataPtr)
+		if (Mip->DataPtr && !(importedMips & (1 << level)))
 		{
 			INT mipsize = uploader->GetUploadSize(0, 0, Mip->USize, Mip->VSize);
 			mipsize = (mipsize + 15) / 16 * 16; // memory alignment
@@ -113,10 +389,10 @@ void UploadManager::UploadData(CachedTexture* tex, const FTextureInfo& Info, boo
 
 	size_t& UploadBufferPos = renderer->Buffers->UploadBufferPositions[renderer->Commands->CurrentFrameIndex];
 	uint8_t* UploadData = renderer->Buffers->UploadDataArray[renderer->Commands->CurrentFrameIndex];
-	for (INT level = 0; level < Info.NumMips; level++)
+	for (INT level = firstLevel; level < endLevel; level++)
 	{
 		FMipmapBase* Mip = Info.Mips[level];
-		if (Mip->DataPtr)
+		if (Mip->DataPtr && !(importedMips & (1 << level)))
 		{
 			uint32_t mipwidth = Mip->USize;
 			uint32_t mipheight = Mip->VSize;
@@ -157,6 +433,69 @@ void UploadManager::UploadWhite(CachedTexture* tex)
 	UploadBufferPos += 16; // 16-byte aligned
 }
 
+bool UploadManager::ImportHostMip(CachedTexture* tex, FMipmapBase* Mip, INT level, TextureUploader* uploader)
+{
+	// The GPU reads Mip->DataPtr when the transfer commands run, a frame or more after this returns. The caller must keep
+	// the mip data alive until then. Mips that are unloaded again right after the upload must go through the upload buffer.
+	if (!uploader->IsVerbatimCopy())
+		return false;
+
+	size_t size = uploader->GetUploadSize(0, 0, Mip->USize, Mip->VSize);
+	if (size < MinHostImportSize)
+		return false;
+
+	// The import must cover whole pages and the data offset within the first page must be valid for a buffer to image copy
+	uintptr_t start = (uintptr_t)Mip->DataPtr & ~(uintptr_t)(HostImportAlignment - 1);
+	uintptr_t end = ((uintptr_t)Mip->DataPtr + size + HostImportAlignment - 1) & ~(uintptr_t)(HostImportAlignment - 1);
+	VkDeviceSize offset = (uintptr_t)Mip->DataPtr - start;
+	if (offset % std::max(uploader->GetUploadSize(0, 0, 1, 1), 4) != 0)
+		return false;
+
+	auto buffer = BufferBuilder()
+		.Usage(VK_BUFFER_USAGE_TRANSFER_SRC_BIT)
+		.Size(end - start)
+		.ImportHostPointer((void*)start)
+		.DebugName("UploadManager.HostImport")
+		.TryCreate(renderer->Device.get());
+	if (!buffer)
+		return false;
+
+	HostImport hostImport;
+	hostImport.tex = tex->GetUploadTexture();
+	hostImport.buffer = buffer->buffer;
+	hostImport.region = {};
+	hostImport.region.bufferOffset = offset;
+	hostImport.region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	hostImport.region.imageSubresource.mipLevel = level;
+	hostImport.region.imageSubresource.baseArrayLayer = tex->ArrayLayer;
+	hostImport.region.imageSubresource.layerCount = 1;
+	hostImport.region.imageExtent = { (uint32_t)Mip->USize, (uint32_t)Mip->VSize, 1 };
+	HostImports.push_back(hostImport);
+	HostImportSerial = renderer->Commands->GetNextSubmitSerial();
+	AddPendingTexture(tex);
+
+	// The copy is submitted with this frame, so the buffer can go away when the frame is done
+	renderer->Commands->GetCurrentDeleteList()->buffers.push_back(std::move(buffer));
+	return true;
+}
+
+void UploadManager::WaitForHostImports()
+{
+	if (HostImportSerial == 0)
+		return;
+
+	if (HostImportSerial == renderer->Commands->GetNextSubmitSerial())
+	{
+		// Not submitted yet. WaitForTransfer submits the transfer commands with the copies and waits for them.
+		renderer->Commands->WaitForTransfer();
+	}
+	else
+	{
+		renderer->Commands->WaitForSubmit(HostImportSerial);
+	}
+	HostImportSerial = 0;
+}
+
 void UploadManager::WaitIfUploadBufferIsFull(int bytes)
 {
 	size_t UploadBufferPos = renderer->Buffers->UploadBufferPositions[renderer->Commands->CurrentFrameIndex];
@@ -166,15 +505,49 @@ void UploadManager::WaitIfUploadBufferIsFull(int bytes)
 	}
 }
 
-void UploadManager::AddPendingUpload(CachedTexture* tex, const VkBufferImageCopy& region, bool isPartial)
+void UploadManager::AddPendingTexture(CachedTexture* tex)
 {
+	tex = tex->GetUploadTexture();
 	if (!tex->inPendingUploads)
 	{
 		PendingUploads.push_back(tex);
 		tex->inPendingUploads = true;
 	}
+}
+
+void UploadManager::AddPendingUpload(CachedTexture* tex, const VkBufferImageCopy& region, bool isPartial)
+{
+	AddPendingTexture(tex);
+	if (tex->ArrayTexture)
+	{
+		VkBufferImageCopy layerRegion = region;
+		layerRegion.imageSubresource.baseArrayLayer = tex->ArrayLayer;
+		tex->ArrayTexture->pendingUploads[isPartial].push_back(layerRegion);
+	}
+	else
+	{
+		tex->pendingUploads[isPartial].push_back(region);
+	}
+}
 
-	tex->pendingUploads[isPartial].push_back(region);
+void UploadManager::ClearPendingUploads(CachedTexture* tex)
+{
+	// Only the texture's own layer is cleared when it shares an array image
+	CachedTexture* owner = tex->GetUploadTexture();
+	uint32_t layer = tex->ArrayLayer;
+	auto isLayer = [=](const VkBufferImageCopy& region) { return region.imageSubresource.baseArrayLayer == layer; };
+	for (auto& regions : owner->pendingUploads)
+	{
+		if (tex->ArrayTexture)
+			regions.erase(std::remove_if(regions.begin(), regions.end(), isLayer), regions.end());
+		else
+			regions.clear();
+	}
+
+	if (!HostImports.empty())
+	{
+		HostImports.erase(std::remove_if(HostImports.begin(), HostImports.end(), [=](const HostImport& hostImport) { return hostImport.tex == owner && isLayer(hostImport.region); }), HostImports.end());
+	}
 }
 
 void UploadManager::SubmitUploads()
@@ -183,6 +556,7 @@ void UploadManager::SubmitUploads()
 		return;
 
 	auto cmdbuffer = renderer->Commands->GetTransferCommands();
+	LastUploadSerial = renderer->Commands->GetNextSubmitSerial();
 
 	// Transition images to transfer
 	PipelineBarrier beforeBarrier;
@@ -195,7 +569,8 @@ void UploadManager::SubmitUploads()
 			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
 			VK_ACCESS_TRANSFER_WRITE_BIT,
 			VK_IMAGE_ASPECT_COLOR_BIT,
-			0, tex->image->mipLevels);
+			0, tex->image->mipLevels,
+			0, tex->image->layerCount);
 
 		tex->imageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
 	}
@@ -218,6 +593,15 @@ void UploadManager::SubmitUploads()
 				cmdbuffer->copyBufferToImage(buffer, tex->image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, tex->pendingUploads[i].size(), tex->pendingUploads[i].data());
 			}
 		}
+
+		if (i == 0)
+		{
+			for (const HostImport& hostImport : HostImports)
+			{
+				renderer->Stats.HostImports++;
+				cmdbuffer->copyBufferToImage(hostImport.buffer, hostImport.tex->image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &hostImport.region);
+			}
+		}
 	}
 
 	// Transition images to texture sampling
@@ -231,7 +615,8 @@ void UploadManager::SubmitUploads()
 			VK_ACCESS_TRANSFER_WRITE_BIT,
 			VK_ACCESS_SHADER_READ_BIT,
 			VK_IMAGE_ASPECT_COLOR_BIT,
-			0, tex->image->mipLevels);
+			0, tex->image->mipLevels,
+			0, tex->image->layerCount);
 
 		tex->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	}
@@ -245,5 +630,11 @@ void UploadManager::SubmitUploads()
 		tex->inPendingUploads = false;
 	}
 	PendingUploads.clear();
+	HostImports.clear();
 	renderer->Buffers->UploadBufferPositions[renderer->Commands->CurrentFrameIndex] = 0;
 }
+
+bool UploadManager::IsIdle()
+{
+	return PendingUploads.empty() && renderer->Commands->IsSubmitFinished(LastUploadSerial);
+}
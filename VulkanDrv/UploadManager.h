@@ -15,20 +15,55 @@ public:
 
 	bool SupportsTextureFormat(ETextureFormat Format) const;
 
-	void UploadTexture(CachedTexture* tex, const FTextureInfo& Info, bool masked);
+	// Pass hostImport = false when the mip data may be freed before the next submit has finished on the GPU
+	void UploadTexture(CachedTexture* tex, const FTextureInfo& Info, bool masked, bool hostImport = true);
+	void UploadRealtimeTexture(CachedTexture* tex, const FTextureInfo& Info, bool masked);
 	void UploadTextureRect(CachedTexture* tex, const FTextureInfo& Info, int x, int y, int w, int h);
+	void UploadAtlasRect(CachedTexture* page, const FTextureInfo& Info, int x, int y, int padding);
+	int UploadMip(CachedTexture* tex, const FTextureInfo& Info, bool masked, INT level, bool hostImport = true);
 
 	void SubmitUploads();
 
+	// True when nothing is waiting to be uploaded and the last upload has finished on the GPU
+	bool IsIdle();
+
+	// Waits until the GPU no longer reads engine memory imported by earlier uploads
+	void WaitForHostImports();
+
 	void ClearCache();
 
 private:
-	void UploadData(CachedTexture* tex, const FTextureInfo& Info, bool masked, TextureUploader* uploader);
+	void UploadData(CachedTexture* tex, const FTextureInfo& Info, bool masked, TextureUploader* uploader, INT firstLevel = 0, INT endLevel = -1, bool hostImport = false);
+	INT GetStreamingTailLevel(const FTextureInfo& Info) const;
+	void SetResidentMip(CachedTexture* tex, INT level, VkFormat format);
+	bool UploadDirtyRows(CachedTexture* tex, int width, int height, TextureUploader* uploader);
 	void UploadWhite(CachedTexture* tex);
+	bool ImportHostMip(CachedTexture* tex, FMipmapBase* Mip, INT level, TextureUploader* uploader);
 	void WaitIfUploadBufferIsFull(int bytes);
+	void AddPendingTexture(CachedTexture* tex);
 	void AddPendingUpload(CachedTexture* tex, const VkBufferImageCopy& region, bool isPartial);
+	void ClearPendingUploads(CachedTexture* tex);
 
 	UVulkanRenderDevice* renderer = nullptr;
 
 	std::vector<CachedTexture*> PendingUploads;
+	uint64_t LastUploadSerial = 0;
+
+	// Mips copied directly from engine memory using VK_EXT_external_memory_host
+	struct HostImport
+	{
+		CachedTexture* tex;
+		VkBuffer buffer;
+		VkBufferImageCopy region;
+	};
+	std::vector<HostImport> HostImports;
+	uint64_t HostImportSerial = 0; // Submit that copies the last imported mip
+	VkDeviceSize HostImportAlignment = 0;
+	enum { MinHostImportSize = 256 * 1024 };
+
+	// Largest mip uploaded up front when VkMipStreaming is on
+	enum { StreamingTailSize = 64 };
+
+	std::vector<uint8_t> RealtimeScratch;
+	std::vector<uint32_t> AtlasScratch;
 };
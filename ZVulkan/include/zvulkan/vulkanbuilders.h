@@ -52,6 +52,7 @@ public:
 	VulkanDeviceBuilder& OptionalExtension(const std::string& extensionName);
 	VulkanDeviceBuilder& OptionalRayQuery();
 	VulkanDeviceBuilder& OptionalDescriptorIndexing();
+	VulkanDeviceBuilder& OptionalDynamicRendering();
 	VulkanDeviceBuilder& Surface(std::shared_ptr<VulkanSurface> surface);
 	VulkanDeviceBuilder& SelectDevice(int index);
 
@@ -189,15 +190,20 @@ public:
 	BufferBuilder& Usage(VkBufferUsageFlags bufferUsage, VmaMemoryUsage memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY, VmaAllocationCreateFlags allocFlags = 0);
 	BufferBuilder& MemoryType(VkMemoryPropertyFlags requiredFlags, VkMemoryPropertyFlags preferredFlags, uint32_t memoryTypeBits = 0);
 	BufferBuilder& MinAlignment(VkDeviceSize memoryAlignment);
+	BufferBuilder& ImportHostPointer(void* pointer); // Requires VK_EXT_external_memory_host. Pointer and size must be aligned to minImportedHostPointerAlignment
 	BufferBuilder& DebugName(const char* name) { debugName = name; return *this; }
 
 	std::unique_ptr<VulkanBuffer> Create(VulkanDevice *device);
+	std::unique_ptr<VulkanBuffer> TryCreate(VulkanDevice *device);
 
 private:
+	std::unique_ptr<VulkanBuffer> TryImport(VulkanDevice *device);
+
 	VkBufferCreateInfo bufferInfo = {};
 	VmaAllocationCreateInfo allocInfo = {};
 	const char* debugName = nullptr;
 	VkDeviceSize minAlignment = 0;
+	void* hostPointer = nullptr;
 };
 
 enum class ShaderType
@@ -234,12 +240,18 @@ public:
 	ShaderBuilder& OnIncludeSystem(std::function<ShaderIncludeResult(std::string headerName, std::string includerName, size_t inclusionDepth)> onIncludeSystem);
 	ShaderBuilder& OnIncludeLocal(std::function<ShaderIncludeResult(std::string headerName, std::string includerName, size_t inclusionDepth)> onIncludeLocal);
 
+	ShaderBuilder& SpirvCode(std::vector<uint32_t> code) { spirvCode = std::move(code); return *this; }
+
 	ShaderBuilder& DebugName(const char* name) { debugName = name; return *this; }
 
+	std::vector<uint32_t> CompileSpirv(VulkanDevice *device);
 	std::unique_ptr<VulkanShader> Create(const char *shadername, VulkanDevice *device);
 
+	static std::string GetCompilerVersion();
+
 private:
 	std::vector<std::pair<std::string, std::string>> sources;
+	std::vector<uint32_t> spirvCode;
 	std::function<ShaderIncludeResult(std::string headerName, std::string includerName, size_t inclusionDepth)> onIncludeSystem;
 	std::function<ShaderIncludeResult(std::string headerName, std::string includerName, size_t inclusionDepth)> onIncludeLocal;
 	int stage = 0;
@@ -272,6 +284,7 @@ public:
 	ComputePipelineBuilder& Cache(VulkanPipelineCache* cache);
 	ComputePipelineBuilder& Layout(VulkanPipelineLayout *layout);
 	ComputePipelineBuilder& ComputeShader(VulkanShader *shader);
+	ComputePipelineBuilder& AddSpecializationConstant(uint32_t constantID, uint32_t value);
 	ComputePipelineBuilder& DebugName(const char* name) { debugName = name; return *this; }
 
 	std::unique_ptr<VulkanPipeline> Create(VulkanDevice *device);
@@ -279,6 +292,9 @@ public:
 private:
 	VkComputePipelineCreateInfo pipelineInfo = {};
 	VkPipelineShaderStageCreateInfo stageInfo = {};
+	std::vector<VkSpecializationMapEntry> specializationEntries;
+	std::vector<uint32_t> specializationData;
+	VkSpecializationInfo specializationInfo = { };
 	VulkanPipelineCache* cache = nullptr;
 	const char* debugName = nullptr;
 };
@@ -379,6 +395,8 @@ public:
 	GraphicsPipelineBuilder& Subpass(int subpass);
 	GraphicsPipelineBuilder& Layout(VulkanPipelineLayout *layout);
 	GraphicsPipelineBuilder& RenderPass(VulkanRenderPass *renderPass);
+	GraphicsPipelineBuilder& AddColorAttachmentFormat(VkFormat format);
+	GraphicsPipelineBuilder& DepthAttachmentFormat(VkFormat format);
 	GraphicsPipelineBuilder& Topology(VkPrimitiveTopology topology);
 	GraphicsPipelineBuilder& Viewport(float x, float y, float width, float height, float minDepth = 0.0f, float maxDepth = 1.0f);
 	GraphicsPipelineBuilder& Scissor(int x, int y, int width, int height);
@@ -395,6 +413,7 @@ public:
 
 	GraphicsPipelineBuilder& AddVertexShader(VulkanShader *shader);
 	GraphicsPipelineBuilder& AddFragmentShader(VulkanShader *shader);
+	GraphicsPipelineBuilder& AddSpecializationConstant(VkShaderStageFlags stages, uint32_t constantID, uint32_t value);
 
 	GraphicsPipelineBuilder& AddVertexBufferBinding(int index, size_t stride);
 	GraphicsPipelineBuilder& AddVertexAttribute(int location, int binding, VkFormat format, size_t offset);
@@ -417,12 +436,18 @@ private:
 	VkPipelineColorBlendStateCreateInfo colorBlending = { };
 	VkPipelineDepthStencilStateCreateInfo depthStencil = { };
 	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	VkPipelineRenderingCreateInfo renderingInfo = { VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO };
 
 	std::vector<VkPipelineShaderStageCreateInfo> shaderStages;
+	std::vector<VkFormat> colorAttachmentFormats;
 	std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments;
 	std::vector<VkVertexInputBindingDescription> vertexInputBindings;
 	std::vector<VkVertexInputAttributeDescription> vertexInputAttributes;
 	std::vector<VkDynamicState> dynamicStates;
+	std::vector<VkSpecializationMapEntry> specializationEntries;
+	std::vector<uint32_t> specializationData;
+	VkSpecializationInfo specializationInfo = { };
+	VkShaderStageFlags specializationStages = 0;
 
 	VulkanPipelineCache* cache = nullptr;
 	const char* debugName = nullptr;
@@ -477,6 +502,7 @@ public:
 
 	RenderPassBuilder& AddSubpass();
 	RenderPassBuilder& AddSubpassColorAttachmentRef(uint32_t index, VkImageLayout layout);
+	RenderPassBuilder& AddSubpassResolveAttachmentRef(uint32_t index, VkImageLayout layout);
 	RenderPassBuilder& AddSubpassDepthStencilAttachmentRef(uint32_t index, VkImageLayout layout);
 
 	RenderPassBuilder& DebugName(const char* name) { debugName = name; return *this; }
@@ -493,6 +519,7 @@ private:
 	struct SubpassData
 	{
 		std::vector<VkAttachmentReference> colorRefs;
+		std::vector<VkAttachmentReference> resolveRefs;
 		VkAttachmentReference depthRef = { };
 	};
 
@@ -546,6 +573,8 @@ public:
 	WriteDescriptors& AddStorageImage(VulkanDescriptorSet *descriptorSet, int binding, VulkanImageView *view, VkImageLayout imageLayout);
 	WriteDescriptors& AddCombinedImageSampler(VulkanDescriptorSet *descriptorSet, int binding, VulkanImageView *view, VulkanSampler *sampler, VkImageLayout imageLayout);
 	WriteDescriptors& AddCombinedImageSampler(VulkanDescriptorSet* descriptorSet, int binding, int arrayIndex, VulkanImageView* view, VulkanSampler* sampler, VkImageLayout imageLayout);
+	WriteDescriptors& AddSampledImage(VulkanDescriptorSet* descriptorSet, int binding, int arrayIndex, VulkanImageView* view, VkImageLayout imageLayout);
+	WriteDescriptors& AddSampler(VulkanDescriptorSet* descriptorSet, int binding, int arrayIndex, VulkanSampler* sampler);
 	WriteDescriptors& AddAccelerationStructure(VulkanDescriptorSet* descriptorSet, int binding, VulkanAccelerationStructure* accelStruct);
 	void Execute(VulkanDevice *device);
 
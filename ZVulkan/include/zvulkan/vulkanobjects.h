@@ -43,6 +43,7 @@ class VulkanBuffer
 {
 public:
 	VulkanBuffer(VulkanDevice *device, VkBuffer buffer, VmaAllocation allocation, size_t size);
+	VulkanBuffer(VulkanDevice *device, VkBuffer buffer, VkDeviceMemory importedMemory, size_t size);
 	~VulkanBuffer();
 
 	VkDeviceAddress GetDeviceAddress()
@@ -62,7 +63,8 @@ public:
 	VulkanDevice *device = nullptr;
 
 	VkBuffer buffer;
-	VmaAllocation allocation;
+	VmaAllocation allocation = VK_NULL_HANDLE;
+	VkDeviceMemory importedMemory = VK_NULL_HANDLE;
 	size_t size = 0;
 
 	void *Map(size_t offset, size_t size);
@@ -106,6 +108,8 @@ public:
 	void *Map(size_t offset, size_t size);
 	void Unmap();
 
+	VmaAllocation GetAllocation() const { return allocation; }
+
 private:
 	VulkanDevice *device = nullptr;
 	VmaAllocation allocation;
@@ -361,15 +365,37 @@ private:
 	std::vector<VkClearValue> clearValues;
 };
 
+// Begins rendering directly into image views with VK_KHR_dynamic_rendering
+class RenderingBegin
+{
+public:
+	RenderingBegin();
+
+	RenderingBegin& RenderArea(int x, int y, int width, int height);
+	RenderingBegin& AddColorAttachment(VulkanImageView* view, VkAttachmentLoadOp loadOp, VkAttachmentStoreOp storeOp, float r = 0.0f, float g = 0.0f, float b = 0.0f, float a = 0.0f);
+	RenderingBegin& ResolveAttachment(VulkanImageView* view, VkResolveModeFlagBits mode = VK_RESOLVE_MODE_AVERAGE_BIT);
+	RenderingBegin& DepthAttachment(VulkanImageView* view, VkAttachmentLoadOp loadOp, VkAttachmentStoreOp storeOp, float clearDepth = 1.0f);
+	RenderingBegin& Flags(VkRenderingFlags flags);
+
+	void Execute(VulkanCommandBuffer* cmdbuffer);
+
+	VkRenderingInfo renderingInfo = {};
+
+private:
+	std::vector<VkRenderingAttachmentInfo> colorAttachments;
+	VkRenderingAttachmentInfo depthAttachment = {};
+};
+
 class VulkanCommandBuffer
 {
 public:
-	VulkanCommandBuffer(VulkanCommandPool *pool);
+	VulkanCommandBuffer(VulkanCommandPool *pool, VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 	~VulkanCommandBuffer();
 
 	void SetDebugName(const char *name);
 
 	void begin();
+	void begin(const VkCommandBufferInheritanceInfo* inheritance);
 	void end();
 
 	void bindPipeline(VkPipelineBindPoint pipelineBindPoint, VulkanPipeline *pipeline);
@@ -425,6 +451,8 @@ public:
 	void beginRenderPass(const VkRenderPassBeginInfo* pRenderPassBegin, VkSubpassContents contents);
 	void nextSubpass(VkSubpassContents contents);
 	void endRenderPass();
+	void beginRendering(const VkRenderingInfo* pRenderingInfo);
+	void endRendering();
 	void executeCommands(uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers);
 
 	void buildAccelerationStructures(uint32_t infoCount, const VkAccelerationStructureBuildGeometryInfoKHR* pInfos, const VkAccelerationStructureBuildRangeInfoKHR* const* ppBuildRangeInfos);
@@ -450,7 +478,7 @@ public:
 
 	void SetDebugName(const char *name) { device->SetObjectName(name, (uint64_t)pool, VK_OBJECT_TYPE_COMMAND_POOL); }
 
-	std::unique_ptr<VulkanCommandBuffer> createBuffer();
+	std::unique_ptr<VulkanCommandBuffer> createBuffer(VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
 
 	VkCommandPool pool = VK_NULL_HANDLE;
 
@@ -508,9 +536,21 @@ inline VulkanBuffer::VulkanBuffer(VulkanDevice *device, VkBuffer buffer, VmaAllo
 {
 }
 
+inline VulkanBuffer::VulkanBuffer(VulkanDevice *device, VkBuffer buffer, VkDeviceMemory importedMemory, size_t size) : device(device), buffer(buffer), importedMemory(importedMemory), size(size)
+{
+}
+
 inline VulkanBuffer::~VulkanBuffer()
 {
-	vmaDestroyBuffer(device->allocator, buffer, allocation);
+	if (allocation)
+	{
+		vmaDestroyBuffer(device->allocator, buffer, allocation);
+	}
+	else
+	{
+		vkDestroyBuffer(device->device, buffer, nullptr);
+		vkFreeMemory(device->device, importedMemory, nullptr);
+	}
 }
 
 inline void *VulkanBuffer::Map(size_t offset, size_t size)
@@ -543,9 +583,9 @@ inline VulkanCommandPool::~VulkanCommandPool()
 	vkDestroyCommandPool(device->device, pool, nullptr);
 }
 
-inline std::unique_ptr<VulkanCommandBuffer> VulkanCommandPool::createBuffer()
+inline std::unique_ptr<VulkanCommandBuffer> VulkanCommandPool::createBuffer(VkCommandBufferLevel level)
 {
-	return std::make_unique<VulkanCommandBuffer>(this);
+	return std::make_unique<VulkanCommandBuffer>(this, level);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -628,11 +668,78 @@ inline void RenderPassBegin::Execute(VulkanCommandBuffer* cmdbuffer, VkSubpassCo
 
 /////////////////////////////////////////////////////////////////////////////
 
-inline VulkanCommandBuffer::VulkanCommandBuffer(VulkanCommandPool *pool) : pool(pool)
+inline RenderingBegin::RenderingBegin()
+{
+	renderingInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+	renderingInfo.layerCount = 1;
+}
+
+inline RenderingBegin& RenderingBegin::RenderArea(int x, int y, int width, int height)
+{
+	renderingInfo.renderArea.offset.x = x;
+	renderingInfo.renderArea.offset.y = y;
+	renderingInfo.renderArea.extent.width = width;
+	renderingInfo.renderArea.extent.height = height;
+	return *this;
+}
+
+inline RenderingBegin& RenderingBegin::AddColorAttachment(VulkanImageView* view, VkAttachmentLoadOp loadOp, VkAttachmentStoreOp storeOp, float r, float g, float b, float a)
+{
+	VkRenderingAttachmentInfo attachment = { VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO };
+	attachment.imageView = view->view;
+	attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	attachment.loadOp = loadOp;
+	attachment.storeOp = storeOp;
+	attachment.clearValue.color.float32[0] = r;
+	attachment.clearValue.color.float32[1] = g;
+	attachment.clearValue.color.float32[2] = b;
+	attachment.clearValue.color.float32[3] = a;
+	colorAttachments.push_back(attachment);
+	return *this;
+}
+
+// Resolves the last added color attachment into view when rendering ends
+inline RenderingBegin& RenderingBegin::ResolveAttachment(VulkanImageView* view, VkResolveModeFlagBits mode)
+{
+	VkRenderingAttachmentInfo& attachment = colorAttachments.back();
+	attachment.resolveMode = mode;
+	attachment.resolveImageView = view->view;
+	attachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	return *this;
+}
+
+inline RenderingBegin& RenderingBegin::DepthAttachment(VulkanImageView* view, VkAttachmentLoadOp loadOp, VkAttachmentStoreOp storeOp, float clearDepth)
+{
+	depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	depthAttachment.imageView = view->view;
+	depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+	depthAttachment.loadOp = loadOp;
+	depthAttachment.storeOp = storeOp;
+	depthAttachment.clearValue.depthStencil.depth = clearDepth;
+	renderingInfo.pDepthAttachment = &depthAttachment;
+	return *this;
+}
+
+inline RenderingBegin& RenderingBegin::Flags(VkRenderingFlags flags)
+{
+	renderingInfo.flags = flags;
+	return *this;
+}
+
+inline void RenderingBegin::Execute(VulkanCommandBuffer* cmdbuffer)
+{
+	renderingInfo.colorAttachmentCount = (uint32_t)colorAttachments.size();
+	renderingInfo.pColorAttachments = colorAttachments.data();
+	cmdbuffer->beginRendering(&renderingInfo);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+inline VulkanCommandBuffer::VulkanCommandBuffer(VulkanCommandPool *pool, VkCommandBufferLevel level) : pool(pool)
 {
 	VkCommandBufferAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.level = level;
 	allocInfo.commandPool = pool->pool;
 	allocInfo.commandBufferCount = 1;
 
@@ -656,6 +763,18 @@ inline void VulkanCommandBuffer::begin()
 	CheckVulkanError(result, "Could not begin recording command buffer");
 }
 
+// Begins a secondary command buffer that is executed inside the render pass or rendering described by the inheritance info
+inline void VulkanCommandBuffer::begin(const VkCommandBufferInheritanceInfo* inheritance)
+{
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	beginInfo.pInheritanceInfo = inheritance;
+
+	VkResult result = vkBeginCommandBuffer(buffer, &beginInfo);
+	CheckVulkanError(result, "Could not begin recording command buffer");
+}
+
 inline void VulkanCommandBuffer::end()
 {
 	VkResult result = vkEndCommandBuffer(buffer);
@@ -971,6 +1090,16 @@ inline void VulkanCommandBuffer::endRenderPass()
 	vkCmdEndRenderPass(buffer);
 }
 
+inline void VulkanCommandBuffer::beginRendering(const VkRenderingInfo* pRenderingInfo)
+{
+	vkCmdBeginRenderingKHR(buffer, pRenderingInfo);
+}
+
+inline void VulkanCommandBuffer::endRendering()
+{
+	vkCmdEndRenderingKHR(buffer);
+}
+
 inline void VulkanCommandBuffer::executeCommands(uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers)
 {
 	vkCmdExecuteCommands(buffer, commandBufferCount, pCommandBuffers);
@@ -31,6 +31,7 @@ public:
 	int Width() const { return actualExtent.width; }
 	int Height() const { return actualExtent.height; }
 	VkSurfaceFormatKHR Format() const { return format; }
+	VkImageUsageFlags ImageUsage() const { return imageUsage; }
 
 	int ImageCount() const { return (int)images.size(); }
 	VulkanImage* GetImage(int index) { return images[index].get(); }
@@ -52,6 +53,7 @@ private:
 	VkExtent2D actualExtent = {};
 	VkSwapchainKHR swapchain = VK_NULL_HANDLE;
 	VkSurfaceFormatKHR format = {};
+	VkImageUsageFlags imageUsage = 0;
 	VkPresentModeKHR presentMode;
 	std::vector<std::unique_ptr<VulkanImage>> images;
 	std::vector<std::unique_ptr<VulkanImageView>> views;
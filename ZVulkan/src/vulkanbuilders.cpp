@@ -140,7 +140,13 @@ private:
 	ShaderBuilder* shaderBuilder = nullptr;
 };
 
-std::unique_ptr<VulkanShader> ShaderBuilder::Create(const char *shadername, VulkanDevice *device)
+std::string ShaderBuilder::GetCompilerVersion()
+{
+	glslang::Version version = glslang::GetVersion();
+	return "glslang " + std::to_string(version.major) + "." + std::to_string(version.minor) + "." + std::to_string(version.patch) + version.flavor;
+}
+
+std::vector<uint32_t> ShaderBuilder::CompileSpirv(VulkanDevice *device)
 {
 	EShLanguage stage = (EShLanguage)this->stage;
 
@@ -196,10 +202,16 @@ std::unique_ptr<VulkanShader> ShaderBuilder::Create(const char *shadername, Vulk
 	std::vector<unsigned int> spirv;
 	spv::SpvBuildLogger logger;
 	glslang::GlslangToSpv(*intermediate, spirv, &logger, &spvOptions);
+	return spirv;
+}
+
+std::unique_ptr<VulkanShader> ShaderBuilder::Create(const char *shadername, VulkanDevice *device)
+{
+	std::vector<uint32_t> spirv = spirvCode.empty() ? CompileSpirv(device) : spirvCode;
 
 	VkShaderModuleCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = spirv.size() * sizeof(unsigned int);
+	createInfo.codeSize = spirv.size() * sizeof(uint32_t);
 	createInfo.pCode = spirv.data();
 
 	VkShaderModule shaderModule;
@@ -553,8 +565,22 @@ BufferBuilder& BufferBuilder::MinAlignment(VkDeviceSize memoryAlignment)
 	return *this;
 }
 
+BufferBuilder& BufferBuilder::ImportHostPointer(void* pointer)
+{
+	hostPointer = pointer;
+	return *this;
+}
+
 std::unique_ptr<VulkanBuffer> BufferBuilder::Create(VulkanDevice* device)
 {
+	if (hostPointer)
+	{
+		auto obj = TryImport(device);
+		if (!obj)
+			VulkanError("Could not import host memory for vulkan buffer");
+		return obj;
+	}
+
 	VkBuffer buffer;
 	VmaAllocation allocation;
 
@@ -575,6 +601,101 @@ std::unique_ptr<VulkanBuffer> BufferBuilder::Create(VulkanDevice* device)
 	return obj;
 }
 
+std::unique_ptr<VulkanBuffer> BufferBuilder::TryCreate(VulkanDevice* device)
+{
+	if (hostPointer)
+		return TryImport(device);
+
+	VkBuffer buffer;
+	VmaAllocation allocation;
+
+	VkResult result;
+	if (minAlignment == 0)
+		result = vmaCreateBuffer(device->allocator, &bufferInfo, &allocInfo, &buffer, &allocation, nullptr);
+	else
+		result = vmaCreateBufferWithAlignment(device->allocator, &bufferInfo, &allocInfo, minAlignment, &buffer, &allocation, nullptr);
+	if (result != VK_SUCCESS)
+		return nullptr;
+
+	auto obj = std::make_unique<VulkanBuffer>(device, buffer, allocation, (size_t)bufferInfo.size);
+	if (debugName)
+		obj->SetDebugName(debugName);
+	return obj;
+}
+
+std::unique_ptr<VulkanBuffer> BufferBuilder::TryImport(VulkanDevice* device)
+{
+	if (!device->SupportsExtension(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME))
+		return nullptr;
+
+	VkMemoryHostPointerPropertiesEXT hostProps = { VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT };
+	VkResult result = vkGetMemoryHostPointerPropertiesEXT(device->device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, hostPointer, &hostProps);
+	if (result != VK_SUCCESS)
+		return nullptr;
+
+	VkExternalMemoryBufferCreateInfo externalInfo = { VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO };
+	externalInfo.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+	VkBufferCreateInfo createInfo = bufferInfo;
+	createInfo.pNext = &externalInfo;
+
+	VkBuffer buffer;
+	result = vkCreateBuffer(device->device, &createInfo, nullptr, &buffer);
+	if (result != VK_SUCCESS)
+		return nullptr;
+
+	VkMemoryRequirements requirements = {};
+	vkGetBufferMemoryRequirements(device->device, buffer, &requirements);
+
+	uint32_t memoryTypeBits = requirements.memoryTypeBits & hostProps.memoryTypeBits;
+	uint32_t memoryTypeIndex = VK_MAX_MEMORY_TYPES;
+	const VkPhysicalDeviceMemoryProperties& memoryProps = device->PhysicalDevice.Properties.Memory;
+	for (uint32_t i = 0; i < memoryProps.memoryTypeCount; i++)
+	{
+		if ((memoryTypeBits & (1 << i)) && (memoryProps.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+		{
+			memoryTypeIndex = i;
+			break;
+		}
+	}
+
+	if (memoryTypeIndex == VK_MAX_MEMORY_TYPES)
+	{
+		vkDestroyBuffer(device->device, buffer, nullptr);
+		return nullptr;
+	}
+
+	VkImportMemoryHostPointerInfoEXT importInfo = { VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT };
+	importInfo.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+	importInfo.pHostPointer = hostPointer;
+
+	VkMemoryAllocateInfo memoryInfo = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+	memoryInfo.pNext = &importInfo;
+	memoryInfo.allocationSize = bufferInfo.size;
+	memoryInfo.memoryTypeIndex = memoryTypeIndex;
+
+	VkDeviceMemory memory;
+	result = vkAllocateMemory(device->device, &memoryInfo, nullptr, &memory);
+	if (result != VK_SUCCESS)
+	{
+		vkDestroyBuffer(device->device, buffer, nullptr);
+		return nullptr;
+	}
+
+	result = vkBindBufferMemory(device->device, buffer, memory, 0);
+	if (result != VK_SUCCESS)
+	{
+		vkFreeMemory(device->device, memory, nullptr);
+		vkDestroyBuffer(device->device, buffer, nullptr);
+		return nullptr;
+	}
+
+	auto obj = std::make_unique<VulkanBuffer>(device, buffer, memory, (size_t)bufferInfo.size);
+	if (debugName)
+		obj->SetDebugName(debugName);
+	return obj;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 
 AccelerationStructureBuilder::AccelerationStructureBuilder()
@@ -645,10 +766,31 @@ ComputePipelineBuilder& ComputePipelineBuilder::ComputeShader(VulkanShader* shad
 	return *this;
 }
 
+ComputePipelineBuilder& ComputePipelineBuilder::AddSpecializationConstant(uint32_t constantID, uint32_t value)
+{
+	VkSpecializationMapEntry entry = {};
+	entry.constantID = constantID;
+	entry.offset = (uint32_t)(specializationData.size() * sizeof(uint32_t));
+	entry.size = sizeof(uint32_t);
+	specializationEntries.push_back(entry);
+	specializationData.push_back(value);
+	return *this;
+}
+
 std::unique_ptr<VulkanPipeline> ComputePipelineBuilder::Create(VulkanDevice* device)
 {
-	VkPipeline pipeline;
-	vkCreateComputePipelines(device->device, cache ? cache->cache : VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+	if (!specializationEntries.empty())
+	{
+		specializationInfo.mapEntryCount = (uint32_t)specializationEntries.size();
+		specializationInfo.pMapEntries = specializationEntries.data();
+		specializationInfo.dataSize = specializationData.size() * sizeof(uint32_t);
+		specializationInfo.pData = specializationData.data();
+		pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
+	}
+
+	VkPipeline pipeline = 0;
+	VkResult result = vkCreateComputePipelines(device->device, cache ? cache->cache : VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+	CheckVulkanError(result, "Could not create compute pipeline");
 	auto obj = std::make_unique<VulkanPipeline>(device, pipeline);
 	if (debugName)
 		obj->SetDebugName(debugName);
@@ -977,7 +1119,19 @@ GraphicsPipelineBuilder& GraphicsPipelineBuilder::Layout(VulkanPipelineLayout* l
 
 GraphicsPipelineBuilder& GraphicsPipelineBuilder::RenderPass(VulkanRenderPass* renderPass)
 {
-	pipelineInfo.renderPass = renderPass->renderPass;
+	pipelineInfo.renderPass = renderPass ? renderPass->renderPass : VK_NULL_HANDLE;
+	return *this;
+}
+
+GraphicsPipelineBuilder& GraphicsPipelineBuilder::AddColorAttachmentFormat(VkFormat format)
+{
+	colorAttachmentFormats.push_back(format);
+	return *this;
+}
+
+GraphicsPipelineBuilder& GraphicsPipelineBuilder::DepthAttachmentFormat(VkFormat format)
+{
+	renderingInfo.depthAttachmentFormat = format;
 	return *this;
 }
 
@@ -1097,6 +1251,18 @@ GraphicsPipelineBuilder& GraphicsPipelineBuilder::AddFragmentShader(VulkanShader
 	return *this;
 }
 
+GraphicsPipelineBuilder& GraphicsPipelineBuilder::AddSpecializationConstant(VkShaderStageFlags stages, uint32_t constantID, uint32_t value)
+{
+	VkSpecializationMapEntry entry = {};
+	entry.constantID = constantID;
+	entry.offset = (uint32_t)(specializationData.size() * sizeof(uint32_t));
+	entry.size = sizeof(uint32_t);
+	specializationEntries.push_back(entry);
+	specializationData.push_back(value);
+	specializationStages |= stages;
+	return *this;
+}
+
 GraphicsPipelineBuilder& GraphicsPipelineBuilder::AddVertexBufferBinding(int index, size_t stride)
 {
 	VkVertexInputBindingDescription desc = {};
@@ -1139,6 +1305,27 @@ std::unique_ptr<VulkanPipeline> GraphicsPipelineBuilder::Create(VulkanDevice* de
 	colorBlending.pAttachments = colorBlendAttachments.data();
 	colorBlending.attachmentCount = (uint32_t)colorBlendAttachments.size();
 
+	if (!specializationEntries.empty())
+	{
+		specializationInfo.mapEntryCount = (uint32_t)specializationEntries.size();
+		specializationInfo.pMapEntries = specializationEntries.data();
+		specializationInfo.dataSize = specializationData.size() * sizeof(uint32_t);
+		specializationInfo.pData = specializationData.data();
+		for (auto& stage : shaderStages)
+		{
+			if (stage.stage & specializationStages)
+				stage.pSpecializationInfo = &specializationInfo;
+		}
+	}
+
+	// Without a render pass the attachment formats come from VK_KHR_dynamic_rendering
+	if (pipelineInfo.renderPass == VK_NULL_HANDLE)
+	{
+		renderingInfo.colorAttachmentCount = (uint32_t)colorAttachmentFormats.size();
+		renderingInfo.pColorAttachmentFormats = colorAttachmentFormats.data();
+		pipelineInfo.pNext = &renderingInfo;
+	}
+
 	VkPipeline pipeline = 0;
 	VkResult result = vkCreateGraphicsPipelines(device->device, cache ? cache->cache : VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
 	CheckVulkanError(result, "Could not create graphics pipeline");
@@ -1316,6 +1503,18 @@ RenderPassBuilder& RenderPassBuilder::AddSubpassColorAttachmentRef(uint32_t inde
 	return *this;
 }
 
+// Adds the resolve target for the color attachment ref with the same position. Must be added for every color attachment or none.
+RenderPassBuilder& RenderPassBuilder::AddSubpassResolveAttachmentRef(uint32_t index, VkImageLayout layout)
+{
+	VkAttachmentReference resolveAttachmentRef = {};
+	resolveAttachmentRef.attachment = index;
+	resolveAttachmentRef.layout = layout;
+
+	subpassData.back()->resolveRefs.push_back(resolveAttachmentRef);
+	subpasses.back().pResolveAttachments = subpassData.back()->resolveRefs.data();
+	return *this;
+}
+
 RenderPassBuilder& RenderPassBuilder::AddSubpassDepthStencilAttachmentRef(uint32_t index, VkImageLayout layout)
 {
 	VkAttachmentReference& depthAttachmentRef = subpassData.back()->depthRef;
@@ -1557,6 +1756,49 @@ WriteDescriptors& WriteDescriptors::AddCombinedImageSampler(VulkanDescriptorSet*
 	return *this;
 }
 
+WriteDescriptors& WriteDescriptors::AddSampledImage(VulkanDescriptorSet* descriptorSet, int binding, int arrayIndex, VulkanImageView* view, VkImageLayout imageLayout)
+{
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.imageView = view->view;
+	imageInfo.imageLayout = imageLayout;
+
+	auto extra = std::make_unique<WriteExtra>();
+	extra->imageInfo = imageInfo;
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = descriptorSet->set;
+	descriptorWrite.dstBinding = binding;
+	descriptorWrite.dstArrayElement = arrayIndex;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pImageInfo = &extra->imageInfo;
+	writes.push_back(descriptorWrite);
+	writeExtras.push_back(std::move(extra));
+	return *this;
+}
+
+WriteDescriptors& WriteDescriptors::AddSampler(VulkanDescriptorSet* descriptorSet, int binding, int arrayIndex, VulkanSampler* sampler)
+{
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.sampler = sampler->sampler;
+
+	auto extra = std::make_unique<WriteExtra>();
+	extra->imageInfo = imageInfo;
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = descriptorSet->set;
+	descriptorWrite.dstBinding = binding;
+	descriptorWrite.dstArrayElement = arrayIndex;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pImageInfo = &extra->imageInfo;
+	writes.push_back(descriptorWrite);
+	writeExtras.push_back(std::move(extra));
+	return *this;
+}
+
 WriteDescriptors& WriteDescriptors::AddAccelerationStructure(VulkanDescriptorSet* descriptorSet, int binding, VulkanAccelerationStructure* accelStruct)
 {
 	auto extra = std::make_unique<WriteExtra>();
@@ -1708,6 +1950,14 @@ VulkanDeviceBuilder& VulkanDeviceBuilder::OptionalDescriptorIndexing()
 	return *this;
 }
 
+VulkanDeviceBuilder& VulkanDeviceBuilder::OptionalDynamicRendering()
+{
+	OptionalExtension(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
+	OptionalExtension(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME);
+	OptionalExtension(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+	return *this;
+}
+
 VulkanDeviceBuilder& VulkanDeviceBuilder::Surface(std::shared_ptr<VulkanSurface> surface)
 {
 	if (surface)
@@ -1780,6 +2030,7 @@ std::vector<VulkanCompatibleDevice> VulkanDeviceBuilder::FindDevices(const std::
 		enabledFeatures.DescriptorIndexing.descriptorBindingSampledImageUpdateAfterBind = deviceFeatures.DescriptorIndexing.descriptorBindingSampledImageUpdateAfterBind;
 		enabledFeatures.DescriptorIndexing.descriptorBindingVariableDescriptorCount = deviceFeatures.DescriptorIndexing.descriptorBindingVariableDescriptorCount;
 		enabledFeatures.DescriptorIndexing.shaderSampledImageArrayNonUniformIndexing = deviceFeatures.DescriptorIndexing.shaderSampledImageArrayNonUniformIndexing;
+		enabledFeatures.DynamicRendering.dynamicRendering = deviceFeatures.DynamicRendering.dynamicRendering;
 
 		// Figure out which queue can present
 		if (surface)
@@ -137,6 +137,11 @@ void VulkanDevice::CreateDevice()
 		*next = &EnabledFeatures.DescriptorIndexing;
 		next = &EnabledFeatures.DescriptorIndexing.pNext;
 	}
+	if (SupportsExtension(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME))
+	{
+		*next = &EnabledFeatures.DynamicRendering;
+		next = &EnabledFeatures.DynamicRendering.pNext;
+	}
 
 	VkResult result = vkCreateDevice(PhysicalDevice.Device, &deviceCreateInfo, nullptr, &device);
 	CheckVulkanError(result, "Could not create vulkan device");
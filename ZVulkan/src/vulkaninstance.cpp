@@ -267,12 +267,18 @@ std::vector<VulkanPhysicalDevice> VulkanInstance::GetPhysicalDevices(VkInstance
 				*next = &dev.Properties.LayeredDriver;
 				next = &dev.Properties.LayeredDriver.pNext;
 			}
+			if (checkForExtension(VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME))
+			{
+				*next = &dev.Properties.ExternalMemoryHost;
+				next = &dev.Properties.ExternalMemoryHost.pNext;
+			}
 
 			vkGetPhysicalDeviceProperties2(dev.Device, &deviceProperties2);
 			dev.Properties.Properties = deviceProperties2.properties;
 			dev.Properties.AccelerationStructure.pNext = nullptr;
 			dev.Properties.DescriptorIndexing.pNext = nullptr;
 			dev.Properties.LayeredDriver.pNext = nullptr;
+			dev.Properties.ExternalMemoryHost.pNext = nullptr;
 
 			VkPhysicalDeviceFeatures2 deviceFeatures2 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 };
 
@@ -297,6 +303,11 @@ std::vector<VulkanPhysicalDevice> VulkanInstance::GetPhysicalDevices(VkInstance
 				*next = &dev.Features.DescriptorIndexing;
 				next = &dev.Features.DescriptorIndexing.pNext;
 			}
+			if (checkForExtension(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME))
+			{
+				*next = &dev.Features.DynamicRendering;
+				next = &dev.Features.DynamicRendering.pNext;
+			}
 
 			vkGetPhysicalDeviceFeatures2(dev.Device, &deviceFeatures2);
 			dev.Features.Features = deviceFeatures2.features;
@@ -304,6 +315,7 @@ std::vector<VulkanPhysicalDevice> VulkanInstance::GetPhysicalDevices(VkInstance
 			dev.Features.AccelerationStructure.pNext = nullptr;
 			dev.Features.RayQuery.pNext = nullptr;
 			dev.Features.DescriptorIndexing.pNext = nullptr;
+			dev.Features.DynamicRendering.pNext = nullptr;
 		}
 		else
 		{
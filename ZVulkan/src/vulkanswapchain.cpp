@@ -163,7 +163,11 @@ bool VulkanSwapChain::CreateSwapchain(int width, int height, int imageCount, boo
 	swapChainCreateInfo.imageColorSpace = format.colorSpace;
 	swapChainCreateInfo.imageExtent = actualExtent;
 	swapChainCreateInfo.imageArrayLayers = 1;
-	swapChainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	// Transfer destination lets a compute pass output be blitted into the swap chain
+	imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	if (caps.Capabilites.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+		imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	swapChainCreateInfo.imageUsage = imageUsage;
 
 	uint32_t queueFamilyIndices[] = { (uint32_t)device->GraphicsFamily, (uint32_t)device->PresentFamily };
 	if (device->GraphicsFamily != device->PresentFamily)